@@ -2,9 +2,12 @@
 #define BMP_280_H
 
 #include "common_inc.h"
+#include "spi_td3_ioctl.h"
 
-float get_bmp280_temp();
+float get_bmp280_temp(int32_t *raw_adc);
 ssize_t set_bmp280_control_reg(uint32_t value);
+int bmp280_start_sampling(uint32_t rate_hz, uint16_t batch);
+float bmp280_sample_temp(const struct spi_td3_sample *sample, int32_t *raw_adc);
 
 typedef struct
 {
@@ -19,5 +22,6 @@ typedef struct
 
 #define BMP280_REG_RESULT_TEMPRERATURE 0xFA  // 0xFA(msb) , 0xFB(lsb) , 0xFC(xlsb)
 #define BMP280_REG_CONTROL 0xF4
+#define BMP280_REG_CALIB 0x88                // dig_T1..dig_T3, little endian
 
 #endif
\ No newline at end of file
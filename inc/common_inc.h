@@ -15,6 +15,9 @@
 #include <sys/types.h>
 #include <sys/prctl.h>
 
+#include "sample_ring.h"
+#include "latest_sample.h"
+
 /* Semaphore primitives */
 void sem_initialise(int sem_num, int val);
 void sem_take(int sem_num);
@@ -24,7 +27,8 @@ void sem_give(int sem_num);
 /** Struct para manejo de memoria compartida */
 typedef struct
 {
-    float current_temp;
+    sample_ring_t ring;    /* Samples published by the owner process */
+    latest_slot_t latest; /* Last reading published by the owner process */
 } shared_mem_t;
 
 
@@ -34,6 +38,8 @@ typedef struct
     uint32_t max_conn;
     uint32_t read_interval;
     uint32_t samples;
+    uint32_t workers;
+    uint32_t queue_depth;
 } config_file_t;
 
 
@@ -45,6 +51,8 @@ typedef struct
     uint32_t max_conn;
     uint32_t read_interval;
     uint32_t samples;
+    uint32_t workers;
+    uint32_t queue_depth;
     shared_mem_t *shared_data_1;
     shared_mem_t *shared_data_2;
     config_file_t *config_file;
@@ -58,14 +66,12 @@ typedef struct
 } last_temp_t;
 
 
-struct pollfd fdinfo[1];
+extern struct pollfd fdinfo[1];
 
 /** IPC flag for file.cfg modifications */
 extern bool flag_sigusr1;
 
 #define SEM_MUTEX 0
-#define SEM_FULL 1
-#define SEM_EMPTY 2
 
 
 #define ERROR -1
@@ -4,6 +4,12 @@
 #include "common_inc.h"
 
 
+/* Driver sampling, one reading per second published as soon as it is taken */
+#define DRIVER_SAMPLE_RATE_HZ 1
+#define DRIVER_SAMPLE_BATCH 1
+#define DRIVER_SAMPLE_TIMEOUT_MS 5000 /* Warn when the driver stops sampling */
+
+
 void child_driver_handler(ctx_t *ctx);
 
 
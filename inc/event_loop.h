@@ -0,0 +1,74 @@
+/**
+ * @file event_loop.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for event_loop.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include "webserver.h"
+#include "common_inc.h"
+#include "worker_pool.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+
+/* Event loop defines */
+#define EVENT_LOOP_MAX_EVENTS 64
+#define EVENT_LOOP_TIMEOUT_MS 1000
+#define CONN_READ_BUF_SIZE 4096
+
+
+/** Connection state machine */
+typedef enum
+{
+    CONN_READING,    /* Waiting for the full request header */
+    CONN_PROCESSING, /* Owned by a worker building the response */
+    CONN_WRITING,    /* Flushing the response */
+    CONN_CLOSING,    /* Done, release on the next pass */
+    CONN_CLOSED      /* Released, freed once the epoll batch is handled */
+} conn_state_t;
+
+
+typedef struct event_loop_s event_loop_t;
+
+
+/** Per connection state owned by the event loop */
+typedef struct conn_s
+{
+    int fd;
+    event_loop_t *loop;
+    struct conn_s *next; /* Completion or closed list link */
+    conn_state_t state;
+    char read_buf[CONN_READ_BUF_SIZE];
+    size_t read_len;
+    char *write_buf;
+    size_t write_len;
+    size_t write_pos;
+} conn_t;
+
+
+/** Event loop state */
+struct event_loop_s
+{
+    ctx_t *ctx;
+    int epoll_fd;
+    int listen_fd;
+    int done_fd; /* eventfd signalled by the workers */
+    pthread_mutex_t done_lock;
+    conn_t *done_head; /* Responses ready to be written */
+    conn_t *closed_head; /* Closed in this epoll batch, later events may still point to them */
+    worker_pool_t pool;
+};
+
+
+ssize_t event_loop_run(ctx_t *ctx, int listen_fd);
+
+#endif
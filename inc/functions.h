@@ -18,8 +18,8 @@
 extern bool flag_sigusr1;
 
 void update_ctx_from_file(ctx_t *ctx);
-float get_current_temp(ctx_t *ctx);
 ssize_t read_config_file(config_file_t *config_file, const char *file);
 char *get_base64_plot(const char *file_path);
+char *image_base64_encode(const unsigned char *data, size_t input_length);
 
 #endif
\ No newline at end of file
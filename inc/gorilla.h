@@ -0,0 +1,60 @@
+/**
+ * @file gorilla.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for gorilla.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef GORILLA_H
+#define GORILLA_H
+
+#include "common_inc.h"
+
+
+/** Streaming encoder, the output grows as samples are added */
+typedef struct
+{
+    uint8_t *data;
+    size_t capacity;
+    uint64_t bits;          /* Bits written */
+    uint32_t count;         /* Samples encoded */
+    int64_t prev_timestamp;
+    int64_t prev_delta;
+    uint32_t prev_value;    /* Bits of the previous float */
+    uint8_t prev_leading;   /* XOR window of the previous value */
+    uint8_t prev_trailing;
+} gorilla_encoder_t;
+
+
+/** Streaming decoder over an encoded block */
+typedef struct
+{
+    const uint8_t *data;
+    uint64_t size;          /* Size in bits */
+    uint64_t pos;           /* Next bit to read */
+    uint32_t remaining;     /* Samples left */
+    uint32_t decoded;
+    int64_t prev_timestamp;
+    int64_t prev_delta;
+    uint32_t prev_value;
+    uint8_t prev_leading;
+    uint8_t prev_trailing;
+} gorilla_decoder_t;
+
+
+void gorilla_encoder_init(gorilla_encoder_t *encoder);
+void gorilla_encoder_free(gorilla_encoder_t *encoder);
+ssize_t gorilla_encode(gorilla_encoder_t *encoder, int64_t timestamp, float value);
+size_t gorilla_encoder_size(const gorilla_encoder_t *encoder);
+
+void gorilla_decoder_init(gorilla_decoder_t *decoder,
+                          const uint8_t *data,
+                          size_t size,
+                          uint32_t count);
+bool gorilla_decode(gorilla_decoder_t *decoder, int64_t *timestamp, float *value);
+
+#endif
@@ -0,0 +1,60 @@
+/**
+ * @file history.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for history.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "common_inc.h"
+#include "gorilla.h"
+#include "ts_store.h"
+
+
+/* Segment files */
+#define HISTORY_DIR "./sup/history"
+#define HISTORY_MAGIC 0x53524f47     /* "GORS" */
+#define HISTORY_VERSION 1
+#define HISTORY_SPAN (60 * 60 * 1000) /* Milliseconds covered by each segment */
+
+
+/** Header of a sealed segment, followed by the encoded samples */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;  /* Samples in the segment */
+    uint32_t size;   /* Bytes of encoded samples */
+    int64_t first;   /* Timestamp of the first sample */
+    int64_t last;    /* Timestamp of the last sample */
+} history_header_t;
+
+
+/** Writer side, owned by the plot handler */
+typedef struct
+{
+    gorilla_encoder_t encoder; /* Segment being filled */
+    int64_t start;             /* Start of its span */
+    int64_t first;
+    int64_t last;
+    int64_t sealed;            /* Last timestamp already in a sealed segment */
+    ts_store_t *raw;           /* Raw store, trimmed to the samples not sealed yet */
+} history_writer_t;
+
+
+/** Called for each sample of a query, returning false stops it */
+typedef bool (*history_callback_t)(int64_t timestamp, float value, void *arg);
+
+
+ssize_t history_writer_open(history_writer_t *writer, ts_store_t *raw);
+void history_writer_close(history_writer_t *writer);
+ssize_t history_add(history_writer_t *writer, int64_t timestamp, float value);
+ssize_t history_query(int64_t from, int64_t to, history_callback_t callback, void *arg);
+
+#endif
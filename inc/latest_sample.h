@@ -0,0 +1,42 @@
+/**
+ * @file latest_sample.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for latest_sample.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef LATEST_SAMPLE_H
+#define LATEST_SAMPLE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+/** Last sensor reading */
+typedef struct
+{
+    float value;        /* Compensated temperature */
+    int32_t raw;        /* Raw ADC reading */
+    int64_t timestamp;  /* CLOCK_MONOTONIC in nanoseconds */
+    int64_t wall_time;  /* Epoch in milliseconds, for display */
+    uint64_t sequence;  /* Readings published so far */
+} latest_sample_t;
+
+
+/** Seqlock protected slot living in shared memory, seq is odd while the writer updates it */
+typedef struct
+{
+    uint32_t seq;
+    latest_sample_t sample;
+} latest_slot_t;
+
+
+void latest_sample_publish(latest_slot_t *slot, const latest_sample_t *sample);
+bool latest_sample_read(latest_slot_t *slot, latest_sample_t *sample);
+int64_t latest_sample_monotonic_now(void);
+
+#endif
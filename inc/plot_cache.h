@@ -0,0 +1,32 @@
+/**
+ * @file plot_cache.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for plot_cache.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef PLOT_CACHE_H
+#define PLOT_CACHE_H
+
+#include "webserver.h"
+#include "common_inc.h"
+
+
+/** Encoded plot shared by every request of the same generation */
+typedef struct
+{
+    uint32_t refcount;   /* Owners, the cache counts as one */
+    uint64_t generation; /* Sample generation it was rendered from */
+    size_t length;       /* Length of data */
+    char *data;          /* Base64 encoded image, NUL terminated */
+} plot_image_t;
+
+
+plot_image_t *plot_cache_get(ctx_t *ctx);
+void plot_cache_put(plot_image_t *image);
+
+#endif
@@ -2,9 +2,12 @@
 #define PLOT_HANDLER_H
 #include "common_inc.h"
 #include "functions.h"
+#include "plot_render.h"
+#include "ts_store.h"
+#include "rollup.h"
+#include "history.h"
 
 void child_plot_handler(ctx_t* ctx);
-void get_last_temp(last_temp_t* last_temp);
-void generate_temperature_plot();
+void get_last_temp(ctx_t* ctx, last_temp_t* last_temp);
 
 #endif
@@ -0,0 +1,60 @@
+/**
+ * @file plot_render.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for plot_render.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef PLOT_RENDER_H
+#define PLOT_RENDER_H
+
+#ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#endif
+
+#include <time.h>
+
+#include "common_inc.h"
+
+
+/* Plot layout, same as the old gnuplot setup */
+#define PLOT_WIDTH 640
+#define PLOT_HEIGHT 480
+#define PLOT_Y_MIN 10
+#define PLOT_Y_MAX 45
+#define PLOT_Y_TIC 5
+#define PLOT_X_TIC 60            /* Seconds between time tics */
+#define PLOT_WINDOW_BEFORE 120   /* Seconds shown before now */
+#define PLOT_WINDOW_AFTER 30     /* Seconds shown after now */
+#define PLOT_MAX_SAMPLES 1024
+
+
+/** Sample to plot */
+typedef struct
+{
+    time_t timestamp;
+    float value;
+} plot_sample_t;
+
+
+/** Growable output buffer */
+typedef struct
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+} plot_buffer_t;
+
+
+ssize_t plot_render_svg(plot_buffer_t *buf,
+                        const plot_sample_t *samples,
+                        size_t count,
+                        time_t start,
+                        time_t end);
+void plot_buffer_free(plot_buffer_t *buf);
+
+#endif
@@ -0,0 +1,62 @@
+/**
+ * @file rollup.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for rollup.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include "common_inc.h"
+#include "history.h"
+#include "ts_store.h"
+
+
+/* Rollup tiers, from finest to coarsest */
+#define ROLLUP_TIERS 3
+#define ROLLUP_PATH_FORMAT "./sup/rollup_%s.tsdb"
+#define ROLLUP_MAX_POINTS 10000 /* Buckets returned by a single query */
+
+
+/** Aggregated bucket, stored in one ts_store file per tier */
+typedef struct
+{
+    int64_t timestamp; /* Bucket start, epoch in milliseconds */
+    float min;
+    float max;
+    float mean;
+    uint32_t count;
+} rollup_record_t;
+
+
+/** Bucket being filled */
+typedef struct
+{
+    int64_t start;
+    float min;
+    float max;
+    double sum;
+    uint32_t count;
+} rollup_bucket_t;
+
+
+/** Writer side, owned by the plot handler */
+typedef struct
+{
+    ts_store_t stores[ROLLUP_TIERS];
+    rollup_bucket_t open[ROLLUP_TIERS];
+    int64_t flushed[ROLLUP_TIERS]; /* Start of the last stored bucket */
+} rollup_writer_t;
+
+
+ssize_t rollup_writer_open(rollup_writer_t *writer);
+void rollup_writer_close(rollup_writer_t *writer);
+void rollup_add(rollup_writer_t *writer, int64_t timestamp, float value);
+ssize_t rollup_query(int64_t from, int64_t to, int64_t step, rollup_record_t **out, size_t *count);
+
+#endif
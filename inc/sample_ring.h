@@ -0,0 +1,57 @@
+/**
+ * @file sample_ring.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for sample_ring.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+/* Ring size, must be a power of two */
+#define SAMPLE_RING_SIZE 512
+#define SAMPLE_RING_MASK (SAMPLE_RING_SIZE - 1)
+
+
+/** Timestamped sample */
+typedef struct
+{
+    int64_t timestamp; /* Epoch in milliseconds */
+    float value;
+} sample_t;
+
+
+/** Ring slot, seq is odd while the producer writes it */
+typedef struct
+{
+    uint32_t seq;
+    sample_t sample;
+} sample_slot_t;
+
+
+/** Single producer, multi consumer ring living in shared memory */
+typedef struct
+{
+    uint64_t head; /* Samples published so far */
+    sample_slot_t slots[SAMPLE_RING_SIZE];
+} sample_ring_t;
+
+
+void sample_ring_publish(sample_ring_t *ring, const sample_t *sample);
+uint64_t sample_ring_head(sample_ring_t *ring);
+size_t sample_ring_read(sample_ring_t *ring,
+                        uint64_t *cursor,
+                        sample_t *samples,
+                        size_t max_samples,
+                        uint64_t *missed);
+int64_t sample_time_now(void);
+
+#endif
@@ -0,0 +1,185 @@
+/**
+ * @file spi_td3_ioctl.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief ioctl interface of /dev/spi_td3, shared by the driver and userspace
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef SPI_TD3_IOCTL_H
+#define SPI_TD3_IOCTL_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+
+#define SPI_TD3_IOC_MAGIC 't'
+
+
+/**
+ * One segment of a message. Segments run back to back in a single syscall, like spidev's
+ * SPI_IOC_MESSAGE
+ */
+struct spi_td3_segment
+{
+    __u64 tx_buf;      /* User pointer to the bytes to send, 0 to send zeros */
+    __u64 rx_buf;      /* User pointer for the bytes received, 0 to drop them */
+    __u32 len;         /* Bytes to transfer */
+    __u16 delay_usecs; /* Delay after the segment, before CS changes */
+    __u8 keep_cs;      /* Keep CS asserted into the next segment */
+    __u8 pad;
+};
+
+
+#define SPI_TD3_MAX_SEGMENTS 16
+
+/* Size of a message of n segments, 0 when it does not fit in the ioctl size field */
+#define SPI_TD3_MSGSIZE(n)                                                 \
+    ((((n) * (sizeof(struct spi_td3_segment))) < (1 << _IOC_SIZEBITS)) ? \
+       ((n) * (sizeof(struct spi_td3_segment)))                            \
+       : 0)
+
+/* Run n segments, returns the total bytes transferred */
+#define SPI_TD3_IOC_MESSAGE(n) _IOW(SPI_TD3_IOC_MAGIC, 0, char[SPI_TD3_MSGSIZE(n)])
+
+
+#define SPI_TD3_SAMPLE_MAX 11    /* Bytes of one sample */
+#define SPI_TD3_RATE_MAX 2000    /* Samples per second */
+#define SPI_TD3_FIFO_SAMPLES 256 /* Samples buffered in the driver */
+
+/**
+ * Periodic sampling. The driver reads the sensor from a high resolution timer and queues
+ * timestamped samples, read() then returns whole samples instead of running a transfer
+ */
+struct spi_td3_sampling
+{
+    __u32 rate_hz; /* Samples per second up to SPI_TD3_RATE_MAX, 0 stops sampling */
+    __u16 batch;   /* Samples a blocking read() waits for, up to SPI_TD3_FIFO_SAMPLES / 2 */
+    __u8 command;  /* Byte sent first, the register to read with the read bit set */
+    __u8 len;      /* Bytes read after the command, up to SPI_TD3_SAMPLE_MAX */
+};
+
+
+/** One sample, as returned by read() while sampling */
+struct spi_td3_sample
+{
+    __s64 timestamp_ns; /* CLOCK_MONOTONIC when CS was asserted */
+    __u32 sequence;     /* Gaps mean samples were dropped because nobody read them */
+    __u8 len;
+    __u8 data[SPI_TD3_SAMPLE_MAX];
+};
+
+
+/* Start, reconfigure or stop periodic sampling */
+#define SPI_TD3_IOC_SAMPLING _IOW(SPI_TD3_IOC_MAGIC, 1, struct spi_td3_sampling)
+
+
+#define SPI_TD3_CPHA 0x01 /* Data sampled on the trailing edge */
+#define SPI_TD3_CPOL 0x02 /* SCLK idles high */
+#define SPI_TD3_MODE_0 0
+#define SPI_TD3_MODE_3 (SPI_TD3_CPOL | SPI_TD3_CPHA)
+
+#define SPI_TD3_SPEED_MAX 48000000 /* McSPI functional clock */
+#define SPI_TD3_CS_DELAY_MAX 50000 /* ns */
+
+/**
+ * Bus configuration of a chip select. Words wider than 8 bits are native endian in the read,
+ * write and message buffers, and transfers must be made of whole words. A new configuration is
+ * applied between transactions, the ones queued before it run with the previous one
+ */
+struct spi_td3_config
+{
+    __u32 speed_hz;       /* SCLK, rounded down to SPI_TD3_SPEED_MAX / n, n up to 4096 */
+    __u8 mode;            /* SPI_TD3_CPOL | SPI_TD3_CPHA */
+    __u8 bits_per_word;   /* 8, 16 or 32 */
+    __u16 cs_setup_ns;    /* From CS asserted to the first edge */
+    __u16 cs_hold_ns;     /* From the last edge to CS released */
+    __u16 cs_inactive_ns; /* From CS released until it can be asserted again */
+};
+
+
+/* Get the configuration of the chip select */
+#define SPI_TD3_IOC_RD_CONFIG _IOR(SPI_TD3_IOC_MAGIC, 2, struct spi_td3_config)
+
+/* Configure the chip select, returns the configuration applied with the speed rounded */
+#define SPI_TD3_IOC_WR_CONFIG _IOWR(SPI_TD3_IOC_MAGIC, 2, struct spi_td3_config)
+
+
+#define SPI_TD3_RING_MAGIC 0x52335444 /* "DT3R" */
+#define SPI_TD3_RING_VERSION 1
+#define SPI_TD3_RING_HEADER_SIZE 4096 /* Header page, the slots start on the next page */
+#define SPI_TD3_RING_SAMPLES 4096     /* Power of two */
+#define SPI_TD3_RING_SIZE \
+    (SPI_TD3_RING_HEADER_SIZE + SPI_TD3_RING_SAMPLES * sizeof(struct spi_td3_sample))
+
+/**
+ * Header page of the sample ring mmap()ed from the device. Every sample taken while sampling is
+ * written to slot head % capacity before head is published. The driver never waits for the
+ * consumer, samples it falls a whole ring behind on are overwritten and counted
+ */
+struct spi_td3_ring_header
+{
+    __u32 magic;
+    __u32 version;
+    __u32 sample_size;
+    __u32 capacity;
+    __u64 head;     /* Samples written since the driver was loaded, written by the driver */
+    __u64 tail;     /* Next sample to consume, written by the consumer */
+    __u64 overruns; /* Samples overwritten before the consumer got to them */
+};
+
+
+#ifndef __KERNEL__
+
+/**
+ * @brief Consume the samples written since the tail of a mapped ring, without syscalls. Only one
+ * consumer per ring
+ *
+ * @param ring Mapping of the device
+ * @param out Samples
+ * @param max Room in out
+ * @return unsigned int Samples copied
+ */
+static inline unsigned int spi_td3_ring_consume(struct spi_td3_ring_header *ring,
+                                                struct spi_td3_sample *out,
+                                                unsigned int max)
+{
+    const struct spi_td3_sample *slots =
+      ( const struct spi_td3_sample * )(( const char * )ring + SPI_TD3_RING_HEADER_SIZE);
+    __u64 head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    __u64 tail = ring->tail, next;
+    unsigned int n = 0, valid = 0;
+
+    if(head - tail > ring->capacity)
+    {
+        tail = head - ring->capacity;
+    }
+
+    for(next = tail; next < head && n < max; next++)
+    {
+        out[n++] = slots[next % ring->capacity];
+    }
+
+    /* Drop the copies of slots the driver started to overwrite meanwhile */
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+
+    for(unsigned int i = 0; i < n; i++)
+    {
+        if(head - (tail + i) < ring->capacity)
+        {
+            out[valid++] = out[i];
+        }
+    }
+
+    __atomic_store_n(&ring->tail, next, __ATOMIC_RELEASE);
+
+    return valid;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * @file ts_store.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for ts_store.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef TS_STORE_H
+#define TS_STORE_H
+
+#include "common_inc.h"
+
+
+/* Store file format */
+#define TS_STORE_MAGIC 0x42445354 /* "TSDB" */
+#define TS_STORE_VERSION 1
+#define TS_STORE_HEADER_SIZE 64   /* Records start here */
+#define TS_STORE_GROW 4096        /* Records added each time the file grows */
+
+#define TS_STORE_PATH "./sup/data.tsdb"
+
+
+/** File header, count is published after the record is written */
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t reserved;
+    uint64_t count;
+} ts_store_header_t;
+
+
+/** Raw sample record. Every record type starts with its timestamp */
+typedef struct
+{
+    int64_t timestamp; /* Epoch in milliseconds */
+    float value;
+    uint32_t reserved;
+} ts_record_t;
+
+
+/** Open store */
+typedef struct
+{
+    int fd;
+    bool writable;
+    uint32_t record_size;
+    uint8_t *map;
+    size_t map_size;
+} ts_store_t;
+
+
+ssize_t ts_store_open(ts_store_t *store, const char *path, uint32_t record_size, bool writable);
+void ts_store_close(ts_store_t *store);
+ssize_t ts_store_append(ts_store_t *store, const void *record);
+uint64_t ts_store_count(ts_store_t *store);
+const void *ts_store_get(ts_store_t *store, uint64_t index);
+const void *ts_store_latest(ts_store_t *store);
+uint64_t ts_store_lower_bound(ts_store_t *store, int64_t timestamp);
+uint64_t ts_store_range(ts_store_t *store, int64_t from, int64_t to, uint64_t *first);
+ssize_t ts_store_trim(ts_store_t *store, const char *path, int64_t before);
+
+#endif
@@ -35,6 +35,7 @@
 #include <sys/select.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <stdarg.h>
 
 #include "driver_handler.h"
 #include "common_inc.h"
@@ -49,10 +50,10 @@
 #define MAX_DATA_SIZE 100
 
 /* Semaphore and Mutex */
-#define NUMSEMS 3
+#define NUMSEMS 1
 
 
-int semaphore_set;
+extern int semaphore_set;
 
 union semun
 {
@@ -65,7 +66,6 @@ union semun
 
 /** Total number of live childs */
 static uint8_t g_number_of_childs = 0;
-static uint32_t g_number_of_threads = 0;
 static uint32_t cpid_config_file, cpid_driver_handler, cpid_plot_handler;
 
 
@@ -74,24 +74,10 @@ extern void *shared_mem_1;
 extern void *shared_mem_2;
 
 
-typedef struct
-{
-    ctx_t *ctx_client;
-    uint32_t sock_fd;
-} args_t;
-
-
 /* Webserver variables */
-uint32_t sock_fd;
-socklen_t socket_length;
-struct sockaddr_in server_addr;
-
-
-struct thread_data
-{
-    int duration;
-    int num;
-} td;
+extern uint32_t sock_fd;
+extern socklen_t socket_length;
+extern struct sockaddr_in server_addr;
 
 
 static const char response_http_template[] = {
@@ -127,6 +113,27 @@ Connection: Closed \
 };
 
 
+static const char busy_response_template[] = {
+    "HTTP/1.1 503 Service Unavailable \
+Content-Length: %lu \
+Content-Type: text/html \
+Retry-After: 1 \
+Connection: Closed \
+\n\n \
+%s"
+};
+
+
+static const char history_http_template[] = {
+    "HTTP/1.1 200 OK \
+Content-Length: %lu \
+Content-Type: text/csv \
+Connection: Closed \
+\n\n \
+%s"
+};
+
+
 static const char response_page_template[] = {
     "<!DOCTYPE html> \
 <html> \
@@ -175,7 +182,7 @@ static const char response_page_template[] = {
                 </div> \
                 <div class=\"container \"><div class=\"col-md-12\"></div> \
                 <div class=\"col-md-12 px-0 center-block\"> \
-                    <img class=\"img-responsive \" src=\"data:image/png;base64,%s\" alt=\"Plot\"/> \
+                    <img class=\"img-responsive \" src=\"data:image/svg+xml;base64,%s\" alt=\"Plot\"/> \
                 </div></div> \
             </div> \
         </div> \
@@ -205,6 +212,18 @@ ssize_t configure_signals(void);
 ssize_t read_config_file(config_file_t *config_file, const char *file);
 ssize_t configure_shared_mem(void);
 
+char *build_client_response(ctx_t *ctx, const char *request, size_t *response_length);
+char *build_response_data(const char *student_name,
+                          const char *legajo,
+                          last_temp_t *last_temp,
+                          const char *image_data,
+                          size_t *response_length);
+char *build_invalid_response(const char *method, size_t *response_length);
+char *build_busy_response(size_t *response_length);
+char *build_history_response(char *query, size_t *response_length);
+
+void reload_config(ctx_t *ctx);
+
 void child_config_file(ctx_t *ctx);
 void child_driver_handler(ctx_t *ctx);
 
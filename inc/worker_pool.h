@@ -0,0 +1,53 @@
+/**
+ * @file worker_pool.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for worker_pool.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "webserver.h"
+#include "common_inc.h"
+
+
+/* Worker pool defines */
+#define WORKER_POOL_DEFAULT_WORKERS 4
+#define WORKER_POOL_DEFAULT_QUEUE_DEPTH 64
+
+
+typedef void (*work_fn_t)(void *arg);
+
+
+/** Pending job */
+typedef struct
+{
+    work_fn_t fn;
+    void *arg;
+} work_item_t;
+
+
+/** Pre-spawned workers fed by a bounded MPMC queue */
+typedef struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    work_item_t *items;      /* Circular queue */
+    uint32_t capacity;       /* Queue depth */
+    uint32_t head;           /* Next item to run */
+    uint32_t count;          /* Queued items */
+    uint32_t target_workers; /* Workers wanted after the last resize */
+    uint32_t live_workers;   /* Workers currently running */
+} worker_pool_t;
+
+
+ssize_t worker_pool_init(worker_pool_t *pool, uint32_t workers, uint32_t queue_depth);
+ssize_t worker_pool_submit(worker_pool_t *pool, work_fn_t fn, void *arg);
+ssize_t worker_pool_resize(worker_pool_t *pool, uint32_t workers, uint32_t queue_depth);
+
+#endif
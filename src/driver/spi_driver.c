@@ -17,16 +17,41 @@
 
 #include "spi_driver.h"
 
+#define CREATE_TRACE_POINTS
+#include "spi_trace.h"
+
 /* Device info structure */
 static struct spi_dev_data_t dev;
 static atomic_t index_rx;
-static atomic_t index_tx;
+
+/* FIFO level in bytes, transfers longer than the FIFO take an interrupt each time it is reached */
+static unsigned int fifo_afl = MCSPI_FIFO_LEVEL_DEFAULT;
+module_param(fifo_afl, uint, 0444);
+MODULE_PARM_DESC(fifo_afl, "RX almost full / TX almost empty level in bytes (1-32)");
+
+/* Short transfers busy-poll the channel status, the IRQ and the wakeup cost more than them */
+static unsigned int poll_bytes = MCSPI_POLL_BYTES_DEFAULT;
+module_param(poll_bytes, uint, 0644);
+MODULE_PARM_DESC(poll_bytes, "Transfers up to this many bytes are polled, 0 always sleeps");
+
+static unsigned int poll_ns = MCSPI_POLL_NS_DEFAULT;
+module_param(poll_ns, uint, 0644);
+MODULE_PARM_DESC(poll_ns, "Only poll transfers expected to shift within this many ns");
+
+/* 8 bit transfers moved 4 bytes per FIFO access, the wire sees the same byte stream */
+static unsigned int pack_bytes = MCSPI_PACK_BYTES_DEFAULT;
+module_param(pack_bytes, uint, 0644);
+MODULE_PARM_DESC(pack_bytes, "8 bit transfers from this many bytes are packed, 0 never packs");
 
 static struct file_operations spi_driver_dev_fops = { .owner = THIS_MODULE,
                                                       .open = spi_driver_open,
                                                       .release = spi_driver_close,
                                                       .write = spi_driver_write,
-                                                      .read = spi_driver_read };
+                                                      .read = spi_driver_read,
+                                                      .unlocked_ioctl = spi_driver_ioctl,
+                                                      .poll = spi_driver_poll,
+                                                      .fasync = spi_driver_fasync,
+                                                      .mmap = spi_driver_mmap };
 
 
 static const struct of_device_id spi_td3_driver_of_match[] = {
@@ -35,262 +60,1902 @@ static const struct of_device_id spi_td3_driver_of_match[] = {
 };
 
 
-MODULE_DEVICE_TABLE(of, spi_td3_driver_of_match);
+MODULE_DEVICE_TABLE(of, spi_td3_driver_of_match);
+
+
+static struct platform_driver spi_driver_platform = {
+    .driver =
+      {
+        .name = "spi_driver_td3_platform",
+        .owner = THIS_MODULE,
+        .of_match_table = of_match_ptr(spi_td3_driver_of_match),
+      },
+    .probe = spi_driver_probe,
+    .remove = spi_driver_remove,
+};
+
+
+/*************************************************************************
+ *  Functions
+ **************************************************************************/
+
+
+/**
+ * @brief Add to a counter of the controller
+ *
+ * @param counter Counter
+ * @param n Amount
+ */
+static inline void _spi_count(enum spi_counter_t counter, u64 n)
+{
+    atomic64_add(n, &dev.stats.counters[counter]);
+}
+
+
+/**
+ * @brief Add a latency to its log2 histogram
+ *
+ * @param hist Histogram
+ * @param ns Latency
+ */
+static inline void _spi_hist(enum spi_hist_t hist, u64 ns)
+{
+    unsigned int bucket = fls64(ns);
+
+    atomic64_inc(&dev.stats.hist[hist][bucket < SPI_HIST_BUCKETS ? bucket : SPI_HIST_BUCKETS - 1]);
+}
+
+
+/**
+ * @brief Get a word from a buffer. Packed words are big endian, so the McSPI shifts the bytes
+ * MSB first in buffer order. Configured 16 and 32 bit words are in CPU byte order
+ *
+ * @param buf First byte of the word
+ * @return uint32_t Word for MCSPI_TX
+ */
+static uint32_t _spi_word_load(const char *buf)
+{
+    uint32_t word = 0;
+
+    if(dev.packed)
+    {
+        for(unsigned int i = 0; i < dev.word_bytes; i++)
+        {
+            word = (word << 8) | ( uint8_t )buf[i];
+        }
+        return word;
+    }
+
+    if(dev.word_bytes == 2)
+    {
+        return *( const uint16_t * )buf;
+    }
+
+    return dev.word_bytes == 4 ? *( const uint32_t * )buf : ( uint8_t )*buf;
+}
+
+
+/**
+ * @brief Put a word into a buffer, in the byte order of _spi_word_load
+ *
+ * @param buf First byte of the word
+ * @param word Word from MCSPI_RX
+ */
+static void _spi_word_store(char *buf, uint32_t word)
+{
+    if(dev.packed)
+    {
+        for(unsigned int i = dev.word_bytes; i-- > 0; word >>= 8)
+        {
+            buf[i] = word;
+        }
+    }
+    else if(dev.word_bytes == 2)
+    {
+        *( uint16_t * )buf = word;
+    }
+    else if(dev.word_bytes == 4)
+    {
+        *( uint32_t * )buf = word;
+    }
+    else
+    {
+        *buf = word;
+    }
+}
+
+
+/**
+ * @brief Push TX words into the FIFO. Every word sent brings one back, so staying at most a FIFO
+ * ahead of the received bytes keeps both FIFOs from overflowing without reading CHiSTAT
+ */
+static void _spi_fifo_write(void)
+{
+    size_t room = MCSPI_FIFO_DEPTH - (dev.tx_pos - dev.rx_pos);
+
+    while(room >= dev.word_bytes && dev.tx_pos < dev.tx_len)
+    {
+        spi_reg_write(_spi_word_load(&dev.p_tx_buff[dev.tx_pos]), MCSPI_TX(dev.active->index));
+        dev.tx_pos += dev.word_bytes;
+        room -= dev.word_bytes;
+    }
+}
+
+
+/**
+ * @brief Pop RX words from the FIFO
+ *
+ * @param count Bytes known to be in the RX FIFO, a multiple of the word size
+ */
+static void _spi_fifo_read(size_t count)
+{
+    for(; count >= dev.word_bytes && dev.rx_pos < dev.rx_len; count -= dev.word_bytes)
+    {
+        _spi_word_store(&dev.p_rx_buff[dev.rx_pos], spi_reg_read(MCSPI_RX(dev.active->index)));
+        dev.rx_pos += dev.word_bytes;
+    }
+}
+
+
+/**
+ * @brief Drive the chip select of the channel that owns the bus, holding it for the delays of
+ * its configuration. CS is a GPIO, so the controller cannot time it
+ *
+ * @param active Assert it
+ */
+static void _spi_cs(bool active)
+{
+    const struct spi_td3_config *cfg = &dev.active->config;
+
+    if(active)
+    {
+        gpio_set_value(dev.active->cs_gpio, CS0_GPIO_EN);
+        ndelay(cfg->cs_setup_ns);
+    }
+    else
+    {
+        ndelay(cfg->cs_hold_ns);
+        gpio_set_value(dev.active->cs_gpio, CS0_GPIO_DS);
+        ndelay(cfg->cs_inactive_ns);
+    }
+
+    trace_spi_td3_cs(dev.active->index, active);
+}
+
+
+/**
+ * @brief Move the FIFO to a channel. The controller only lets one channel use it, so it follows
+ * the bus owner. Consecutive transactions on the same chip select cost nothing
+ *
+ * @param ch Channel
+ */
+static void _spi_channel_select(struct spi_channel_t *ch)
+{
+    if(dev.active == ch)
+    {
+        return;
+    }
+
+    spi_reg_write(dev.active->conf, MCSPI_CHCONF(dev.active->index));
+    spi_reg_write(ch->conf | CH_CONF_FFEW | CH_CONF_FFER, MCSPI_CHCONF(ch->index));
+    dev.active = ch;
+}
+
+
+/**
+ * @brief Check a bus configuration and get the channel registers for it. The speed is rounded
+ * down to the closest the divider can do
+ *
+ * @param cfg Configuration, speed_hz is updated
+ * @param conf MCSPI_CHiCONF without the FIFO enables
+ * @param ctrl MCSPI_CHiCTRL with the channel disabled
+ * @return int Return value
+ */
+static int _spi_config_regs(struct spi_td3_config *cfg, uint32_t *conf, uint32_t *ctrl)
+{
+    unsigned int divider;
+
+    if(cfg->speed_hz == 0 || (cfg->mode & ~SPI_TD3_MODE_3) ||
+       (cfg->bits_per_word != 8 && cfg->bits_per_word != 16 && cfg->bits_per_word != 32) ||
+       cfg->cs_setup_ns > SPI_TD3_CS_DELAY_MAX || cfg->cs_hold_ns > SPI_TD3_CS_DELAY_MAX ||
+       cfg->cs_inactive_ns > SPI_TD3_CS_DELAY_MAX)
+    {
+        return -EINVAL;
+    }
+
+    /* One cycle granularity, CLKD holds the low 4 bits of the divider and EXTCLK the rest */
+    divider = clamp(DIV_ROUND_UP(MCSPI_FCLK, cfg->speed_hz), 1u, ( unsigned int )MCSPI_CLK_DIV_MAX);
+    cfg->speed_hz = MCSPI_FCLK / divider;
+
+    *conf = CH_CONF_BASE | CH_CONF_CLKG | CH_CONF_CLKD(divider) | CH_CONF_WL(cfg->bits_per_word);
+    *conf |= cfg->mode & SPI_TD3_CPOL ? CH_CONF_POL : 0;
+    *conf |= cfg->mode & SPI_TD3_CPHA ? CH_CONF_PHA : 0;
+    *ctrl = SPI_CH_EXTCLK(divider);
+
+    return 0;
+}
+
+
+/**
+ * @brief Take buffers from the pool if there are any left
+ *
+ * @param file File
+ * @return bool Got them
+ */
+static bool _spi_buff_try(struct spi_file_data_t *file)
+{
+    struct spi_buff_t *buff;
+
+    spin_lock(&dev.pool_lock);
+    if((buff = list_first_entry_or_null(&dev.pool_free, struct spi_buff_t, node)) != NULL)
+    {
+        list_del(&buff->node);
+    }
+    spin_unlock(&dev.pool_lock);
+
+    if(buff == NULL)
+    {
+        return false;
+    }
+
+    file->buff = buff;
+    file->p_tx_buff = buff->p_tx_buff;
+    file->p_rx_buff = buff->p_rx_buff;
+
+    return true;
+}
+
+
+/**
+ * @brief Borrow transfer buffers for a transaction. The pool has a pair per transaction that can
+ * be staging or on the bus, so the wait is rare and the transfer path never allocates
+ *
+ * @param file File
+ * @return int Return value
+ */
+static int _spi_buff_get(struct spi_file_data_t *file)
+{
+    int rv;
+
+    if((rv = wait_event_interruptible(spi_buff_queue, _spi_buff_try(file))) < 0)
+    {
+        _spi_count(SPI_CNT_INTERRUPTED, 1);
+    }
+
+    return rv;
+}
+
+
+/**
+ * @brief Return the buffers of a transaction to the pool. The last returned is lent first, it is
+ * the most likely to still be in the cache
+ *
+ * @param file File
+ */
+static void _spi_buff_put(struct spi_file_data_t *file)
+{
+    spin_lock(&dev.pool_lock);
+    list_add(&file->buff->node, &dev.pool_free);
+    spin_unlock(&dev.pool_lock);
+
+    file->buff = NULL;
+    file->p_tx_buff = NULL;
+    file->p_rx_buff = NULL;
+
+    wake_up_interruptible(&spi_buff_queue);
+}
+
+
+/**
+ * @brief Get the file that owns the bus
+ *
+ * @return struct spi_file_data_t* Owner, NULL when the bus is free
+ */
+static struct spi_file_data_t *_spi_bus_owner(void)
+{
+    struct spi_file_data_t *owner;
+
+    spin_lock(&dev.xfer_lock);
+    owner = list_first_entry_or_null(&dev.xfer_queue, struct spi_file_data_t, xfer);
+    spin_unlock(&dev.xfer_lock);
+
+    return owner;
+}
+
+
+/**
+ * @brief Leave the transfer queue and wake up the next file and the writers polling for the bus
+ *
+ * @param file File
+ */
+static void _spi_bus_unlock(struct spi_file_data_t *file)
+{
+    spin_lock(&dev.xfer_lock);
+    list_del_init(&file->xfer);
+    spin_unlock(&dev.xfer_lock);
+
+    wake_up_interruptible(&spi_tx_queue);
+}
+
+
+/**
+ * @brief Queue for the bus and wait for the transactions queued before. The queue is FIFO and
+ * shared by every chip select, so the wait is bounded by the transactions ahead and no file can
+ * starve the others. The controller uses the channel and buffers of the file until it unlocks
+ * the bus
+ *
+ * @param file File, with a single transaction in flight
+ * @param len Bytes of the transaction, only traced
+ * @return int Return value
+ */
+static int _spi_bus_lock(struct spi_file_data_t *file, size_t len)
+{
+    u64 start = ktime_get_ns();
+    int rv;
+
+    spin_lock(&dev.xfer_lock);
+    list_add_tail(&file->xfer, &dev.xfer_queue);
+    spin_unlock(&dev.xfer_lock);
+
+    trace_spi_td3_queued(file->ch->index, len);
+
+    if((rv = wait_event_interruptible(spi_tx_queue, _spi_bus_owner() == file)) < 0)
+    {
+        _spi_count(SPI_CNT_INTERRUPTED, 1);
+        _spi_bus_unlock(file);
+        return rv;
+    }
+
+    _spi_hist(SPI_HIST_QUEUE, ktime_get_ns() - start);
+
+    _spi_channel_select(file->ch);
+    dev.p_tx_buff = file->p_tx_buff;
+    dev.p_rx_buff = file->p_rx_buff;
+
+    return 0;
+}
+
+
+/**
+ * @brief Apply a bus configuration to a chip select. It queues for the bus like a transaction,
+ * so the transactions queued before it run with the previous one. Called with mtx_lock held
+ *
+ * @param ch Channel
+ * @param cfg Configuration, speed_hz is updated to the one applied
+ * @return int Return value
+ */
+static int _spi_channel_configure(struct spi_channel_t *ch, struct spi_td3_config *cfg)
+{
+    uint32_t conf, ctrl;
+    int rv;
+
+    if((rv = _spi_config_regs(cfg, &conf, &ctrl)) < 0)
+    {
+        return rv;
+    }
+
+    /* The running sampler shifts whole words of the current length */
+    if(ch->sampling_filp != NULL && cfg->bits_per_word != ch->config.bits_per_word)
+    {
+        return -EBUSY;
+    }
+
+    if((rv = _spi_bus_lock(&ch->configurer, 0)) < 0)
+    {
+        return rv;
+    }
+
+    /* The bus lock moved the FIFO to this channel, which is disabled between transfers */
+    ch->config = *cfg;
+    ch->conf = conf;
+    ch->ctrl = ctrl;
+    spi_reg_write(conf | CH_CONF_FFEW | CH_CONF_FFER, MCSPI_CHCONF(ch->index));
+    spi_reg_write(ctrl | SPI_CH_DS, MCSPI_CHCTRL(ch->index));
+
+    _spi_bus_unlock(&ch->configurer);
+
+    print_info("channel %u at %u Hz, mode %u, %u bit words\n",
+               ch->index,
+               cfg->speed_hz,
+               cfg->mode,
+               cfg->bits_per_word);
+
+    return 0;
+}
+
+
+/**
+ * @brief Wait for the controller to come out of reset and configure every chip select, the TX
+ * and RX FIFOs start on the first one. Used by probe and after a soft reset
+ *
+ * @return int Return value
+ */
+static int _spi_controller_init(void)
+{
+    struct spi_channel_t *ch;
+    uint32_t reg_data;
+    unsigned int i, count = 0;
+
+    /* Wait SPI reset */
+    do
+    {
+        msleep(1);
+        if(count++ >= MCSPI_RESET_TRIES)
+        {
+            print_info("cant reset SPI0\n");
+            return -EBUSY;
+        }
+    } while(spi_reg_read(MCSPI_SYSSTATUS) != SYS_STAT_RD);
+
+    /* Disable channels */
+    for(i = 0; i < dev.num_ch; i++)
+    {
+        spi_reg_write(SPI_CH_DS, MCSPI_CHCTRL(dev.ch[i].index));
+    }
+
+    /* Start channel configuration */
+    reg_data = spi_reg_read(MCSPI_SYSCONFIG);
+    spi_reg_write(0x308 | reg_data, MCSPI_SYSCONFIG);
+
+    reg_data = spi_reg_read(MCSPI_MODULCTRL);
+    spi_reg_write(0x02, MCSPI_MODULCTRL);
+
+    reg_data = spi_reg_read(MCSPI_MODULCTRL);
+    spi_reg_write((~0x04) & reg_data, MCSPI_MODULCTRL);
+
+    /* The configuration in use, the defaults after probe */
+    for(i = 0; i < dev.num_ch; i++)
+    {
+        ch = &dev.ch[i];
+        _spi_config_regs(&ch->config, &ch->conf, &ch->ctrl);
+        spi_reg_write(ch->conf | (i == 0 ? CH_CONF_FFEW | CH_CONF_FFER : 0),
+                      MCSPI_CHCONF(ch->index));
+        spi_reg_write(ch->ctrl | SPI_CH_DS, MCSPI_CHCTRL(ch->index));
+        spi_reg_write(IRQ_STAT_TXS(ch->index) | IRQ_STAT_RXS(ch->index), MCSPI_IRQSTATUS);
+    }
+
+    dev.active = &dev.ch[0];
+
+    return 0;
+}
+
+
+/**
+ * @brief Soft reset a stuck controller and configure it again, with the FIFO back on the active
+ * channel. The bus stays locked and CS is left to the caller
+ */
+static void _spi_controller_reset(void)
+{
+    struct spi_channel_t *active = dev.active;
+
+    spi_reg_write(spi_reg_read(MCSPI_SYSCONFIG) | SYS_CONF_SOFTRESET, MCSPI_SYSCONFIG);
+
+    if(_spi_controller_init() < 0)
+    {
+        print_err("controller reset error\n");
+    }
+
+    _spi_channel_select(active);
+}
+
+
+/**
+ * @brief Time the active channel takes to shift a transfer at its SCLK
+ *
+ * @param count Bytes to transfer
+ * @return u64 Nanoseconds on the bus
+ */
+static u64 _spi_transfer_ns(size_t count)
+{
+    return div_u64(( u64 )count * 8 * NSEC_PER_SEC, dev.active->config.speed_hz);
+}
+
+
+/**
+ * @brief Add a transfer to the latency statistics of the active channel
+ *
+ * @param mode Polled or interrupt driven
+ * @param count Bytes transferred
+ * @param ns Time since the transfer was started
+ */
+static void _spi_xfer_account(enum spi_xfer_mode_t mode, size_t count, u64 ns)
+{
+    struct spi_xfer_stats_t *stats = &dev.active->xfer_stats[mode];
+
+    spin_lock(&dev.xfer_lock);
+    stats->count++;
+    stats->bytes += count;
+    stats->total_ns += ns;
+    stats->min_ns = stats->count == 1 ? ns : min(stats->min_ns, ns);
+    stats->max_ns = max(stats->max_ns, ns);
+    spin_unlock(&dev.xfer_lock);
+}
+
+
+/**
+ * @brief Busy-poll CHiSTAT and move each word as soon as it is received. No interrupt is
+ * enabled, so the transfer pays neither the handler nor the wakeup of the caller
+ *
+ * @param ch Active channel
+ * @param deadline ktime_get_ns() after which the controller is taken as stuck
+ * @return ssize_t 0 or a negative error
+ */
+static ssize_t _spi_transfer_poll(unsigned int ch, u64 deadline)
+{
+    while(dev.rx_pos < dev.rx_len)
+    {
+        if(!(spi_reg_read(MCSPI_CHSTAT(ch)) & CH_STAT_RXFFE))
+        {
+            _spi_fifo_read(dev.word_bytes);
+            _spi_fifo_write();
+        }
+        else if(ktime_get_ns() > deadline)
+        {
+            return -ETIMEDOUT;
+        }
+        else
+        {
+            cpu_relax();
+        }
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Shift a run of words of the same length through the FIFO of the active channel. Runs up
+ * to poll_bytes that shift within poll_ns are polled. The others sleep: the word count raises
+ * EOW once every word was shifted, so a run that fits in the FIFO takes a single interrupt, and
+ * longer ones are drained and refilled each time the RX FIFO is almost full. A run that misses its
+ * deadline resets the controller and returns -ETIMEDOUT
+ *
+ * @param pos Offset of the run in the transfer buffers
+ * @param count Bytes in the run, a multiple of word_bytes
+ * @param word_bytes Bytes per FIFO word, the channel word length must match
+ * @return ssize_t 0 or a negative error
+ */
+static ssize_t _spi_transfer_run(size_t pos, size_t count, unsigned int word_bytes)
+{
+    unsigned int ch = dev.active->index;
+    uint32_t irq_enable = IRQ_EN_EOW;
+    u64 start = ktime_get_ns(), expected_ns = _spi_transfer_ns(count), deadline_ns, elapsed_ns;
+    enum spi_xfer_mode_t mode;
+    ssize_t rv;
+
+    mode = count <= poll_bytes && expected_ns <= poll_ns ? SPI_XFER_POLL : SPI_XFER_IRQ;
+
+    /* Over twice the expected time means stuck */
+    deadline_ns = 2 * expected_ns;
+    deadline_ns += mode == SPI_XFER_POLL ? MCSPI_POLL_SLACK_NS : MCSPI_IRQ_SLACK_NS;
+
+    dev.tx_len = pos + count;
+    dev.tx_pos = pos;
+    dev.rx_len = pos + count;
+    dev.rx_pos = pos;
+    atomic_set(&index_rx, 0);
+
+    /* The FIFO levels are in bytes and must hold whole words */
+    dev.word_bytes = word_bytes;
+    dev.afl = max(fifo_afl - fifo_afl % word_bytes, word_bytes);
+
+    /* Levels and word count can only change while the channel is disabled */
+    spi_reg_write(XFER_WCNT(count / word_bytes) | XFER_AFL(dev.afl) | XFER_AEL(dev.afl),
+                  MCSPI_XFERLEVEL);
+    spi_reg_write(IRQ_STAT_TXS(ch) | IRQ_STAT_RXS(ch) | IRQ_STAT_EOW, MCSPI_IRQSTATUS);
+
+    spi_reg_write(dev.active->ctrl | SPI_CH_EN, MCSPI_CHCTRL(ch));
+
+    _spi_fifo_write();
+
+    if(mode == SPI_XFER_POLL)
+    {
+        rv = _spi_transfer_poll(ch, start + deadline_ns);
+    }
+    else
+    {
+        if(dev.tx_pos < dev.tx_len)
+        {
+            irq_enable |= IRQ_EN_RXE(ch);
+        }
+
+        spi_reg_write(irq_enable, MCSPI_IRQENABLE);
+
+        rv = wait_event_interruptible_timeout(spi_rx_queue,
+                                              (atomic_read(&index_rx)) > 0,
+                                              nsecs_to_jiffies(deadline_ns) + 1);
+
+        spi_reg_write(IRQ_EN_TXD | IRQ_EN_RXD, MCSPI_IRQENABLE);
+
+        if(rv < 0)
+        {
+            print_err("wait_event_interruptible transfer error\n");
+            _spi_count(SPI_CNT_INTERRUPTED, 1);
+        }
+        else if(rv == 0)
+        {
+            rv = -ETIMEDOUT;
+        }
+        else
+        {
+            _spi_hist(SPI_HIST_WAKEUP, ktime_get_ns() - dev.wakeup_ns);
+            rv = 0;
+        }
+    }
+
+    spi_reg_write(dev.active->ctrl | SPI_CH_DS, MCSPI_CHCTRL(ch));
+
+    /* The word count never ended, nothing the controller does can be trusted until a reset */
+    if(rv == -ETIMEDOUT)
+    {
+        print_err("%zu byte transfer timeout on channel %u\n", count, ch);
+        _spi_count(SPI_CNT_TIMEOUTS, 1);
+        _spi_controller_reset();
+    }
+
+    if(rv < 0)
+    {
+        return rv;
+    }
+
+    elapsed_ns = ktime_get_ns() - start;
+    _spi_hist(SPI_HIST_BUS, elapsed_ns);
+    _spi_xfer_account(mode, count, elapsed_ns);
+
+    return 0;
+}
+
+
+/**
+ * @brief Full duplex transfer of dev.p_tx_buff into dev.p_rx_buff through the FIFO of the active
+ * channel. With 8 bit words, transfers from pack_bytes are shifted as 32 bit words holding 4
+ * bytes each, MSB first so the wire sees the same stream, and the last 1 to 3 bytes go in a run
+ * of 8 bit words. With 16 or 32 bit words the buffers hold whole words in CPU byte order. The
+ * caller drives CS, so several transfers can run under the same CS
+ *
+ * @param count Bytes to transfer, a multiple of the word size
+ * @return ssize_t Bytes transferred or a negative error
+ */
+static ssize_t _spi_transfer(size_t count)
+{
+    unsigned int ch = dev.active->index;
+    unsigned int word_bytes = dev.active->config.bits_per_word / 8;
+    uint32_t conf = dev.active->conf | CH_CONF_FFEW | CH_CONF_FFER;
+    u64 start = ktime_get_ns();
+    size_t packed = 0;
+    ssize_t rv = 0;
+
+    if(count == 0 || count > SPI_DRIVER_BUFF_SIZE || count % word_bytes != 0 ||
+       count / word_bytes > XFER_WCNT_MAX)
+    {
+        return -EINVAL;
+    }
+
+    if(word_bytes == 1 && pack_bytes != 0 && count >= pack_bytes)
+    {
+        packed = count - count % MCSPI_PACK_WORD_BYTES;
+    }
+
+    if(packed != 0)
+    {
+        spi_reg_write((conf & ~CH_CONF_WL_MASK) | CH_CONF_WL(32), MCSPI_CHCONF(ch));
+        dev.packed = true;
+
+        rv = _spi_transfer_run(0, packed, MCSPI_PACK_WORD_BYTES);
+
+        dev.packed = false;
+        spi_reg_write(conf, MCSPI_CHCONF(ch));
+    }
+
+    if(rv == 0 && packed < count)
+    {
+        rv = _spi_transfer_run(packed, count - packed, word_bytes);
+    }
+
+    if(rv < 0)
+    {
+        return rv;
+    }
+
+    _spi_count(SPI_CNT_TRANSFERS, 1);
+    _spi_count(SPI_CNT_BYTES, count);
+    trace_spi_td3_transfer(ch, count, packed, ktime_get_ns() - start);
+
+    return count;
+}
+
+
+/**
+ * @brief Transfer a user buffer of any size in chunks of the file buffers, with the bus locked
+ * and CS asserted by the caller. The slave sees a single transfer, SCLK only pauses between
+ * chunks. The first chunk must already be in p_tx_buff and the last one is left in p_rx_buff, so
+ * a transfer that fits in one chunk makes no user copy on the bus
+ *
+ * @param file File that owns the bus
+ * @param tx User bytes to send, NULL sends zeros
+ * @param rx User buffer for the bytes received, NULL drops them
+ * @param count Bytes to transfer, a multiple of the word size
+ * @return ssize_t Size of the chunk left in p_rx_buff or a negative error
+ */
+static ssize_t _spi_transfer_chunks(struct spi_file_data_t *file,
+                                    const char *tx,
+                                    char *rx,
+                                    size_t count)
+{
+    size_t done = 0, chunk = min(count, ( size_t )SPI_DRIVER_BUFF_SIZE);
+    ssize_t rv;
+
+    /* Chunks are whole words, so only the size of the last one can be wrong */
+    if(count % (file->ch->config.bits_per_word / 8) != 0)
+    {
+        return -EINVAL;
+    }
+
+    while((rv = _spi_transfer(chunk)) >= 0 && done + chunk < count)
+    {
+        if(rx != NULL && copy_to_user(rx + done, file->p_rx_buff, chunk) != 0)
+        {
+            return -EFAULT;
+        }
+
+        done += chunk;
+        chunk = min(count - done, ( size_t )SPI_DRIVER_BUFF_SIZE);
+
+        if(tx == NULL)
+        {
+            memset(file->p_tx_buff, 0, chunk);
+        }
+        else if(copy_from_user(file->p_tx_buff, tx + done, chunk) != 0)
+        {
+            return -EFAULT;
+        }
+    }
+
+    return rv;
+}
+
+
+/**
+ * @brief Driver IRQ Handler
+ *
+ * @param irq IRQ number
+ * @param dev_id Device ID
+ * @param regs Struct pointer
+ * @return irqreturn_t Return value
+ */
+static irqreturn_t spi_driver_irq_handler(int irq, void *dev_id, struct pt_regs *regs)
+{
+    dev.irqstatus = spi_reg_read(MCSPI_IRQSTATUS);
+    spi_reg_write(dev.irqstatus, MCSPI_IRQSTATUS);
+
+    _spi_count(SPI_CNT_IRQS, 1);
+
+    if(!(dev.irqstatus & (IRQ_STAT_RXS(dev.active->index) | IRQ_STAT_EOW)))
+    {
+        _spi_count(SPI_CNT_SPURIOUS, 1);
+        return IRQ_NONE;
+    }
+
+    /* RX almost full, dev.afl bytes are waiting and as many can be sent */
+    if(dev.irqstatus & IRQ_STAT_RXS(dev.active->index))
+    {
+        _spi_fifo_read(dev.afl);
+        _spi_fifo_write();
+    }
+
+    /* Every word was shifted, the rest of the bytes are in the RX FIFO */
+    if(dev.irqstatus & IRQ_STAT_EOW)
+    {
+        _spi_fifo_read(dev.rx_len - dev.rx_pos);
+        spi_reg_write(IRQ_EN_TXD | IRQ_EN_RXD, MCSPI_IRQENABLE);
+        atomic_inc(&index_rx);
+        dev.wakeup_ns = ktime_get_ns();
+        wake_up_interruptible(&spi_rx_queue);
+    }
+
+    trace_spi_td3_irq(dev.active->index, dev.irqstatus, dev.rx_pos, dev.rx_len);
+
+    return IRQ_HANDLED;
+}
+
+
+/**
+ * @brief Sampling timer. The transfer sleeps, so the sensor is read from a work item
+ *
+ * @param timer Sampling timer
+ * @return enum hrtimer_restart Keep it running
+ */
+static enum hrtimer_restart _spi_sample_timer(struct hrtimer *timer)
+{
+    struct spi_channel_t *ch = container_of(timer, struct spi_channel_t, sample_timer);
+
+    schedule_work(&ch->sample_work);
+    hrtimer_forward_now(timer, ch->sample_period);
+
+    return HRTIMER_RESTART;
+}
+
+
+/**
+ * @brief Write a sample to the mapped ring. Only the sampling work of the channel writes it
+ *
+ * @param ring Ring of the channel
+ * @param sample Sample
+ */
+static void _spi_ring_push(struct spi_td3_ring_header *ring, const struct spi_td3_sample *sample)
+{
+    struct spi_td3_sample *slots =
+      ( struct spi_td3_sample * )(( char * )ring + SPI_TD3_RING_HEADER_SIZE);
+    u64 head = ring->head, tail = READ_ONCE(ring->tail);
+
+    /* The consumer owns the tail, it is only used to count overwritten samples */
+    if(tail <= head && head - tail >= SPI_TD3_RING_SAMPLES)
+    {
+        ring->overruns++;
+    }
+
+    /* Publishing head must be seen before the slot is overwritten */
+    smp_wmb();
+    slots[head % SPI_TD3_RING_SAMPLES] = *sample;
+    smp_store_release(&ring->head, head + 1);
+}
+
+
+/**
+ * @brief Read one sample and queue it. Readers are only woken once a whole batch is queued. The
+ * work of each chip select queues for the bus like any other file, so sensors on different
+ * channels are sampled in turns at their own rate
+ *
+ * @param work Sampling work
+ */
+static void _spi_sample_work(struct work_struct *work)
+{
+    struct spi_channel_t *ch = container_of(work, struct spi_channel_t, sample_work);
+    struct spi_td3_sample sample = { 0 };
+    size_t count = ch->sampling.len + 1;
+    ssize_t rv;
+
+    if(_spi_buff_get(&ch->sampler) < 0)
+    {
+        return;
+    }
+
+    if(_spi_bus_lock(&ch->sampler, count) < 0)
+    {
+        _spi_buff_put(&ch->sampler);
+        return;
+    }
+
+    memset(dev.p_tx_buff, 0, count);
+    dev.p_tx_buff[0] = ch->sampling.command;
+
+    sample.timestamp_ns = ktime_get_ns();
+    _spi_cs(true);
+    rv = _spi_transfer(count);
+    _spi_cs(false);
+
+    if(rv > 0)
+    {
+        sample.len = ch->sampling.len;
+        memcpy(sample.data, dev.p_rx_buff + 1, sample.len);
+    }
+
+    _spi_bus_unlock(&ch->sampler);
+    _spi_buff_put(&ch->sampler);
+
+    if(rv <= 0)
+    {
+        return;
+    }
+
+    /* A full FIFO drops the sample, readers see the gap in the sequence */
+    sample.sequence = ch->sample_seq++;
+    kfifo_put(&ch->sample_fifo, sample);
+    _spi_ring_push(ch->ring, &sample);
+
+    if(kfifo_len(&ch->sample_fifo) >= ch->sampling.batch)
+    {
+        wake_up_interruptible(&spi_rx_queue);
+        kill_fasync(&ch->async_queue, SIGIO, POLL_IN);
+    }
+}
+
+
+/**
+ * @brief Stop sampling and wake up the reader waiting for a batch. Called with the channel
+ * mtx_lock held
+ *
+ * @param ch Channel
+ */
+static void _spi_sampling_stop(struct spi_channel_t *ch)
+{
+    hrtimer_cancel(&ch->sample_timer);
+    cancel_work_sync(&ch->sample_work);
+
+    ch->sampling.rate_hz = 0;
+    ch->sampling_filp = NULL;
+    wake_up_interruptible(&spi_rx_queue);
+}
+
+
+/**
+ * @brief Start sampling, or stop it when the rate is 0. Samples still queued are dropped. Only
+ * one file per chip select samples at a time, and only it reads the samples
+ *
+ * @param filp File struct pointer
+ * @param sampling User configuration
+ * @return long Return value
+ */
+static long _spi_ioctl_sampling(struct file *filp, const void *sampling)
+{
+    struct spi_channel_t *ch = (( struct spi_file_data_t * )filp->private_data)->ch;
+    struct spi_td3_sampling cfg;
+
+    if(copy_from_user(&cfg, sampling, sizeof(cfg)) != 0)
+    {
+        return -EFAULT;
+    }
+
+    cfg.batch = max(cfg.batch, ( __u16 )1);
+
+    if(cfg.rate_hz > SPI_TD3_RATE_MAX || cfg.len == 0 || cfg.len > SPI_TD3_SAMPLE_MAX ||
+       cfg.batch > SPI_TD3_FIFO_SAMPLES / 2)
+    {
+        return -EINVAL;
+    }
+
+    if(mutex_lock_interruptible(&ch->mtx_lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    if(ch->sampling_filp != NULL && ch->sampling_filp != filp)
+    {
+        mutex_unlock(&ch->mtx_lock);
+        return -EBUSY;
+    }
+
+    /* Control byte and data are shifted as whole words */
+    if((cfg.len + 1) % (ch->config.bits_per_word / 8) != 0)
+    {
+        mutex_unlock(&ch->mtx_lock);
+        return -EINVAL;
+    }
+
+    _spi_sampling_stop(ch);
+
+    if(cfg.rate_hz != 0)
+    {
+        kfifo_reset(&ch->sample_fifo);
+        ch->sample_seq = 0;
+        ch->sampling = cfg;
+        ch->sampling_filp = filp;
+        ch->sample_period = ktime_set(0, NSEC_PER_SEC / cfg.rate_hz);
+
+        hrtimer_start(&ch->sample_timer, ch->sample_period, HRTIMER_MODE_REL);
+
+        print_info("channel %u sampling at %u Hz, %u samples per read\n",
+                   ch->index,
+                   cfg.rate_hz,
+                   cfg.batch);
+    }
+
+    mutex_unlock(&ch->mtx_lock);
+    return 0;
+}
+
+
+/**
+ * @brief Read whole samples while sampling. Blocks until a batch is queued, a non blocking file
+ * gets whatever is queued. Returns 0 once the file no longer owns the sampling
+ *
+ * @param filp File struct pointer
+ * @param buff User buff
+ * @param count Size read, at least one sample
+ * @return ssize_t Bytes read or a negative error
+ */
+static ssize_t _spi_read_samples(struct file *filp, char *buff, size_t count)
+{
+    struct spi_channel_t *ch = (( struct spi_file_data_t * )filp->private_data)->ch;
+    unsigned int copied;
+    int rv;
+
+    if(count < sizeof(struct spi_td3_sample))
+    {
+        return -EINVAL;
+    }
+
+    if(filp->f_flags & O_NONBLOCK)
+    {
+        if(kfifo_is_empty(&ch->sample_fifo))
+        {
+            return -EAGAIN;
+        }
+    }
+    else if((rv = wait_event_interruptible(spi_rx_queue,
+                                           kfifo_len(&ch->sample_fifo) >= ch->sampling.batch ||
+                                             ch->sampling_filp != filp)) < 0)
+    {
+        return rv;
+    }
+
+    /* The fifo has a single reader only under mtx_lock, which also orders the copy with the reset
+     * of a sampling restart */
+    if(mutex_lock_interruptible(&ch->mtx_lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    /* Sampling stopped or restarted by another file while waiting */
+    if(ch->sampling_filp != filp)
+    {
+        mutex_unlock(&ch->mtx_lock);
+        return 0;
+    }
+
+    rv = kfifo_to_user(&ch->sample_fifo, buff, count, &copied);
+    mutex_unlock(&ch->mtx_lock);
+
+    return rv != 0 ? -EFAULT : copied;
+}
+
+/**
+ * @brief Driver read function. The user buffer holds the bytes to send and gets the bytes
+ * received, under a single CS whatever its size
+ *
+ * @param filp File struct pointer
+ * @param buff User buff
+ * @param count Size read
+ * @param offp
+ * @return ssize_t Return value
+ */
+static ssize_t spi_driver_read(struct file *filp, char *buff, size_t count, loff_t *offp)
+{
+    struct spi_file_data_t *file = filp->private_data;
+    ssize_t rv = 0;
+
+    if(file->ch->sampling_filp == filp)
+    {
+        return _spi_read_samples(filp, buff, count);
+    }
+
+    if(!(access_ok(VERIFY_WRITE, buff, count)))
+    {
+        print_err("Invalid read buffer\n");
+        return -ENOMEM;
+    }
+
+    if(mutex_lock_interruptible(&file->lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    if((rv = _spi_buff_get(file)) < 0)
+    {
+        goto read_unlock;
+    }
+
+    /* The copies of the first and last chunks are done off the bus */
+    if(copy_from_user(file->p_tx_buff, buff, min(count, ( size_t )SPI_DRIVER_BUFF_SIZE)) != 0)
+    {
+        print_err("copy_from_user error\n");
+        rv = -EFAULT;
+        goto read_put;
+    }
+
+    if((rv = _spi_bus_lock(file, count)) < 0)
+    {
+        goto read_put;
+    }
+
+    _spi_cs(true);
+    rv = _spi_transfer_chunks(file, buff, buff, count);
+    _spi_cs(false);
+
+    _spi_bus_unlock(file);
+
+    if(rv >= 0 && copy_to_user(buff + count - rv, file->p_rx_buff, rv) != 0)
+    {
+        print_err("error sending %zu bytes to user\n", count);
+        rv = -EFAULT;
+    }
+
+read_put:
+    _spi_buff_put(file);
+
+read_unlock:
+    mutex_unlock(&file->lock);
+
+    if(rv < 0)
+    {
+        return rv;
+    }
+
+    trace_spi_td3_copy(file->ch->index, count, true);
+    return count;
+}
+
+
+/**
+ * @brief Driver write function, the bytes go under a single CS whatever their size
+ *
+ * @param filp File struct pointer
+ * @param buff User buff
+ * @param count Size to write
+ * @param offp
+ * @return ssize_t Return value
+ */
+static ssize_t spi_driver_write(struct file *filp, const char *buff, size_t count, loff_t *offp)
+{
+    struct spi_file_data_t *file = filp->private_data;
+    ssize_t rv;
+
+    if(!(access_ok(VERIFY_READ, buff, count)))
+    {
+        print_err("Invalid write buffer");
+        return -ENOMEM;
+    }
+
+    if(mutex_lock_interruptible(&file->lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    if((rv = _spi_buff_get(file)) < 0)
+    {
+        mutex_unlock(&file->lock);
+        return rv;
+    }
+
+    if(copy_from_user(file->p_tx_buff, buff, min(count, ( size_t )SPI_DRIVER_BUFF_SIZE)) != 0)
+    {
+        print_err("error receiving data from user\n");
+        _spi_buff_put(file);
+        mutex_unlock(&file->lock);
+        return -EFAULT;
+    }
+
+    if((rv = _spi_bus_lock(file, count)) == 0)
+    {
+        /* Received bytes are dropped */
+        _spi_cs(true);
+        rv = _spi_transfer_chunks(file, buff, NULL, count);
+        _spi_cs(false);
+
+        _spi_bus_unlock(file);
+    }
+
+    _spi_buff_put(file);
+    mutex_unlock(&file->lock);
+
+    if(rv < 0)
+    {
+        return rv;
+    }
+
+    trace_spi_td3_copy(file->ch->index, count, false);
+    return count;
+}
+
+
+/**
+ * @brief Wait between segments. Short delays spin, longer ones sleep: udelay overflows past a
+ * couple of milliseconds on ARM and would spin with the bus locked
+ *
+ * @param us Microseconds
+ */
+static void _spi_delay_us(unsigned int us)
+{
+    if(us <= SPI_DRIVER_UDELAY_MAX_US)
+    {
+        udelay(us);
+    }
+    else
+    {
+        usleep_range(us, us + us / 10);
+    }
+}
+
+
+/**
+ * @brief Run a message of segments in one call. CS stays asserted between segments that ask for
+ * it and is always released after the last one
+ *
+ * @param file File
+ * @param cmd SPI_TD3_IOC_MESSAGE(n)
+ * @param segments User array of n segments
+ * @return long Bytes transferred or a negative error
+ */
+static long _spi_ioctl_message(struct spi_file_data_t *file, unsigned int cmd, const void *segments)
+{
+    struct spi_td3_segment msg[SPI_TD3_MAX_SEGMENTS];
+    size_t n = _IOC_SIZE(cmd) / sizeof(struct spi_td3_segment);
+    size_t len = 0;
+    long total = 0;
+    ssize_t rv = 0;
+    bool selected = false, to_user = false;
+
+    if(n == 0 || n > SPI_TD3_MAX_SEGMENTS || _IOC_SIZE(cmd) % sizeof(struct spi_td3_segment))
+    {
+        return -EINVAL;
+    }
+
+    if(copy_from_user(msg, segments, n * sizeof(struct spi_td3_segment)) != 0)
+    {
+        return -EFAULT;
+    }
+
+    /* Reject the message before touching the bus */
+    for(size_t i = 0; i < n; i++)
+    {
+        if(msg[i].len == 0)
+        {
+            return -EINVAL;
+        }
+
+        len += msg[i].len;
+        to_user |= msg[i].rx_buf != 0;
+    }
+
+    if(mutex_lock_interruptible(&file->lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    if((rv = _spi_buff_get(file)) < 0)
+    {
+        mutex_unlock(&file->lock);
+        return rv;
+    }
+
+    /* The whole message is one transaction, CS may stay asserted between segments */
+    if((rv = _spi_bus_lock(file, len)) < 0)
+    {
+        _spi_buff_put(file);
+        mutex_unlock(&file->lock);
+        return rv;
+    }
+
+    /* The word size only changes with the bus locked, every segment must hold whole words */
+    for(size_t i = 0; i < n; i++)
+    {
+        if(msg[i].len % (file->ch->config.bits_per_word / 8) != 0)
+        {
+            _spi_bus_unlock(file);
+            _spi_buff_put(file);
+            mutex_unlock(&file->lock);
+            return -EINVAL;
+        }
+    }
+
+    for(size_t i = 0; i < n; i++)
+    {
+        const char *tx = ( const char * )( uintptr_t )msg[i].tx_buf;
+        char *rx = ( char * )( uintptr_t )msg[i].rx_buf;
+        size_t chunk = min(( size_t )msg[i].len, ( size_t )SPI_DRIVER_BUFF_SIZE);
+
+        if(tx == NULL)
+        {
+            memset(dev.p_tx_buff, 0, chunk);
+        }
+        else if(copy_from_user(dev.p_tx_buff, tx, chunk) != 0)
+        {
+            rv = -EFAULT;
+            break;
+        }
+
+        /* A new edge would make the slave expect a control byte again */
+        if(!selected)
+        {
+            _spi_cs(true);
+            selected = true;
+        }
+
+        if((rv = _spi_transfer_chunks(file, tx, rx, msg[i].len)) < 0)
+        {
+            break;
+        }
+
+        if(rx != NULL && copy_to_user(rx + msg[i].len - rv, dev.p_rx_buff, rv) != 0)
+        {
+            rv = -EFAULT;
+            break;
+        }
+
+        if(msg[i].delay_usecs)
+        {
+            _spi_delay_us(msg[i].delay_usecs);
+        }
+
+        if(!msg[i].keep_cs)
+        {
+            _spi_cs(false);
+            selected = false;
+        }
+
+        total += msg[i].len;
+    }
+
+    if(selected)
+    {
+        _spi_cs(false);
+    }
+
+    _spi_bus_unlock(file);
+    _spi_buff_put(file);
+    mutex_unlock(&file->lock);
+
+    if(rv < 0)
+    {
+        return rv;
+    }
+
+    trace_spi_td3_copy(file->ch->index, total, to_user);
+    return total;
+}
+
+
+/**
+ * @brief Get or set the bus configuration of the chip select of a file. A new configuration
+ * applies to the transactions queued after it, and is copied back with the speed applied
+ *
+ * @param file File
+ * @param cmd SPI_TD3_IOC_RD_CONFIG or SPI_TD3_IOC_WR_CONFIG
+ * @param config User configuration
+ * @return long Return value
+ */
+static long _spi_ioctl_config(struct spi_file_data_t *file, unsigned int cmd, void *config)
+{
+    struct spi_channel_t *ch = file->ch;
+    struct spi_td3_config cfg;
+    long rv = 0;
+
+    if(cmd == SPI_TD3_IOC_WR_CONFIG && copy_from_user(&cfg, config, sizeof(cfg)) != 0)
+    {
+        return -EFAULT;
+    }
+
+    if(mutex_lock_interruptible(&ch->mtx_lock))
+    {
+        return -ERESTARTSYS;
+    }
+
+    if(cmd == SPI_TD3_IOC_WR_CONFIG)
+    {
+        rv = _spi_channel_configure(ch, &cfg);
+    }
+    else
+    {
+        cfg = ch->config;
+    }
+
+    mutex_unlock(&ch->mtx_lock);
+
+    if(rv == 0 && copy_to_user(config, &cfg, sizeof(cfg)) != 0)
+    {
+        rv = -EFAULT;
+    }
+
+    return rv;
+}
+
+
+/**
+ * @brief Driver ioctl function
+ *
+ * @param filp File struct pointer
+ * @param cmd Command
+ * @param arg Command argument
+ * @return long Return value
+ */
+static long spi_driver_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
+{
+    if(_IOC_TYPE(cmd) != SPI_TD3_IOC_MAGIC)
+    {
+        return -ENOTTY;
+    }
+
+    if(_IOC_NR(cmd) == _IOC_NR(SPI_TD3_IOC_MESSAGE(0)) && _IOC_DIR(cmd) == _IOC_WRITE)
+    {
+        return _spi_ioctl_message(filp->private_data, cmd, ( const void * )arg);
+    }
+
+    if(cmd == SPI_TD3_IOC_SAMPLING)
+    {
+        return _spi_ioctl_sampling(filp, ( const void * )arg);
+    }
+
+    if(cmd == SPI_TD3_IOC_RD_CONFIG || cmd == SPI_TD3_IOC_WR_CONFIG)
+    {
+        return _spi_ioctl_config(filp->private_data, cmd, ( void * )arg);
+    }
+
+    return -ENOTTY;
+}
+
+
+/**
+ * @brief Driver poll function. The sampling file is readable when a batch of samples is queued,
+ * the others when a transfer would start right away. Writable when the bus is free
+ *
+ * @param filp File struct pointer
+ * @param wait Poll table
+ * @return unsigned int Poll mask
+ */
+static unsigned int spi_driver_poll(struct file *filp, poll_table *wait)
+{
+    struct spi_channel_t *ch = (( struct spi_file_data_t * )filp->private_data)->ch;
+    unsigned int mask = 0;
+    bool bus_free = _spi_bus_owner() == NULL;
+
+    poll_wait(filp, &spi_rx_queue, wait);
+    poll_wait(filp, &spi_tx_queue, wait);
+
+    if(ch->sampling_filp == filp ? kfifo_len(&ch->sample_fifo) >= ch->sampling.batch : bus_free)
+    {
+        mask |= POLLIN | POLLRDNORM;
+    }
+
+    if(bus_free)
+    {
+        mask |= POLLOUT | POLLWRNORM;
+    }
+
+    return mask;
+}
+
+
+/**
+ * @brief Driver fasync function, SIGIO is sent when a batch of samples is queued
+ *
+ * @param fd File descriptor
+ * @param filp File struct pointer
+ * @param on Enable
+ * @return int Return value
+ */
+static int spi_driver_fasync(int fd, struct file *filp, int on)
+{
+    struct spi_file_data_t *file = filp->private_data;
+
+    return fasync_helper(fd, filp, on, &file->ch->async_queue);
+}
+
+
+/**
+ * @brief Driver mmap function, maps the sample ring of the chip select from its header page
+ *
+ * @param filp File struct pointer
+ * @param vma User mapping
+ * @return int Return value
+ */
+static int spi_driver_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+    struct spi_file_data_t *file = filp->private_data;
+
+    if(vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > SPI_TD3_RING_SIZE)
+    {
+        return -EINVAL;
+    }
+
+    return remap_vmalloc_range(vma, file->ch->ring, 0);
+}
 
 
-static struct platform_driver spi_driver_platform = {
-    .driver =
-      {
-        .name = "spi_driver_td3_platform",
-        .owner = THIS_MODULE,
-        .of_match_table = of_match_ptr(spi_td3_driver_of_match),
-      },
-    .probe = spi_driver_probe,
-    .remove = spi_driver_remove,
-};
+/**
+ * @brief Set up a file, its transfer buffers come from the pool per transaction
+ *
+ * @param file File
+ * @param ch Chip select the file talks to
+ */
+static void _spi_file_init(struct spi_file_data_t *file, struct spi_channel_t *ch)
+{
+    mutex_init(&file->lock);
+    INIT_LIST_HEAD(&file->xfer);
+    file->buff = NULL;
+    file->ch = ch;
+}
 
 
-/*************************************************************************
- *  Functions
- **************************************************************************/
+/**
+ * @brief Release a file
+ *
+ * @param file File
+ */
+static void _spi_file_free(struct spi_file_data_t *file)
+{
+    mutex_destroy(&file->lock);
+}
 
 
 /**
- * @brief Driver IRQ Handler
+ * @brief Driver open function
  *
- * @param irq IRQ number
- * @param dev_id Device ID
- * @param regs Struct pointer
- * @return irqreturn_t Return value
+ * @param inode Inode struct pointer
+ * @param filp File struct pointer
+ * @return int Return value
  */
-static irqreturn_t spi_driver_irq_handler(int irq, void *dev_id, struct pt_regs *regs)
+static int spi_driver_open(struct inode *inode, struct file *filp)
 {
-    iowrite32(IRQ_STAT_TXS | IRQ_STAT_RXS, dev.pspi_addr + MCSPI_IRQSTATUS);
+    unsigned int minor = iminor(inode) - SPI_DRIVER_MINORBASE;
+    struct spi_file_data_t *file;
 
-    if(dev.irqstatus & IRQ_STAT_RXS)
+    if(minor >= dev.num_ch)
     {
-        iowrite32(IRQ_STAT_RXS, dev.pspi_addr + MCSPI_IRQSTATUS);
-
-        dev.p_rx_buff[dev.rx_pos] = ioread32(dev.pspi_addr + MCSPI_RX0);
-
-        if(dev.rx_pos >= dev.rx_len)
-        {
-            iowrite32(IRQ_EN_RXD, dev.pspi_addr + MCSPI_IRQENABLE);
-            iowrite32(SPI_CH0_DS, dev.pspi_addr + MCSPI_CH0CTRL);
-            atomic_inc(&index_rx);
-            wake_up_interruptible(&spi_rx_queue);
-            return IRQ_HANDLED;
-        }
-        else
-        {
-            dev.rx_pos++;
-            return IRQ_HANDLED;
-        }
+        return -ENODEV;
     }
 
-    if(dev.irqstatus & IRQ_STAT_TXS)
+    if((file = kzalloc(sizeof(struct spi_file_data_t), GFP_KERNEL)) == NULL)
     {
-        iowrite32(IRQ_STAT_TXS, dev.pspi_addr + MCSPI_IRQSTATUS);
-
-        if(dev.tx_pos >= dev.tx_len)
-        {
-            iowrite32(IRQ_EN_TXD, dev.pspi_addr + MCSPI_IRQENABLE);
-            iowrite32(SPI_CH0_DS, dev.pspi_addr + MCSPI_CH0CTRL);
-            atomic_inc(&index_tx);
-            wake_up_interruptible(&spi_tx_queue);
-            return IRQ_HANDLED;
-        }
-        else
-        {
-            iowrite32(((( int )dev.p_tx_buff[dev.tx_pos]) << 8), dev.pspi_addr + MCSPI_TX0);
-            dev.tx_pos++;
-            dev.tx_pos++;
-            iowrite32(IRQ_EN_TXE, dev.pspi_addr + MCSPI_IRQENABLE);
-            return IRQ_HANDLED;
-        }
+        print_err("kzalloc file data\n");
+        return -ENOMEM;
     }
 
-    return IRQ_HANDLED;
+    _spi_file_init(file, &dev.ch[minor]);
+
+    /* Every file queues for the bus per transaction, nobody holds the device */
+    filp->private_data = file;
+
+    return 0;
 }
 
+
 /**
- * @brief Driver write function
+ * @brief Driver close function
  *
+ * @param inode Inode struct pointer
  * @param filp File struct pointer
- * @param buff User buff
- * @param count Size read
- * @param offp
- * @return ssize_t Return value
+ * @return int Return value
  */
-static ssize_t spi_driver_read(struct file *filp, char *buff, size_t count, loff_t *offp)
+static int spi_driver_close(struct inode *inode, struct file *filp)
 {
-    uint32_t reg_data = 0;
-    uint32_t rv = 0;
+    struct spi_file_data_t *file = filp->private_data;
+    struct spi_channel_t *ch = file->ch;
 
-    if(!(access_ok(VERIFY_WRITE, buff, count)))
+    print_info("Close\n");
+
+    mutex_lock(&ch->mtx_lock);
+    if(ch->sampling_filp == filp)
     {
-        print_err("Invalid read buffer\n");
-        return -ENOMEM;
+        _spi_sampling_stop(ch);
     }
+    mutex_unlock(&ch->mtx_lock);
 
-    reg_data = ioread32(dev.pspi_addr + MCSPI_IRQSTATUS);
-    iowrite32(IRQ_STAT_RXS | reg_data, dev.pspi_addr + MCSPI_IRQSTATUS);
+    spi_driver_fasync(-1, filp, 0);
 
-    dev.rx_len = count;
-    dev.rx_pos = 0;
-    atomic_set(&index_rx, 0);
+    _spi_file_free(file);
+    kfree(file);
 
-    dev.tx_len = count;
-    dev.tx_pos = 0;
-    atomic_set(&index_tx, 0);
+    return 0;
+}
 
-    rv = copy_from_user(dev.p_tx_buff, buff, count);
 
-    if(rv != 0)
+/**
+ * @brief Show the latency of each transfer mode of a chip select, to tune poll_bytes and poll_ns.
+ * Counted per run of words, a packed transfer with a tail counts twice
+ *
+ * @param device Device of the chip select
+ * @param attr Attribute
+ * @param buf Page to print into
+ * @return ssize_t Bytes printed
+ */
+static ssize_t xfer_stats_show(struct device *device, struct device_attribute *attr, char *buf)
+{
+    static const char *const names[SPI_XFER_MODES] = { "irq", "poll" };
+    struct spi_channel_t *ch = dev_get_drvdata(device);
+    struct spi_xfer_stats_t stats[SPI_XFER_MODES];
+    ssize_t len;
+
+    spin_lock(&dev.xfer_lock);
+    memcpy(stats, ch->xfer_stats, sizeof(stats));
+    spin_unlock(&dev.xfer_lock);
+
+    len = scnprintf(buf,
+                    PAGE_SIZE,
+                    "poll_bytes %u poll_ns %u pack_bytes %u\n%-4s %10s %12s %10s %10s %10s\n",
+                    poll_bytes,
+                    poll_ns,
+                    pack_bytes,
+                    "mode",
+                    "count",
+                    "bytes",
+                    "min_ns",
+                    "avg_ns",
+                    "max_ns");
+
+    for(int i = 0; i < SPI_XFER_MODES; i++)
     {
-        print_err("copy_from_user error\n");
-        kfree(dev.p_tx_buff);
-        return -EFAULT;
+        len += scnprintf(buf + len,
+                         PAGE_SIZE - len,
+                         "%-4s %10llu %12llu %10llu %10llu %10llu\n",
+                         names[i],
+                         stats[i].count,
+                         stats[i].bytes,
+                         stats[i].min_ns,
+                         stats[i].count ? div64_u64(stats[i].total_ns, stats[i].count) : 0,
+                         stats[i].max_ns);
     }
 
-    iowrite32(((( int )dev.p_tx_buff[dev.tx_pos]) << 8), dev.pspi_addr + MCSPI_TX0);
+    return len;
+}
 
-    iowrite32(IRQ_EN_TXE, dev.pspi_addr + MCSPI_IRQENABLE);
 
-    gpio_set_value(GPIO_CS, CS0_GPIO_EN);
+/**
+ * @brief Clear the latency statistics of a chip select, whatever is written
+ *
+ * @param device Device of the chip select
+ * @param attr Attribute
+ * @param buf Written data
+ * @param count Size written
+ * @return ssize_t Size consumed
+ */
+static ssize_t xfer_stats_store(struct device *device,
+                                struct device_attribute *attr,
+                                const char *buf,
+                                size_t count)
+{
+    struct spi_channel_t *ch = dev_get_drvdata(device);
 
-    iowrite32(SPI_CH0_EN, dev.pspi_addr + MCSPI_CH0CTRL);
+    spin_lock(&dev.xfer_lock);
+    memset(ch->xfer_stats, 0, sizeof(ch->xfer_stats));
+    spin_unlock(&dev.xfer_lock);
 
-    if((rv = wait_event_interruptible(spi_tx_queue, (atomic_read(&index_tx)) > 0)) < 0)
-    {
-        print_err("wait_event_interruptible write read error\n");
-        return rv;
-    }
+    return count;
+}
 
-    iowrite32(IRQ_EN_RXE, dev.pspi_addr + MCSPI_IRQENABLE);
 
-    if((rv = wait_event_interruptible(spi_rx_queue, (atomic_read(&index_rx)) > 0)) < 0)
-    {
-        print_err("wait_event_interruptible read error\n");
-        return rv;
-    }
+static DEVICE_ATTR_RW(xfer_stats);
+
+
+/* Each field of the bus configuration of a chip select, applied as with SPI_TD3_IOC_WR_CONFIG */
+#define SPI_CONFIG_ATTR(field)                                                                 \
+    static ssize_t field##_show(struct device *device, struct device_attribute *attr, char *buf) \
+    {                                                                                          \
+        struct spi_channel_t *ch = dev_get_drvdata(device);                                    \
+                                                                                               \
+        return scnprintf(buf, PAGE_SIZE, "%u\n", ( unsigned int )ch->config.field);            \
+    }                                                                                          \
+                                                                                               \
+    static ssize_t field##_store(struct device *device,                                        \
+                                 struct device_attribute *attr,                                \
+                                 const char *buf,                                              \
+                                 size_t count)                                                 \
+    {                                                                                          \
+        struct spi_channel_t *ch = dev_get_drvdata(device);                                    \
+        struct spi_td3_config cfg;                                                             \
+        unsigned int value;                                                                    \
+        int rv;                                                                                \
+                                                                                               \
+        if(kstrtouint(buf, 0, &value) != 0)                                                    \
+        {                                                                                      \
+            return -EINVAL;                                                                    \
+        }                                                                                      \
+                                                                                               \
+        if(mutex_lock_interruptible(&ch->mtx_lock))                                            \
+        {                                                                                      \
+            return -ERESTARTSYS;                                                               \
+        }                                                                                      \
+                                                                                               \
+        cfg = ch->config;                                                                      \
+        cfg.field = value;                                                                     \
+        rv = cfg.field == value ? _spi_channel_configure(ch, &cfg) : -EINVAL;                  \
+        mutex_unlock(&ch->mtx_lock);                                                           \
+                                                                                               \
+        return rv < 0 ? rv : ( ssize_t )count;                                                 \
+    }                                                                                          \
+                                                                                               \
+    static DEVICE_ATTR_RW(field)
+
+SPI_CONFIG_ATTR(speed_hz);
+SPI_CONFIG_ATTR(mode);
+SPI_CONFIG_ATTR(bits_per_word);
+SPI_CONFIG_ATTR(cs_setup_ns);
+SPI_CONFIG_ATTR(cs_hold_ns);
+SPI_CONFIG_ATTR(cs_inactive_ns);
+
+static struct attribute *spi_td3_attrs[] = {
+    &dev_attr_speed_hz.attr,
+    &dev_attr_mode.attr,
+    &dev_attr_bits_per_word.attr,
+    &dev_attr_cs_setup_ns.attr,
+    &dev_attr_cs_hold_ns.attr,
+    &dev_attr_cs_inactive_ns.attr,
+    &dev_attr_xfer_stats.attr,
+    NULL,
+};
 
-    gpio_set_value(GPIO_CS, CS0_GPIO_DS);
+ATTRIBUTE_GROUPS(spi_td3);
 
-    iowrite32(SPI_CH0_DS, dev.pspi_addr + MCSPI_CH0CTRL);
 
-    rv = copy_to_user(buff, dev.p_rx_buff, count);
+/**
+ * @brief Print the counters, then the histograms from the first to the last bucket used. Each
+ * row counts the latencies from its ns up to twice that
+ *
+ * @param m Sequence file
+ * @param data Unused
+ * @return int Return value
+ */
+static int spi_driver_stats_show(struct seq_file *m, void *data)
+{
+    static const char *const counters[SPI_COUNTERS] = {
+        "transfers", "bytes", "irqs", "spurious_irqs", "timeouts", "interrupted"
+    };
+    struct spi_debug_stats_t *stats = &dev.stats;
+    int first = SPI_HIST_BUCKETS, last = -1;
 
-    if(rv == 0)
+    for(int i = 0; i < SPI_COUNTERS; i++)
     {
-        print_info("%d bytes sent to user\n", sizeof(count));
-        return count;
+        seq_printf(m,
+                   "%-14s %llu\n",
+                   counters[i],
+                   ( unsigned long long )atomic64_read(&stats->counters[i]));
     }
-    else
+
+    for(int b = 0; b < SPI_HIST_BUCKETS; b++)
     {
-        print_err("error sending %d bytes to user\n", sizeof(count));
-        return -EFAULT;
+        for(int h = 0; h < SPI_HISTS; h++)
+        {
+            if(atomic64_read(&stats->hist[h][b]) != 0)
+            {
+                first = min(first, b);
+                last = b;
+            }
+        }
     }
 
-    return rv;
+    seq_printf(m, "\n%12s %12s %12s %12s\n", "ns", "queue", "bus", "wakeup");
+
+    for(int b = first; b <= last; b++)
+    {
+        seq_printf(m, "%12llu", b == 0 ? 0ULL : 1ULL << (b - 1));
+
+        for(int h = 0; h < SPI_HISTS; h++)
+        {
+            seq_printf(m, " %12llu", ( unsigned long long )atomic64_read(&stats->hist[h][b]));
+        }
+
+        seq_puts(m, "\n");
+    }
+
+    return 0;
+}
+
+
+/**
+ * @brief Open the stats file of debugfs
+ *
+ * @param inode Inode struct pointer
+ * @param filp File struct pointer
+ * @return int Return value
+ */
+static int spi_driver_stats_open(struct inode *inode, struct file *filp)
+{
+    return single_open(filp, spi_driver_stats_show, inode->i_private);
 }
 
 
 /**
- * @brief Driver write function
+ * @brief Clear the counters and histograms, whatever is written
  *
  * @param filp File struct pointer
  * @param buff User buff
- * @param count Size to write
+ * @param count Size written
  * @param offp
- * @return ssize_t Return value
+ * @return ssize_t Size consumed
  */
-static ssize_t spi_driver_write(struct file *filp, const char *buff, size_t count, loff_t *offp)
+static ssize_t spi_driver_stats_write(struct file *filp,
+                                      const char *buff,
+                                      size_t count,
+                                      loff_t *offp)
 {
-    ssize_t rv = 0;
-
-    if(count > MAX_RW_COUNT)
+    for(int i = 0; i < SPI_COUNTERS; i++)
     {
-        print_err("max write size reached\n");
-        return -ENOMEM;
+        atomic64_set(&dev.stats.counters[i], 0);
     }
 
-    if(!(access_ok(VERIFY_READ, buff, count)))
+    for(int h = 0; h < SPI_HISTS; h++)
     {
-        print_err("Invalid write buffer");
-        return -ENOMEM;
+        for(int b = 0; b < SPI_HIST_BUCKETS; b++)
+        {
+            atomic64_set(&dev.stats.hist[h][b], 0);
+        }
     }
 
-    rv = copy_from_user(dev.p_tx_buff, buff, count);
+    return count;
+}
 
-    if(rv == 0)
-    {
-        print_info("received %d bytes from user", sizeof(count));
-    }
-    else
-    {
-        print_err("error receiving data from user\n");
-        kfree(dev.p_tx_buff);
-        return -EFAULT;
-    }
 
-    dev.tx_len = count;
-    dev.tx_pos = 0;
-    atomic_set(&index_tx, 0);
+static const struct file_operations spi_driver_stats_fops = {
+    .owner = THIS_MODULE,
+    .open = spi_driver_stats_open,
+    .read = seq_read,
+    .write = spi_driver_stats_write,
+    .llseek = seq_lseek,
+    .release = single_release,
+};
 
-    iowrite32(((( int )dev.p_tx_buff[dev.tx_pos]) << 8) + (( int )dev.p_tx_buff[dev.tx_pos + 1]),
-              dev.pspi_addr + MCSPI_TX0);
 
-    iowrite32(IRQ_EN_TXE, dev.pspi_addr + MCSPI_IRQENABLE);
+/**
+ * @brief Free the transfer buffers
+ */
+static void _spi_pool_free(void)
+{
+    for(unsigned int i = 0; i < SPI_DRIVER_POOL_SIZE; i++)
+    {
+        kfree(dev.pool[i].p_tx_buff);
+        kfree(dev.pool[i].p_rx_buff);
+        dev.pool[i].p_tx_buff = NULL;
+        dev.pool[i].p_rx_buff = NULL;
+    }
+}
 
-    gpio_set_value(GPIO_CS, CS0_GPIO_EN);
 
-    iowrite32(SPI_CH0_EN, dev.pspi_addr + MCSPI_CH0CTRL);
+/**
+ * @brief Allocate the transfer buffers once. kmalloc of a page is page aligned and in lowmem, so
+ * the buffers could also be handed to a DMA engine
+ *
+ * @return int Return value
+ */
+static int _spi_pool_init(void)
+{
+    spin_lock_init(&dev.pool_lock);
+    INIT_LIST_HEAD(&dev.pool_free);
 
-    if((rv = wait_event_interruptible(spi_tx_queue, (atomic_read(&index_tx)) > 0)) < 0)
+    for(unsigned int i = 0; i < SPI_DRIVER_POOL_SIZE; i++)
     {
-        print_err("wait_event_interruptible write error\n");
-        kfree(dev.p_tx_buff);
-        return rv;
-    }
+        dev.pool[i].p_tx_buff = ( char * )kmalloc(SPI_DRIVER_BUFF_SIZE, GFP_KERNEL);
+        dev.pool[i].p_rx_buff = ( char * )kmalloc(SPI_DRIVER_BUFF_SIZE, GFP_KERNEL);
 
-    gpio_set_value(GPIO_CS, CS0_GPIO_DS);
+        if(dev.pool[i].p_tx_buff == NULL || dev.pool[i].p_rx_buff == NULL)
+        {
+            print_err("kmalloc transfer buffers\n");
+            _spi_pool_free();
+            return -ENOMEM;
+        }
 
-    iowrite32(SPI_CH0_DS, dev.pspi_addr + MCSPI_CH0CTRL);
+        list_add_tail(&dev.pool[i].node, &dev.pool_free);
+    }
 
-    return count;
+    return 0;
 }
 
 
 /**
- * @brief Driver open function
+ * @brief Read the chip selects from the slave nodes of the controller. Each node gives the McSPI
+ * channel in reg and the CS GPIO in td3,cs-gpio, in the order of the minors. Without slave nodes
+ * channel 0 is driven by GPIO_CS
  *
- * @param inode Inode struct pointer
- * @param filp File struct pointer
+ * @param node Controller node
  * @return int Return value
  */
-static int spi_driver_open(struct inode *inode, struct file *filp)
+static int _spi_channels_of(struct device_node *node)
 {
-    uint32_t count = 30;
-    uint32_t rv;
+    struct device_node *child;
+    unsigned int used = 0;
+    u32 index, cs_gpio;
 
-    if((dev.p_rx_buff = ( char * )kmalloc(sizeof(uint32_t) * count, GFP_KERNEL)) == NULL)
-    {
-        print_err("kmalloc p_rx_buff\n");
-        return -ENOMEM;
-    }
+    dev.num_ch = 0;
 
-    if((dev.p_tx_buff = ( char * )kmalloc(sizeof(uint32_t) * count, GFP_KERNEL)) == NULL)
+    for_each_available_child_of_node(node, child)
     {
-        print_err("kmalloc p_tx_buff\n");
-        return -ENOMEM;
-    }
+        if(of_property_read_u32(child, "reg", &index) != 0 || index >= MCSPI_CHANNELS ||
+           (used & (1 << index)) || of_property_read_u32(child, "td3,cs-gpio", &cs_gpio) != 0)
+        {
+            print_err("invalid slave node %s\n", child->name);
+            of_node_put(child);
+            return -EINVAL;
+        }
 
-    rv = mutex_lock_interruptible(&dev.mtx_lock);
+        used |= 1 << index;
+        dev.ch[dev.num_ch].index = index;
+        dev.ch[dev.num_ch].cs_gpio = cs_gpio;
+        dev.num_ch++;
+    }
 
-    if(rv < 0)
+    if(dev.num_ch == 0)
     {
-        print_err("mutex_lock_interruptible error\n");
+        dev.ch[0].index = 0;
+        dev.ch[0].cs_gpio = GPIO_CS;
+        dev.num_ch = 1;
     }
 
     return 0;
@@ -298,25 +1963,78 @@ static int spi_driver_open(struct inode *inode, struct file *filp)
 
 
 /**
- * @brief Driver close function
+ * @brief Set up the configuration and sampling of a chip select and claim its CS GPIO
  *
- * @param inode Inode struct pointer
- * @param filp File struct pointer
+ * @param ch Channel
+ * @param minor Minor of the chip select
  * @return int Return value
  */
-static int spi_driver_close(struct inode *inode, struct file *filp)
+static int _spi_channel_init(struct spi_channel_t *ch, unsigned int minor)
 {
-    print_info("Close\n");
+    ch->devt = MKDEV(MAJOR(spi_driver_dev), MINOR(spi_driver_dev) + minor);
+    mutex_init(&ch->mtx_lock);
+
+    /* Periodic sampling, started from the ioctl */
+    INIT_KFIFO(ch->sample_fifo);
+    INIT_WORK(&ch->sample_work, _spi_sample_work);
+    hrtimer_init(&ch->sample_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ch->sample_timer.function = _spi_sample_timer;
+
+    _spi_file_init(&ch->sampler, ch);
+
+    /* Queues for the bus to apply a configuration, it never transfers */
+    INIT_LIST_HEAD(&ch->configurer.xfer);
+    ch->configurer.ch = ch;
+    ch->config = ( struct spi_td3_config ){ .speed_hz = SPI_DRIVER_SPEED_DEFAULT,
+                                            .mode = SPI_DRIVER_MODE_DEFAULT,
+                                            .bits_per_word = SPI_DRIVER_BITS_DEFAULT };
+
+    /* Zeroed and page aligned, so it can be mapped as is */
+    if((ch->ring = vmalloc_user(SPI_TD3_RING_SIZE)) == NULL)
+    {
+        print_err("vmalloc_user ring error\n");
+        _spi_file_free(&ch->sampler);
+        return -ENOMEM;
+    }
 
-    mutex_unlock(&dev.mtx_lock); /* Free mutex */
+    ch->ring->magic = SPI_TD3_RING_MAGIC;
+    ch->ring->version = SPI_TD3_RING_VERSION;
+    ch->ring->sample_size = sizeof(struct spi_td3_sample);
+    ch->ring->capacity = SPI_TD3_RING_SAMPLES;
+
+    /* CS driven by GPIO because normal SPI_CS0 was not working */
+    if(gpio_request(ch->cs_gpio, "spi_cs_td3") != 0)
+    {
+        print_err("gpio_request %u error\n", ch->cs_gpio);
+        vfree(ch->ring);
+        _spi_file_free(&ch->sampler);
+        return -EBUSY;
+    }
 
-    kfree(dev.p_rx_buff);
-    kfree(dev.p_tx_buff);
+    gpio_direction_output(ch->cs_gpio, GPIO_OUTPUT);
 
     return 0;
 }
 
 
+/**
+ * @brief Stop the sampling of a chip select and release it
+ *
+ * @param ch Channel
+ */
+static void _spi_channel_free(struct spi_channel_t *ch)
+{
+    mutex_lock(&ch->mtx_lock);
+    _spi_sampling_stop(ch);
+    mutex_unlock(&ch->mtx_lock);
+
+    gpio_free(ch->cs_gpio);
+    mutex_destroy(&ch->mtx_lock);
+    _spi_file_free(&ch->sampler);
+    vfree(ch->ring);
+}
+
+
 /**
  * @brief Driver Init function
  *
@@ -352,23 +2070,15 @@ static int __init spi_driver_init(void)
         return EFAULT;
     }
 
-    if(IS_ERR((device_create(spi_driver_dev_class, NULL, spi_driver_dev, NULL, "spi_td3"))))
-    {
-        print_err("device_create error\n");
-        class_destroy(spi_driver_dev_class);
-        unregister_chrdev_region(spi_driver_dev, SPI_DRIVER_MINORCOUNT);
-        return EFAULT;
-    }
-
     print_info(
       "Device register correct. MAJOR:%d MINOR:%d\n", MAJOR(spi_driver_dev), MINOR(spi_driver_dev));
 
+    /* The device nodes are created by the probe, one per chip select */
     status = platform_driver_register(&spi_driver_platform);
 
     if(status != 0)
     {
         cdev_del(p_cdev);
-        device_destroy(spi_driver_dev_class, spi_driver_dev);
         class_destroy(spi_driver_dev_class);
         unregister_chrdev_region(spi_driver_dev, SPI_DRIVER_MINORCOUNT);
         print_err("platform_driver_register error\n");
@@ -385,15 +2095,38 @@ static int __init spi_driver_init(void)
  */
 static void __exit spi_driver_exit(void)
 {
-    mutex_destroy(&dev.mtx_lock);
     platform_driver_unregister(&spi_driver_platform);
-    device_destroy(spi_driver_dev_class, spi_driver_dev);
     class_destroy(spi_driver_dev_class);
     cdev_del(p_cdev);
     unregister_chrdev_region(spi_driver_dev, SPI_DRIVER_MINORCOUNT);
 }
 
 
+/**
+ * @brief Unmap the register blocks mapped by probe
+ */
+static void _spi_unmap(void)
+{
+    if(dev.pspi_addr != NULL)
+    {
+        iounmap(dev.pspi_addr);
+        dev.pspi_addr = NULL;
+    }
+
+    if(dev.pcontrol_module != NULL)
+    {
+        iounmap(dev.pcontrol_module);
+        dev.pcontrol_module = NULL;
+    }
+
+    if(dev.pcm_per != NULL)
+    {
+        iounmap(dev.pcm_per);
+        dev.pcm_per = NULL;
+    }
+}
+
+
 /**
  * @brief Driver probe function
  *
@@ -404,9 +2137,10 @@ static int spi_driver_probe(struct platform_device *pdev)
 {
     uint32_t rv = 0;
     uint32_t reg_data = 0;
-    uint32_t count = 0, aux = 0;
     const char *dt_compatible = NULL;
     unsigned int dt_reg[2];
+    unsigned int i;
+    int status;
 
     /* Get an irq for the device */
     dev.spi_irq_num = platform_get_irq(pdev, 0);
@@ -415,31 +2149,46 @@ static int spi_driver_probe(struct platform_device *pdev)
     {
         print_err("platform_get_irq error");
         platform_driver_unregister(&spi_driver_platform);
-        device_destroy(spi_driver_dev_class, spi_driver_dev);
         class_destroy(spi_driver_dev_class);
         cdev_del(p_cdev);
         unregister_chrdev_region(spi_driver_dev, SPI_DRIVER_MINORCOUNT);
         return -1;
     }
 
-    rv = request_irq(dev.spi_irq_num,
-                     ( irq_handler_t )spi_driver_irq_handler,
-                     IRQF_TRIGGER_RISING,
-                     pdev->name,
-                     NULL);
+    rv = spi_irq_request(dev.spi_irq_num, spi_driver_irq_handler, pdev->name);
 
     if(rv != 0)
     {
         print_err("request_irq error");
         platform_driver_unregister(&spi_driver_platform);
-        device_destroy(spi_driver_dev_class, spi_driver_dev);
         class_destroy(spi_driver_dev_class);
         cdev_del(p_cdev);
         unregister_chrdev_region(spi_driver_dev, SPI_DRIVER_MINORCOUNT);
         return -1;
     }
 
-    mutex_init(&dev.mtx_lock);
+    spin_lock_init(&dev.xfer_lock);
+    INIT_LIST_HEAD(&dev.xfer_queue);
+
+    /* Every buffer a transfer uses is allocated here */
+    if((status = _spi_pool_init()) < 0)
+    {
+        goto probe_irq;
+    }
+
+    /* One minor per slave node */
+    if((status = _spi_channels_of(pdev->dev.of_node)) < 0)
+    {
+        goto probe_pool;
+    }
+
+    for(i = 0; i < dev.num_ch; i++)
+    {
+        if((status = _spi_channel_init(&dev.ch[i], i)) < 0)
+        {
+            goto probe_channels; /* Frees the ones before i */
+        }
+    }
 
     /* Read property of device tree */
     of_property_read_string(pdev->dev.of_node, "compatible", &dt_compatible);
@@ -456,7 +2205,8 @@ static int spi_driver_probe(struct platform_device *pdev)
     if(!dev.pcm_per || !dev.pcontrol_module || !dev.pspi_addr)
     {
         print_err("error to obtain base addresses");
-        return -ENOMEM;
+        status = -ENOMEM;
+        goto probe_unmap;
     }
 
     /* Configure spi clock */
@@ -470,45 +2220,63 @@ static int spi_driver_probe(struct platform_device *pdev)
     iowrite32(0x30, dev.pcontrol_module + PIN_SPI0_D1_OFFSET);
     iowrite32(0x30, dev.pcontrol_module + PIN_SPI0_CS0_OFFSET);
 
-    /* Wait SPI reset */
-    do
+    if((status = _spi_controller_init()) < 0)
     {
-        msleep(1);
-        aux = ioread32(dev.pspi_addr + MCSPI_SYSSTATUS);
-        if(count >= 4)
-        {
-            print_info("cant reset SPI0\n");
-            return -EBUSY;
-        }
-        count++;
-    } while(aux != SYS_STAT_RD);
-
-    /* Disable channel */
-    iowrite32(SPI_CH0_DS, dev.pspi_addr + MCSPI_CH0CTRL);
-
-    /* Start channel configuration */
-    reg_data = ioread32(dev.pspi_addr + MCSPI_SYSCONFIG);
-    iowrite32(0x308 | reg_data, dev.pspi_addr + MCSPI_SYSCONFIG);
-
-    reg_data = ioread32(dev.pspi_addr + MCSPI_MODULCTRL);
-    iowrite32(0x02, dev.pspi_addr + MCSPI_MODULCTRL);
+        goto probe_unmap;
+    }
 
-    reg_data = ioread32(dev.pspi_addr + MCSPI_MODULCTRL);
-    iowrite32((~0x04) & reg_data, dev.pspi_addr + MCSPI_MODULCTRL);
+    fifo_afl = clamp(fifo_afl, 1u, ( unsigned int )MCSPI_FIFO_DEPTH);
 
-    reg_data = ioread32(dev.pspi_addr + MCSPI_CH0CONF);
-    iowrite32(0x607DF | reg_data, dev.pspi_addr + MCSPI_CH0CONF);
+    /* The first chip select keeps the node name of the single sensor driver */
+    for(i = 0; i < dev.num_ch; i++)
+    {
+        dev.ch[i].device =
+          device_create_with_groups(spi_driver_dev_class,
+                                    NULL,
+                                    dev.ch[i].devt,
+                                    &dev.ch[i],
+                                    spi_td3_groups,
+                                    i == 0 ? SPI_DRIVER_NAME_SHORT : SPI_DRIVER_NAME_SHORT ".%u",
+                                    i);
+
+        if(IS_ERR(dev.ch[i].device))
+        {
+            print_err("device_create error\n");
+            while(i-- > 0)
+            {
+                device_destroy(spi_driver_dev_class, dev.ch[i].devt);
+            }
+            status = -EFAULT;
+            goto probe_unmap;
+        }
 
-    reg_data = ioread32(dev.pspi_addr + MCSPI_CH0CONF);
-    iowrite32(IRQ_STAT_TXS | IRQ_STAT_RXS, dev.pspi_addr + MCSPI_IRQSTATUS);
+        print_info("Channel %u CS GPIO %u on minor %u\n",
+                   dev.ch[i].index,
+                   dev.ch[i].cs_gpio,
+                   MINOR(dev.ch[i].devt));
+    }
 
-    /* Configure CS0 with GPIO because normal SPI_CS0 was not working */
-    gpio_request(GPIO_CS, "spi_cs0_td3");
-    gpio_direction_output(GPIO_CS, GPIO_OUTPUT);
+    /* Failing to create them leaves the driver working without stats */
+    dev.debug_dir = debugfs_create_dir(SPI_DRIVER_NAME_SHORT, NULL);
+    debugfs_create_file("stats", 0644, dev.debug_dir, NULL, &spi_driver_stats_fops);
 
     print_info("End of probe\n");
 
     return 0;
+
+probe_unmap:
+    _spi_unmap();
+    i = dev.num_ch;
+probe_channels:
+    while(i-- > 0)
+    {
+        _spi_channel_free(&dev.ch[i]);
+    }
+probe_pool:
+    _spi_pool_free();
+probe_irq:
+    spi_irq_free(dev.spi_irq_num);
+    return status;
 }
 
 /**
@@ -519,11 +2287,20 @@ static int spi_driver_probe(struct platform_device *pdev)
  */
 static int spi_driver_remove(struct platform_device *pdev)
 {
-    free_irq(dev.spi_irq_num, NULL);
-    mutex_destroy(&dev.mtx_lock);
+    debugfs_remove_recursive(dev.debug_dir);
+
+    for(unsigned int i = 0; i < dev.num_ch; i++)
+    {
+        device_destroy(spi_driver_dev_class, dev.ch[i].devt);
+        _spi_channel_free(&dev.ch[i]);
+    }
+
+    _spi_unmap();
+    _spi_pool_free();
+    spi_irq_free(dev.spi_irq_num);
     return 0;
 }
 
 
 module_init(spi_driver_init);
-module_exit(spi_driver_exit);
\ No newline at end of file
+module_exit(spi_driver_exit);
@@ -1,27 +1,45 @@
-#include <linux/init.h>
-#include <linux/atomic.h>
-#include <linux/uaccess.h>
-#include <linux/pagemap.h>
-#include <linux/module.h>
-#include <linux/version.h>
-#include <linux/kernel.h>
-#include <linux/interrupt.h>
-#include <linux/cdev.h>
-#include <linux/device.h>
-#include <linux/kdev_t.h>
-#include <linux/fs.h>
-#include <linux/version.h>
-#include <linux/slab.h>
-#include <linux/platform_device.h>
-#include <linux/of.h>
-#include <linux/of_device.h>
-#include <linux/of_platform.h>
-#include <linux/of_address.h>
-#include <linux/of_irq.h>
-#include <linux/wait.h>
-#include <linux/mutex.h>
-#include <linux/delay.h>
-#include <linux/gpio.h>
+#ifdef SPI_TD3_SIM
+#    include "../sim/linux_shim.h"
+#else
+#    include <linux/init.h>
+#    include <linux/atomic.h>
+#    include <linux/uaccess.h>
+#    include <linux/pagemap.h>
+#    include <linux/module.h>
+#    include <linux/version.h>
+#    include <linux/kernel.h>
+#    include <linux/interrupt.h>
+#    include <linux/cdev.h>
+#    include <linux/device.h>
+#    include <linux/kdev_t.h>
+#    include <linux/fs.h>
+#    include <linux/version.h>
+#    include <linux/slab.h>
+#    include <linux/platform_device.h>
+#    include <linux/of.h>
+#    include <linux/of_device.h>
+#    include <linux/of_platform.h>
+#    include <linux/of_address.h>
+#    include <linux/of_irq.h>
+#    include <linux/wait.h>
+#    include <linux/mutex.h>
+#    include <linux/delay.h>
+#    include <linux/gpio.h>
+#    include <linux/hrtimer.h>
+#    include <linux/ktime.h>
+#    include <linux/jiffies.h>
+#    include <linux/kfifo.h>
+#    include <linux/workqueue.h>
+#    include <linux/poll.h>
+#    include <linux/mm.h>
+#    include <linux/vmalloc.h>
+#    include <linux/debugfs.h>
+#    include <linux/seq_file.h>
+#    include <linux/bitops.h>
+#endif
+
+#include "spi_hal.h"
+#include "../../inc/spi_td3_ioctl.h"
 
 /*************************************************************************
  *  Module Description
@@ -39,7 +57,7 @@ MODULE_LICENSE("GPL");
 #define SPI_DRIVER_NAME_SHORT "spi_td3"
 #define SPI_DRIVER_CLASS "spi_td3_class"
 #define SPI_DRIVER_MINORBASE 0
-#define SPI_DRIVER_MINORCOUNT 1
+#define SPI_DRIVER_MINORCOUNT MCSPI_CHANNELS /* One minor per chip select */
 #define SPI_DRIVER_DEV_PARENT NULL
 #define SPI_DRIVER_DEVDATA NULL
 
@@ -47,8 +65,9 @@ MODULE_LICENSE("GPL");
  *  BMP280 Defines
  **************************************************************************/
 
-static DECLARE_WAIT_QUEUE_HEAD (spi_rx_queue);  /*Interrupt queue */
-static DECLARE_WAIT_QUEUE_HEAD (spi_tx_queue);	/*Interrupt queue */
+static DECLARE_WAIT_QUEUE_HEAD (spi_rx_queue);  /* Transfer done or sample batch queued */
+static DECLARE_WAIT_QUEUE_HEAD (spi_tx_queue);	/* Bus released */
+static DECLARE_WAIT_QUEUE_HEAD (spi_buff_queue); /* Transfer buffers returned to the pool */
 
 
 #define BMP280_SENSOR_ADDR 0x77     /* Sensor Address */
@@ -66,11 +85,12 @@ static DECLARE_WAIT_QUEUE_HEAD (spi_tx_queue);	/*Interrupt queue */
 #define MCSPI_IRQENABLE (0x11C)
 #define MCSPI_SYST (0x124)
 #define MCSPI_MODULCTRL (0x128)
-#define MCSPI_CH0CONF (0x12C)
-#define MCSPI_CH0STAT (0x130)
-#define MCSPI_CH0CTRL (0x134)
-#define MCSPI_TX0 (0x138)      /* Channel 0 data to transmit */
-#define MCSPI_RX0 (0x13C)      /* Channel 0 data received */
+#define MCSPI_CHCONF(ch) (0x12C + 0x14 * (ch))
+#define MCSPI_CHSTAT(ch) (0x130 + 0x14 * (ch))
+#define MCSPI_CHCTRL(ch) (0x134 + 0x14 * (ch))
+#define MCSPI_TX(ch) (0x138 + 0x14 * (ch))  /* Channel data to transmit */
+#define MCSPI_RX(ch) (0x13C + 0x14 * (ch))  /* Channel data received */
+#define MCSPI_XFERLEVEL (0x17C)  /* FIFO levels and word count */
 
 #define CM_PER_SPI0_CLKCTRL (0x4C)
 
@@ -80,28 +100,92 @@ static DECLARE_WAIT_QUEUE_HEAD (spi_tx_queue);	/*Interrupt queue */
 #define PIN_SPI0_CS0_OFFSET (0x95C)
 
 
+/* MCSPI_SYSCONFIG */
+#define SYS_CONF_SOFTRESET (1 << 1) /* Self clears */
+
 /* MCSPI_SYSSTATUS Pag4924 */
 #define SYS_STAT_RD (1 << 0) /* Reset Done */
 
-/* MCSPI_IRQSTATUS Pag4925 */
-#define IRQ_STAT_TXS (1 << 0)  /* TX0 Empty */
-#define IRQ_STAT_RXS (1 << 2)  /* RX0 Full */
+/* MCSPI_IRQSTATUS Pag4925, channel i uses bits 4i to 4i+3 */
+#define IRQ_STAT_TXS(ch) (1 << (4 * (ch)))     /* TXi Empty */
+#define IRQ_STAT_RXS(ch) (1 << (4 * (ch) + 2)) /* RXi Full */
+#define IRQ_STAT_EOW (1 << 17)                 /* End of word count */
 
 /* MCSPI_IRQENABLE Pag4928 */
-#define IRQ_EN_TXE (1 << 0) /* Enable TX0 Empty */
-#define IRQ_EN_RXE (1 << 2) /* Enable RX0 Full */
-#define IRQ_EN_TXD (0 << 0) /* Disable TX0 Empty */
-#define IRQ_EN_RXD (0 << 2) /* Disable RX0 Full */
+#define IRQ_EN_TXE(ch) (1 << (4 * (ch)))     /* Enable TXi Empty */
+#define IRQ_EN_RXE(ch) (1 << (4 * (ch) + 2)) /* Enable RXi Full */
+#define IRQ_EN_TXD (0 << 0)                  /* Disable TX Empty */
+#define IRQ_EN_RXD (0 << 2)                  /* Disable RX Full */
+#define IRQ_EN_EOW (1 << 17)                 /* Enable end of word count */
+
+/* MCSPI_CHiCTRL */
+#define SPI_CH_EN (1 << 0)     /* Enable the channel */
+#define SPI_CH_DS (0 << 0)     /* Disable the channel */
+#define SPI_CH_EXTCLK(div) (((((div) - 1) >> 4) & 0xFF) << 8) /* Divider - 1, high bits */
 
-/* MCSPI_CH0CTRL */
-#define SPI_CH0_EN (1 << 0)     /* Enable MCSPI_CH0 */
-#define SPI_CH0_DS (0 << 0)     /* Disable MCSPI_CH0 */
 
+/* MCSPI_CHiSTAT Pag4948 */
+#define CH_STAT_RXS (1 << 0)   /* RX register full */
+#define CH_STAT_TXS (1 << 1)   /* TX register empty */
+#define CH_STAT_EOT (1 << 2)   /* End of transfer */
+#define CH_STAT_TXFFE (1 << 3) /* TX FIFO empty */
+#define CH_STAT_TXFFF (1 << 4) /* TX FIFO full */
+#define CH_STAT_RXFFE (1 << 5) /* RX FIFO empty */
+#define CH_STAT_RXFFF (1 << 6) /* RX FIFO full */
 
-/* MCSPI_CH0CONF */
-#define GPIO_CS (115)
+/* MCSPI_CHiCONF */
+#define MCSPI_CHANNELS (4)
+#define GPIO_CS (115)  /* CS of channel 0 when the device tree describes no slave */
 #define CS0_EN (1 << 20)
 #define CS0_DS (0 << 20)
+#define CH_CONF_BASE (0x60040)               /* CS active low, D0 output, D1 input */
+#define CH_CONF_PHA (1 << 0)                 /* Data latched on the trailing edge */
+#define CH_CONF_POL (1 << 1)                 /* SCLK idles high */
+#define CH_CONF_CLKD(div) ((((div) - 1) & 0xF) << 2) /* Divider - 1, low bits with CLKG */
+#define CH_CONF_WL(bits) (((bits) - 1) << 7) /* Word length */
+#define CH_CONF_WL_MASK CH_CONF_WL(32)
+#define CH_CONF_FFEW (1 << 27)               /* TX FIFO enable */
+#define CH_CONF_FFER (1 << 28)               /* RX FIFO enable */
+#define CH_CONF_CLKG (1 << 29)               /* SCLK is MCSPI_FCLK / divider, not a power of 2 */
+
+/* MCSPI_XFERLEVEL Pag4953 */
+#define XFER_AEL(bytes) (((bytes) - 1) << 0) /* TX almost empty level */
+#define XFER_AFL(bytes) (((bytes) - 1) << 8) /* RX almost full level */
+#define XFER_WCNT(words) ((words) << 16)     /* Words of the transfer, EOW when done */
+#define XFER_WCNT_MAX (0xFFFF)
+
+/* FIFO, the 64 byte buffer is split between TX and RX when both are enabled. Only one channel
+ * can have it enabled at a time */
+#define MCSPI_FIFO_DEPTH (32)
+#define MCSPI_FIFO_LEVEL_DEFAULT (16)
+
+/* Clock, the divider goes up to 4096 with one cycle granularity */
+#define MCSPI_FCLK (SPI_TD3_SPEED_MAX)      /* Functional clock */
+#define MCSPI_CLK_DIV_MAX (4096)
+
+/* Configuration of every chip select after probe: mode 3 at 375 kHz, 8 bit words */
+#define SPI_DRIVER_SPEED_DEFAULT (MCSPI_FCLK / 128)
+#define SPI_DRIVER_MODE_DEFAULT (SPI_TD3_MODE_3)
+#define SPI_DRIVER_BITS_DEFAULT (8)
+
+/* Polled transfers, an IRQ and a wakeup take about as long as shifting 4 bytes at 375 kHz */
+#define MCSPI_POLL_BYTES_DEFAULT (4)
+#define MCSPI_POLL_NS_DEFAULT (200000)
+#define MCSPI_POLL_SLACK_NS (100000)        /* Over twice the expected time means stuck */
+
+/* Sleeping transfers also wait for the IRQ, the wakeup and the scheduler */
+#define MCSPI_IRQ_SLACK_NS (20 * NSEC_PER_MSEC)
+#define MCSPI_RESET_TRIES (4)
+
+/* Delays between the segments of a message spin up to this, longer ones sleep */
+#define SPI_DRIVER_UDELAY_MAX_US (10)
+
+/* Byte streams packed in 32 bit words, below 8 bytes the extra CHiCONF writes cost more */
+#define MCSPI_PACK_BYTES_DEFAULT (8)
+#define MCSPI_PACK_WORD_BYTES (4)
+
+#define SPI_DRIVER_BUFF_SIZE (PAGE_SIZE) /* Transfer buffers, longer transfers go in chunks */
+#define SPI_DRIVER_POOL_SIZE (2 * MCSPI_CHANNELS) /* Transactions staging or on the bus at once */
 
 /* CS_GPIO */
 #define CS0_GPIO_EN (0x00)
@@ -117,6 +201,10 @@ static int spi_driver_open(struct inode *inode, struct file *filp);
 static int spi_driver_close(struct inode *inode, struct file *filp);
 static ssize_t spi_driver_read(struct file *filp, char *buff, size_t count, loff_t *offp);
 static ssize_t spi_driver_write(struct file *filp, const char *buff, size_t count, loff_t *offp);
+static long spi_driver_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+static unsigned int spi_driver_poll(struct file *filp, poll_table *wait);
+static int spi_driver_fasync(int fd, struct file *filp, int on);
+static int spi_driver_mmap(struct file *filp, struct vm_area_struct *vma);
 static int spi_driver_probe(struct platform_device *pdev);
 static int spi_driver_remove(struct platform_device *pdev);
 static irqreturn_t spi_driver_irq_handler(int irq, void *dev_id, struct pt_regs *regs);
@@ -126,19 +214,124 @@ static irqreturn_t spi_driver_irq_handler(int irq, void *dev_id, struct pt_regs
  *  Global Variables
  **************************************************************************/
 
+/* Per open file */
+/* Transfer buffers, allocated at probe and lent to one transaction at a time */
+struct spi_buff_t
+{
+    char *p_tx_buff;                         /* Tx buffer */
+    char *p_rx_buff;                         /* Rx buffer */
+    struct list_head node;                   /* Place in the free list */
+};
+
+struct spi_file_data_t
+{
+    struct spi_buff_t *buff;                 /* Pool buffers of the transaction, NULL between */
+    char *p_tx_buff;                         /* Tx buffer of the transaction */
+    char *p_rx_buff;                         /* Rx buffer of the transaction */
+    struct mutex lock;                       /* One transaction at a time per file */
+    struct list_head xfer;                   /* Place in the transfer queue */
+    struct spi_channel_t *ch;                /* Chip select of the minor opened */
+};
+
+/* How a transfer waits for the bus */
+enum spi_xfer_mode_t
+{
+    SPI_XFER_IRQ,                            /* Sleeps until EOW */
+    SPI_XFER_POLL,                           /* Busy-polls CHiSTAT */
+    SPI_XFER_MODES
+};
+
+/* Latency from the start of a transfer until the caller has every byte */
+struct spi_xfer_stats_t
+{
+    u64 count;                               /* Transfers */
+    u64 bytes;                               /* Bytes transferred */
+    u64 total_ns;                            /* Sum of the latencies */
+    u64 min_ns;                              /* Fastest transfer */
+    u64 max_ns;                              /* Slowest transfer */
+};
+
+/* Counters of the controller, in /sys/kernel/debug/spi_td3/stats */
+enum spi_counter_t
+{
+    SPI_CNT_TRANSFERS,                       /* Transfers completed */
+    SPI_CNT_BYTES,                           /* Bytes transferred */
+    SPI_CNT_IRQS,                            /* Interrupts taken */
+    SPI_CNT_SPURIOUS,                        /* Interrupts with nothing to do */
+    SPI_CNT_TIMEOUTS,                        /* Transfers the controller never finished */
+    SPI_CNT_INTERRUPTED,                     /* Waits cut short by a signal */
+    SPI_COUNTERS
+};
+
+/* Latency histograms, log2 buckets of ns */
+enum spi_hist_t
+{
+    SPI_HIST_QUEUE,                          /* Waiting for the bus */
+    SPI_HIST_BUS,                            /* Shifting a run of words */
+    SPI_HIST_WAKEUP,                         /* From the EOW wakeup until the caller runs */
+    SPI_HISTS
+};
+
+#define SPI_HIST_BUCKETS (32) /* Bucket n counts [2^(n-1), 2^n) ns, the last one up to forever */
+
+/* Updated with atomics only, from the IRQ handler and the transfer paths */
+struct spi_debug_stats_t
+{
+    atomic64_t counters[SPI_COUNTERS];
+    atomic64_t hist[SPI_HISTS][SPI_HIST_BUCKETS];
+};
+
+/* Per chip select, one minor each */
+struct spi_channel_t
+{
+    unsigned int index;                      /* McSPI channel, reg of the slave node */
+    unsigned int cs_gpio;                    /* CS GPIO, td3,cs-gpio of the slave node */
+    struct spi_td3_config config;            /* Bus configuration, speed as applied */
+    uint32_t conf;                           /* MCSPI_CHiCONF without the FIFO enables */
+    uint32_t ctrl;                           /* MCSPI_CHiCTRL with the channel disabled */
+    struct spi_file_data_t configurer;       /* Place of a new configuration in the bus queue */
+    dev_t devt;                              /* Device number */
+    struct device *device;                   /* Device node and its sysfs attributes */
+    struct spi_xfer_stats_t xfer_stats[SPI_XFER_MODES]; /* Latency per mode */
+    struct mutex mtx_lock;                   /* Bus and sampling configuration */
+    struct spi_file_data_t sampler;          /* Buffers of the sampling work */
+    struct file *sampling_filp;              /* File that started sampling, reads the samples */
+    struct hrtimer sample_timer;             /* Sampling period */
+    struct work_struct sample_work;          /* Sensor read, the transfer sleeps */
+    ktime_t sample_period;                   /* Sampling period */
+    struct spi_td3_sampling sampling;        /* Sampling configuration, rate 0 when stopped */
+    uint32_t sample_seq;                     /* Sequence of the next sample */
+    DECLARE_KFIFO(sample_fifo, struct spi_td3_sample, SPI_TD3_FIFO_SAMPLES); /* Samples */
+    struct fasync_struct *async_queue;       /* SIGIO when a batch is queued */
+    struct spi_td3_ring_header *ring;        /* Sample ring mapped by userspace */
+};
+
 struct spi_dev_data_t
 {
     uint8_t chip_id;                         /* Chip ID */
     uint8_t dev_addr;                        /* Device Address */
     size_t spi_irq_num;                      /* Interrupt number */
-    char *p_tx_buff;                         /* Tx buffer */
-    char *p_rx_buff;                         /* Rx buffer */
+    char *p_tx_buff;                         /* Tx buffer of the bus owner */
+    char *p_rx_buff;                         /* Rx buffer of the bus owner */
     size_t tx_len;                           /* Tx length */
     size_t rx_len;                           /* Rx length */
     size_t tx_pos;                           /* Tx position */
     size_t rx_pos;                           /* Rx position */
+    unsigned int word_bytes;                 /* Bytes per FIFO word of the transfer */
+    bool packed;                             /* Words packed from a byte stream, big endian */
+    size_t afl;                              /* RX almost full level of the transfer, bytes */
     uint32_t irqstatus;                      /* IRQ Status */
-    struct mutex mtx_lock;                   /* Mutex */
+    spinlock_t xfer_lock;                    /* Transfer queue */
+    struct list_head xfer_queue;             /* Files waiting for the bus, the first one owns it */
+    struct spi_buff_t pool[SPI_DRIVER_POOL_SIZE]; /* Transfer buffers */
+    struct list_head pool_free;              /* Buffers not lent, last returned first */
+    spinlock_t pool_lock;                    /* Free list */
+    struct spi_debug_stats_t stats;          /* Counters and latency histograms */
+    u64 wakeup_ns;                           /* When the IRQ handler woke up the transfer */
+    struct dentry *debug_dir;                /* debugfs directory */
+    struct spi_channel_t ch[MCSPI_CHANNELS]; /* Chip selects, indexed by minor */
+    unsigned int num_ch;                     /* Chip selects in the device tree */
+    struct spi_channel_t *active;            /* Channel with the FIFO enabled */
     void *pcm_per;
     void *pcontrol_module;
     void *pspi_addr;
@@ -154,23 +347,23 @@ static struct cdev *p_cdev;
  *  Debug Wrapper
  **************************************************************************/
 
-#define DEBUG
+/* Errors always print, the rest only with -DDEBUG. The format is still checked when compiled out */
+#define print_err(fmt, args...) printk(KERN_ERR "spi_driver: " fmt, ##args)
 
 #ifdef DEBUG
 #    define print_dbg(fmt, args...) printk(KERN_DEBUG "spi_driver: " fmt, ##args)
-#    define print_err(fmt, args...) printk(KERN_ERR "spi_driver: " fmt, ##args)
 #    define print_info(fmt, args...) printk(KERN_INFO "spi_driver: " fmt, ##args)
 #else
-#    define print_dbg(fmt, args....) \
-        do                           \
-        {                            \
-        } while(0)
-#    define print_err(fmt, args....) \
-        do                           \
-        {                            \
+#    define print_dbg(fmt, args...)                              \
+        do                                                       \
+        {                                                        \
+            if(0)                                                \
+                printk(KERN_DEBUG "spi_driver: " fmt, ##args);   \
         } while(0)
-#    define print_info(fmt, args....) \
-        do                            \
-        {                             \
+#    define print_info(fmt, args...)                             \
+        do                                                       \
+        {                                                        \
+            if(0)                                                \
+                printk(KERN_INFO "spi_driver: " fmt, ##args);    \
         } while(0)
 #endif
@@ -0,0 +1,35 @@
+/**
+ * @file spi_hal.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief McSPI register access and IRQ delivery, on the board or on the host simulator
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Build with SPI_TD3_SIM to run the driver against the register model in src/sim.
+ *
+ */
+
+#ifndef SPI_HAL_H
+#define SPI_HAL_H
+
+#ifdef SPI_TD3_SIM
+
+#    define spi_reg_read(reg) spi_sim_reg_read(reg)
+#    define spi_reg_write(value, reg) spi_sim_reg_write((value), (reg))
+#    define spi_irq_request(irq, handler, name) \
+        spi_sim_request_irq((irq), ( spi_sim_irq_handler_t )(handler), NULL)
+#    define spi_irq_free(irq) spi_sim_free_irq(irq)
+
+#else
+
+#    define spi_reg_read(reg) ioread32(dev.pspi_addr + (reg))
+#    define spi_reg_write(value, reg) iowrite32((value), dev.pspi_addr + (reg))
+#    define spi_irq_request(irq, handler, name) \
+        request_irq((irq), ( irq_handler_t )(handler), IRQF_TRIGGER_RISING, (name), NULL)
+#    define spi_irq_free(irq) free_irq((irq), NULL)
+
+#endif
+
+#endif
@@ -0,0 +1,122 @@
+/**
+ * @file spi_trace.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Tracepoints of the lifecycle of a transaction
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Every event is timestamped by the trace buffer, so the latency of each step of a transaction
+ * is the distance between its events on the same chip select:
+ *
+ *   trace-cmd record -e spi_td3 && trace-cmd report
+ *
+ * When tracing is off each call site costs a static branch.
+ *
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM spi_td3
+
+#if !defined(_SPI_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _SPI_TRACE_H_
+
+#ifndef SPI_TD3_SIM
+#    include <linux/tracepoint.h>
+#endif
+
+
+/**
+ * @brief A transaction entered the bus queue
+ *
+ * @param ch Chip select
+ * @param len Bytes of the transaction, 0 for a configuration
+ */
+TRACE_EVENT(spi_td3_queued,
+            TP_PROTO(unsigned int ch, size_t len),
+            TP_ARGS(ch, len),
+            TP_STRUCT__entry(__field(unsigned int, ch) __field(size_t, len)),
+            TP_fast_assign(__entry->ch = ch; __entry->len = len;),
+            TP_printk("ch=%u len=%zu", __entry->ch, __entry->len));
+
+
+/**
+ * @brief CS changed, after the setup delay when asserted and the inactive delay when released
+ *
+ * @param ch Chip select
+ * @param active Asserted
+ */
+TRACE_EVENT(spi_td3_cs,
+            TP_PROTO(unsigned int ch, bool active),
+            TP_ARGS(ch, active),
+            TP_STRUCT__entry(__field(unsigned int, ch) __field(bool, active)),
+            TP_fast_assign(__entry->ch = ch; __entry->active = active;),
+            TP_printk("ch=%u %s", __entry->ch, __entry->active ? "asserted" : "released"));
+
+
+/**
+ * @brief Transfer interrupt, after the FIFO was serviced
+ *
+ * @param ch Chip select
+ * @param status IRQSTATUS
+ * @param rx_pos Bytes received so far
+ * @param rx_len Bytes of the run
+ */
+TRACE_EVENT(spi_td3_irq,
+            TP_PROTO(unsigned int ch, uint32_t status, size_t rx_pos, size_t rx_len),
+            TP_ARGS(ch, status, rx_pos, rx_len),
+            TP_STRUCT__entry(__field(unsigned int, ch) __field(uint32_t, status)
+                                 __field(size_t, rx_pos) __field(size_t, rx_len)),
+            TP_fast_assign(__entry->ch = ch; __entry->status = status;
+                           __entry->rx_pos = rx_pos; __entry->rx_len = rx_len;),
+            TP_printk("ch=%u status=0x%08x rx=%zu/%zu",
+                      __entry->ch, __entry->status, __entry->rx_pos, __entry->rx_len));
+
+
+/**
+ * @brief A transfer of one buffer finished on the bus
+ *
+ * @param ch Chip select
+ * @param len Bytes transferred
+ * @param packed Bytes sent as packed 32 bit words
+ * @param ns Time on the bus, FIFO service included
+ */
+TRACE_EVENT(spi_td3_transfer,
+            TP_PROTO(unsigned int ch, size_t len, size_t packed, u64 ns),
+            TP_ARGS(ch, len, packed, ns),
+            TP_STRUCT__entry(__field(unsigned int, ch) __field(size_t, len)
+                                 __field(size_t, packed) __field(u64, ns)),
+            TP_fast_assign(__entry->ch = ch; __entry->len = len; __entry->packed = packed;
+                           __entry->ns = ns;),
+            TP_printk("ch=%u len=%zu packed=%zu ns=%llu",
+                      __entry->ch, __entry->len, __entry->packed,
+                      ( unsigned long long )__entry->ns));
+
+
+/**
+ * @brief The last user copy of a transaction is done, the call is about to return
+ *
+ * @param ch Chip select
+ * @param len Bytes of the transaction
+ * @param to_user Bytes went to user, otherwise they came from user
+ */
+TRACE_EVENT(spi_td3_copy,
+            TP_PROTO(unsigned int ch, size_t len, bool to_user),
+            TP_ARGS(ch, len, to_user),
+            TP_STRUCT__entry(__field(unsigned int, ch) __field(size_t, len)
+                                 __field(bool, to_user)),
+            TP_fast_assign(__entry->ch = ch; __entry->len = len; __entry->to_user = to_user;),
+            TP_printk("ch=%u len=%zu %s",
+                      __entry->ch, __entry->len, __entry->to_user ? "to user" : "from user"));
+
+#endif /* _SPI_TRACE_H_ */
+
+/* Must be outside the header guard, define_trace.h includes this file again */
+#ifndef SPI_TD3_SIM
+#    undef TRACE_INCLUDE_PATH
+#    define TRACE_INCLUDE_PATH .
+#    undef TRACE_INCLUDE_FILE
+#    define TRACE_INCLUDE_FILE spi_trace
+#    include <trace/define_trace.h>
+#endif
@@ -0,0 +1,813 @@
+/**
+ * @file linux_shim.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Just enough of the kernel API to build spi_driver.c as a host program against the
+ * McSPI model in spi_sim.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Everything runs in a single thread: sleeping advances the simulated hardware until the
+ * condition holds, and the IRQ handler is called from inside the register accesses.
+ *
+ */
+
+#ifndef LINUX_SHIM_H
+#define LINUX_SHIM_H
+
+#ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include "spi_sim.h"
+
+
+/*************************************************************************
+ *  Types
+ **************************************************************************/
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int32_t s32;
+typedef long long s64;
+
+struct module;
+struct pt_regs;
+struct class;
+
+typedef struct poll_table_struct
+{
+    int unused;
+} poll_table;
+
+struct vm_area_struct
+{
+    unsigned long vm_start;
+    unsigned long vm_end;
+    unsigned long vm_pgoff;
+};
+
+struct fasync_struct
+{
+    int fd;
+    struct file *filp;
+};
+
+struct inode
+{
+    dev_t i_rdev;
+    void *i_private;
+};
+
+struct file
+{
+    void *private_data;
+    unsigned int f_flags;
+};
+
+struct file_operations
+{
+    struct module *owner;
+    int (*open)(struct inode *, struct file *);
+    int (*release)(struct inode *, struct file *);
+    ssize_t (*read)(struct file *, char *, size_t, loff_t *);
+    ssize_t (*write)(struct file *, const char *, size_t, loff_t *);
+    loff_t (*llseek)(struct file *, loff_t, int);
+    long (*unlocked_ioctl)(struct file *, unsigned int, unsigned long);
+    unsigned int (*poll)(struct file *, struct poll_table_struct *);
+    int (*fasync)(int, struct file *, int);
+    int (*mmap)(struct file *, struct vm_area_struct *);
+};
+
+struct cdev
+{
+    const struct file_operations *ops;
+    struct module *owner;
+    dev_t dev;
+};
+
+struct device_node
+{
+    const char *name;
+    const char *compatible;
+    u32 reg[2];
+    u32 cs_gpio;                 /* td3,cs-gpio of a slave node */
+    struct device_node *child;   /* First slave node */
+    struct device_node *sibling; /* Next slave node */
+};
+
+struct attribute
+{
+    const char *name;
+    unsigned short mode;
+};
+
+struct attribute_group
+{
+    struct attribute **attrs;
+};
+
+struct device
+{
+    struct device_node *of_node;
+    dev_t devt;
+    void *driver_data;
+    const struct attribute_group **groups;
+};
+
+/* sysfs is not there, the simulation calls show and store itself */
+struct device_attribute
+{
+    struct attribute attr;
+    ssize_t (*show)(struct device *, struct device_attribute *, char *);
+    ssize_t (*store)(struct device *, struct device_attribute *, const char *, size_t);
+};
+
+#define DEVICE_ATTR_RW(_name)                       \
+    struct device_attribute dev_attr_##_name = {    \
+        { #_name, 0644 }, _name##_show, _name##_store \
+    }
+#define ATTRIBUTE_GROUPS(_name)                                                  \
+    static const struct attribute_group _name##_group = { _name##_attrs };       \
+    static const struct attribute_group *_name##_groups[] = { &_name##_group, NULL }
+#define dev_get_drvdata(device) ((device)->driver_data)
+
+/* Nor is debugfs, the simulation calls the show function of a file itself */
+struct dentry
+{
+    const char *name;
+};
+
+struct seq_file
+{
+    char *buf;
+    size_t size;
+    size_t count;
+};
+
+static inline void seq_printf(struct seq_file *m, const char *fmt, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, fmt);
+    len = vsnprintf(m->buf + m->count, m->size - m->count, fmt, args);
+    va_end(args);
+
+    if(len > 0)
+    {
+        m->count = m->count + len < m->size ? m->count + len : m->size - 1;
+    }
+}
+
+#define seq_puts(m, s) seq_printf((m), "%s", (s))
+
+static inline int single_open(struct file *file, int (*show)(struct seq_file *, void *), void *data)
+{
+    return 0;
+}
+
+static inline struct dentry *debugfs_create_dir(const char *name, struct dentry *parent)
+{
+    static struct dentry dir;
+
+    dir.name = name;
+    return &dir;
+}
+
+static inline struct dentry *debugfs_create_file(const char *name,
+                                                 unsigned int mode,
+                                                 struct dentry *parent,
+                                                 void *data,
+                                                 const struct file_operations *fops)
+{
+    return parent;
+}
+
+#define debugfs_remove_recursive(dentry) ((void)(dentry))
+#define seq_read NULL
+#define seq_lseek NULL
+#define single_release NULL
+
+/* Tracepoints, every event compiles to an empty call */
+#define TP_PROTO(args...) args
+#define TP_ARGS(args...) args
+#define TRACE_EVENT(name, proto, args, tstruct, assign, print) \
+    static inline void trace_##name(proto)                    \
+    {                                                          \
+    }
+
+struct platform_device
+{
+    const char *name;
+    struct device dev;
+};
+
+struct of_device_id
+{
+    char compatible[128];
+    const void *data;
+};
+
+struct device_driver
+{
+    const char *name;
+    struct module *owner;
+    const struct of_device_id *of_match_table;
+};
+
+struct platform_driver
+{
+    struct device_driver driver;
+    int (*probe)(struct platform_device *);
+    int (*remove)(struct platform_device *);
+};
+
+typedef enum
+{
+    IRQ_NONE,
+    IRQ_HANDLED
+} irqreturn_t;
+
+typedef irqreturn_t (*irq_handler_t)(int, void *);
+
+
+/*************************************************************************
+ *  Module
+ **************************************************************************/
+
+#define THIS_MODULE NULL
+#define MODULE_DESCRIPTION(x)
+#define MODULE_AUTHOR(x)
+#define MODULE_LICENSE(x)
+#define MODULE_DEVICE_TABLE(type, name)
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define __init
+#define __exit
+#define of_match_ptr(x) (x)
+
+/* The simulation calls these instead of insmod/rmmod */
+#define module_init(fn)           \
+    int spi_sim_module_init(void)  \
+    {                              \
+        return fn();               \
+    }
+#define module_exit(fn)            \
+    void spi_sim_module_exit(void) \
+    {                              \
+        fn();                      \
+    }
+
+int spi_sim_module_init(void);
+void spi_sim_module_exit(void);
+
+
+/*************************************************************************
+ *  Helpers
+ **************************************************************************/
+
+#define KERN_DEBUG ""
+#define KERN_ERR ""
+#define KERN_INFO ""
+#define KERN_WARNING ""
+
+#define printk(fmt, ...)                               \
+    do                                                 \
+    {                                                  \
+        spi_sim_printk();                              \
+        if(getenv("SPI_SIM_VERBOSE") != NULL)          \
+        {                                              \
+            fprintf(stderr, fmt, ##__VA_ARGS__);       \
+        }                                              \
+    } while(0)
+
+#define ERESTARTSYS 512
+#define MAX_RW_COUNT (INT_MAX & ~4095)
+#define GFP_KERNEL 0
+#define VERIFY_READ 0
+#define VERIFY_WRITE 1
+#define IRQF_TRIGGER_RISING 0x1
+
+#define MAJOR(dev) (( unsigned int )((dev) >> 20))
+#define MINOR(dev) (( unsigned int )((dev) & 0xFFFFF))
+#define MKDEV(ma, mi) ((( dev_t )(ma) << 20) | (mi))
+#define iminor(inode) MINOR((inode)->i_rdev)
+
+#define IS_ERR(ptr) (( unsigned long )(ptr) >= ( unsigned long )-4095)
+#define scnprintf(buf, size, fmt, ...) snprintf((buf), (size), fmt, ##__VA_ARGS__)
+#define div_u64(dividend, divisor) (( u64 )(dividend) / (divisor))
+#define div64_u64(dividend, divisor) (( u64 )(dividend) / (divisor))
+#define cpu_relax() ((void)0)
+#define clamp(val, lo, hi) ((val) < (lo) ? (lo) : (val) > (hi) ? (hi) : (val))
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define fls64(x) ((x) == 0 ? 0 : 64 - __builtin_clzll(x))
+
+#define PAGE_SIZE 4096
+
+static inline int kstrtouint(const char *s, unsigned int base, unsigned int *res)
+{
+    unsigned long value;
+    char *end;
+
+    errno = 0;
+    value = strtoul(s, &end, base);
+    if(end == s || (*end != '\0' && strcmp(end, "\n") != 0) || errno != 0 || value > UINT_MAX)
+    {
+        return -EINVAL;
+    }
+
+    *res = value;
+    return 0;
+}
+
+#define kmalloc(size, flags) spi_sim_alloc((size), false)
+#define kzalloc(size, flags) spi_sim_alloc((size), true)
+#define kfree(ptr) free(ptr)
+#define vfree(ptr) free(ptr)
+
+static inline void *vmalloc_user(size_t size)
+{
+    void *ptr = aligned_alloc(PAGE_SIZE, (size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1));
+
+    return ptr != NULL ? memset(ptr, 0, size) : NULL;
+}
+
+/* The user mapping is the buffer itself */
+static inline int remap_vmalloc_range(struct vm_area_struct *vma, void *addr, unsigned long pgoff)
+{
+    unsigned long size = vma->vm_end - vma->vm_start;
+
+    vma->vm_start = ( unsigned long )addr + pgoff * PAGE_SIZE;
+    vma->vm_end = vma->vm_start + size;
+    return 0;
+}
+
+#define access_ok(type, addr, size) ((addr) != NULL)
+#define copy_from_user(to, from, n) (memcpy((to), (from), (n)), 0)
+#define copy_to_user(to, from, n) (memcpy((to), (from), (n)), 0)
+
+
+/*************************************************************************
+ *  Lists
+ **************************************************************************/
+
+#define container_of(ptr, type, member) (( type * )(( char * )(ptr)-offsetof(type, member)))
+
+struct list_head
+{
+    struct list_head *next, *prev;
+};
+
+static inline void INIT_LIST_HEAD(struct list_head *list)
+{
+    list->next = list->prev = list;
+}
+
+static inline int list_empty(const struct list_head *head)
+{
+    return head->next == head;
+}
+
+static inline void list_add_tail(struct list_head *node, struct list_head *head)
+{
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+}
+
+static inline void list_add(struct list_head *node, struct list_head *head)
+{
+    node->prev = head;
+    node->next = head->next;
+    head->next->prev = node;
+    head->next = node;
+}
+
+static inline void list_del(struct list_head *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+static inline void list_del_init(struct list_head *node)
+{
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    INIT_LIST_HEAD(node);
+}
+
+#define list_first_entry_or_null(head, type, member) \
+    (list_empty(head) ? NULL : container_of((head)->next, type, member))
+
+
+/*************************************************************************
+ *  Synchronisation, single threaded
+ **************************************************************************/
+
+#define READ_ONCE(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define smp_wmb() __atomic_thread_fence(__ATOMIC_RELEASE)
+#define smp_store_release(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+typedef struct
+{
+    int counter;
+} atomic_t;
+
+#define atomic_set(v, i) ((v)->counter = (i))
+#define atomic_read(v) ((v)->counter)
+#define atomic_inc(v) ((v)->counter++)
+#define atomic_dec(v) ((v)->counter--)
+
+typedef struct
+{
+    long long counter;
+} atomic64_t;
+
+#define atomic64_set(v, i) ((v)->counter = (i))
+#define atomic64_read(v) ((v)->counter)
+#define atomic64_inc(v) ((v)->counter++)
+#define atomic64_add(i, v) ((v)->counter += (i))
+
+struct mutex
+{
+    int locked;
+};
+
+#define mutex_init(m) ((m)->locked = 0)
+#define mutex_destroy(m) ((void)(m))
+#define mutex_lock(m) ((m)->locked = 1)
+#define mutex_lock_interruptible(m) ((m)->locked = 1, 0)
+#define mutex_unlock(m) ((m)->locked = 0)
+#define mutex_is_locked(m) ((m)->locked)
+
+typedef struct
+{
+    int locked;
+} spinlock_t;
+
+#define spin_lock_init(l) ((l)->locked = 0)
+#define spin_lock(l) ((l)->locked = 1)
+#define spin_unlock(l) ((l)->locked = 0)
+
+typedef struct
+{
+    int sleepers;
+} wait_queue_head_t;
+
+#define DECLARE_WAIT_QUEUE_HEAD(name) wait_queue_head_t name __attribute__((unused)) = { 0 }
+#define wake_up_interruptible(wq) ((void)(wq))
+
+/* Nothing sleeps in poll, the caller waits with spi_sim_wait */
+#define poll_wait(filp, wq, table) ((void)(wq))
+
+/* One async reader, SIGIO is only counted */
+static inline int fasync_helper(int fd, struct file *filp, int on, struct fasync_struct **fa)
+{
+    static struct fasync_struct entry;
+
+    entry.fd = fd;
+    entry.filp = filp;
+    *fa = on ? &entry : NULL;
+    return 0;
+}
+
+static inline void kill_fasync(struct fasync_struct **fa, int sig, int band)
+{
+    if(*fa != NULL)
+    {
+        spi_sim_signal();
+    }
+}
+
+/* Sleep until the condition holds, the hardware model runs meanwhile */
+#define wait_event_interruptible(wq, condition)      \
+    ({                                               \
+        int __ret = 0;                               \
+        bool __slept = false;                        \
+        while(!(condition))                          \
+        {                                            \
+            __slept = true;                          \
+            if(spi_sim_wait() < 0)                   \
+            {                                        \
+                __ret = -ERESTARTSYS;                \
+                break;                               \
+            }                                        \
+        }                                            \
+        if(__slept && __ret == 0)                    \
+        {                                            \
+            spi_sim_wakeup();                        \
+        }                                            \
+        __ret;                                       \
+    })
+
+/* Same with a timeout in jiffies, when nothing would wake the caller the time skips to it */
+#define wait_event_interruptible_timeout(wq, condition, timeout) \
+    ({                                                           \
+        u64 __deadline = spi_sim_now() + (timeout);              \
+        long __ret = 1;                                          \
+        bool __slept = false;                                    \
+        while(!(condition))                                      \
+        {                                                        \
+            __slept = true;                                      \
+            if(spi_sim_now() >= __deadline)                      \
+            {                                                    \
+                __ret = 0;                                       \
+                break;                                           \
+            }                                                    \
+            if(spi_sim_wait() < 0)                               \
+            {                                                    \
+                spi_sim_delay(__deadline - spi_sim_now());       \
+            }                                                    \
+        }                                                        \
+        if(__slept)                                              \
+        {                                                        \
+            spi_sim_wakeup();                                    \
+        }                                                        \
+        if(__ret != 0 && spi_sim_now() < __deadline)             \
+        {                                                        \
+            __ret = __deadline - spi_sim_now();                  \
+        }                                                        \
+        __ret;                                                   \
+    })
+
+
+/*************************************************************************
+ *  Time, timers and work
+ **************************************************************************/
+
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000LL
+
+/* Jiffies are nanoseconds in the model */
+#define nsecs_to_jiffies(ns) (( unsigned long )(ns))
+
+typedef s64 ktime_t;
+
+#define ktime_get() (( ktime_t )spi_sim_now())
+#define ktime_get_ns() (( u64 )spi_sim_now())
+#define ktime_set(secs, nsecs) (( ktime_t )(secs) * NSEC_PER_SEC + (nsecs))
+#define ktime_add(a, b) ((a) + (b))
+
+enum hrtimer_restart
+{
+    HRTIMER_NORESTART,
+    HRTIMER_RESTART
+};
+
+enum hrtimer_mode
+{
+    HRTIMER_MODE_ABS,
+    HRTIMER_MODE_REL
+};
+
+struct hrtimer
+{
+    enum hrtimer_restart (*function)(struct hrtimer *);
+    ktime_t expires;
+};
+
+static inline void _hrtimer_fire(void *id)
+{
+    struct hrtimer *timer = id;
+
+    if(timer->function(timer) == HRTIMER_RESTART)
+    {
+        spi_sim_timer_start(timer, timer->expires, _hrtimer_fire);
+    }
+}
+
+static inline void hrtimer_init(struct hrtimer *timer, clockid_t clock, enum hrtimer_mode mode)
+{
+    memset(timer, 0, sizeof(struct hrtimer));
+}
+
+static inline void hrtimer_start(struct hrtimer *timer, ktime_t time, enum hrtimer_mode mode)
+{
+    timer->expires = mode == HRTIMER_MODE_REL ? ktime_get() + time : time;
+    spi_sim_timer_start(timer, timer->expires, _hrtimer_fire);
+}
+
+/* Move the expiry past now by whole intervals, returns the intervals skipped */
+static inline u64 hrtimer_forward_now(struct hrtimer *timer, ktime_t interval)
+{
+    u64 overruns = 0;
+
+    while(timer->expires <= ktime_get())
+    {
+        timer->expires += interval;
+        overruns++;
+    }
+
+    return overruns;
+}
+
+static inline int hrtimer_cancel(struct hrtimer *timer)
+{
+    spi_sim_timer_cancel(timer);
+    return 0;
+}
+
+struct work_struct
+{
+    void (*func)(struct work_struct *);
+};
+
+static inline void _work_run(void *id)
+{
+    struct work_struct *work = id;
+
+    work->func(work);
+}
+
+#define INIT_WORK(work, fn) ((work)->func = (fn))
+#define schedule_work(work) spi_sim_work_queue((work), _work_run)
+#define cancel_work_sync(work) spi_sim_work_cancel(work)
+
+/* Typed kfifo, size is a power of two */
+#define DECLARE_KFIFO(name, type, size) \
+    struct                              \
+    {                                   \
+        unsigned int in;                \
+        unsigned int out;               \
+        type buf[size];                 \
+    } name
+
+#define INIT_KFIFO(fifo) ((fifo).in = (fifo).out = 0)
+#define kfifo_size(fifo) (sizeof((fifo)->buf) / sizeof((fifo)->buf[0]))
+#define kfifo_len(fifo) (( unsigned int )((fifo)->in - (fifo)->out))
+#define kfifo_is_empty(fifo) (kfifo_len(fifo) == 0)
+#define kfifo_reset(fifo) ((fifo)->in = (fifo)->out = 0)
+
+#define kfifo_put(fifo, val)                                           \
+    ({                                                                 \
+        int __ok = kfifo_len(fifo) < kfifo_size(fifo);                 \
+        if(__ok)                                                       \
+        {                                                              \
+            (fifo)->buf[(fifo)->in++ % kfifo_size(fifo)] = (val);      \
+        }                                                              \
+        __ok;                                                          \
+    })
+
+/* Copy whole elements, copied is in bytes */
+#define kfifo_to_user(fifo, to, len, copied)                                       \
+    ({                                                                             \
+        size_t __esize = sizeof((fifo)->buf[0]);                                   \
+        unsigned int __n = min(( unsigned int )((len) / __esize), kfifo_len(fifo)); \
+        for(unsigned int __i = 0; __i < __n; __i++)                                \
+        {                                                                          \
+            memcpy(( char * )(to) + __i * __esize,                                 \
+                   &(fifo)->buf[(fifo)->out++ % kfifo_size(fifo)],                 \
+                   __esize);                                                       \
+        }                                                                          \
+        *(copied) = __n * __esize;                                                 \
+        0;                                                                         \
+    })
+
+
+/*************************************************************************
+ *  Hardware
+ **************************************************************************/
+
+/* Only the clock and pinmux registers are accessed this way, McSPI goes through spi_hal.h */
+#define ioremap(addr, size) calloc(1, (size))
+#define iounmap(addr) free(addr)
+#define ioread32(addr) (*( volatile u32 * )(addr))
+#define iowrite32(value, addr) (*( volatile u32 * )(addr) = (value))
+
+#define msleep(ms) spi_sim_delay(( uint64_t )(ms) * 1000000)
+#define udelay(us) spi_sim_delay(( uint64_t )(us) * 1000)
+#define usleep_range(min, max) spi_sim_delay(( uint64_t )(min) * 1000)
+#define ndelay(ns) spi_sim_delay(ns)
+
+static inline int gpio_request(unsigned int gpio, const char *label)
+{
+    return 0;
+}
+
+#define gpio_free(gpio)
+#define gpio_direction_output(gpio, value) spi_sim_gpio_set((gpio), (value))
+#define gpio_set_value(gpio, value) spi_sim_gpio_set((gpio), (value))
+
+
+/*************************************************************************
+ *  Device model
+ **************************************************************************/
+
+static inline int alloc_chrdev_region(dev_t *dev, unsigned int base, unsigned int count,
+                                      const char *name)
+{
+    *dev = MKDEV(240, base);
+    return 0;
+}
+
+#define unregister_chrdev_region(dev, count)
+#define cdev_alloc() (( struct cdev * )calloc(1, sizeof(struct cdev)))
+#define cdev_add(cdev, dev, count) 0
+#define cdev_del(cdev) free(cdev)
+#define class_create(owner, name) (( struct class * )1)
+#define class_destroy(cls)
+#define device_create(cls, parent, dev, data, fmt, ...) (( void * )1)
+#define device_destroy(cls, dev)
+
+/* One device per minor, kept here so nothing has to be freed */
+static inline struct device *device_create_with_groups(struct class *cls, struct device *parent,
+                                                       dev_t devt, void *drvdata,
+                                                       const struct attribute_group **groups,
+                                                       const char *fmt, ...)
+{
+    static struct device devices[8];
+    struct device *device = &devices[MINOR(devt) % 8];
+
+    device->devt = devt;
+    device->driver_data = drvdata;
+    device->groups = groups;
+    return device;
+}
+
+static inline int of_property_read_string(struct device_node *node, const char *name,
+                                          const char **out)
+{
+    *out = node->compatible;
+    return 0;
+}
+
+static inline int of_property_read_u32_array(struct device_node *node, const char *name,
+                                             u32 *out, size_t n)
+{
+    memcpy(out, node->reg, n * sizeof(u32));
+    return 0;
+}
+
+/* Only the properties of the slave nodes */
+static inline int of_property_read_u32(struct device_node *node, const char *name, u32 *out)
+{
+    if(strcmp(name, "reg") == 0)
+    {
+        *out = node->reg[0];
+        return 0;
+    }
+
+    if(strcmp(name, "td3,cs-gpio") == 0 && node->cs_gpio != 0)
+    {
+        *out = node->cs_gpio;
+        return 0;
+    }
+
+    return -EINVAL;
+}
+
+#define for_each_available_child_of_node(parent, child) \
+    for((child) = (parent)->child; (child) != NULL; (child) = (child)->sibling)
+#define of_node_put(node) ((void)(node))
+
+#define platform_get_irq(pdev, index) SPI_SIM_IRQ
+
+/* A BMP280 on channel 0 and another one on channel 1, as in am335x-boneblack.dts */
+static struct device_node spi_sim_cs_nodes[] = {
+    { "bmp280@0", NULL, { 0 }, SPI_SIM_CS_GPIO, NULL, &spi_sim_cs_nodes[1] },
+    { "bmp280@1", NULL, { 1 }, SPI_SIM_CS1_GPIO, NULL, NULL },
+};
+static struct device_node spi_sim_of_node = {
+    "spi_td3", "td3,omap4-mcspi", { 0x48030000, 0x400 }, 0, spi_sim_cs_nodes, NULL
+};
+static struct platform_device spi_sim_pdev = { "48030000.spi_td3", { &spi_sim_of_node } };
+static struct platform_driver *spi_sim_platform_driver;
+
+/* Bind the driver to the simulated controller right away */
+static inline int platform_driver_register(struct platform_driver *drv)
+{
+    spi_sim_platform_driver = drv;
+    return drv->probe(&spi_sim_pdev);
+}
+
+static inline void platform_driver_unregister(struct platform_driver *drv)
+{
+    if(spi_sim_platform_driver == drv)
+    {
+        spi_sim_platform_driver = NULL;
+        drv->remove(&spi_sim_pdev);
+    }
+}
+
+#endif
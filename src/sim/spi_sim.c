@@ -0,0 +1,1005 @@
+/**
+ * @file spi_sim.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Register level model of the AM335x McSPI0 with a BMP280 on each GPIO chip select, to
+ * run the driver on the host
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Time only moves forward when the driver touches the hardware or waits: every register access
+ * costs SPI_SIM_REG_NS and words shift at the SCLK rate set in CHiCONF while it does. The IRQ
+ * handler runs synchronously as soon as an enabled status bit is set, unless it is already
+ * running. Timers fire at their expiry in the same way, and queued work runs when the caller
+ * sleeps with nothing on the bus, before the time skips to the next timer. The shift register
+ * and the FIFO belong to the channel enabled last, and only one channel may enable the FIFO.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "spi_sim.h"
+
+
+/* McSPI registers, as documented in the TRM */
+#define SIM_SYSCONFIG 0x110
+#define SIM_SYSSTATUS 0x114
+#define SIM_IRQSTATUS 0x118
+#define SIM_IRQENABLE 0x11C
+#define SIM_SYST 0x124
+#define SIM_MODULCTRL 0x128
+#define SIM_CH_BASE 0x12C   /* CH0CONF */
+#define SIM_CH_STRIDE 0x14
+#define SIM_CHANNELS 4
+#define SIM_CHCONF 0x00     /* Offsets inside the registers of a channel */
+#define SIM_CHSTAT 0x04
+#define SIM_CHCTRL 0x08
+#define SIM_TX 0x0C
+#define SIM_RX 0x10
+#define SIM_XFERLEVEL 0x17C
+
+#define SIM_IRQ_TX_EMPTY(ch) (1 << (4 * (ch)))
+#define SIM_IRQ_RX_FULL(ch) (1 << (4 * (ch) + 2))
+#define SIM_IRQ_EOW (1 << 17)
+
+#define SIM_STAT_RXS (1 << 0)
+#define SIM_STAT_TXS (1 << 1)
+#define SIM_STAT_EOT (1 << 2)
+#define SIM_STAT_TXFFE (1 << 3)
+#define SIM_STAT_TXFFF (1 << 4)
+#define SIM_STAT_RXFFE (1 << 5)
+#define SIM_STAT_RXFFF (1 << 6)
+
+#define SIM_CONF_PHA (1 << 0)
+#define SIM_CONF_POL (1 << 1)
+#define SIM_CONF_CLKD(conf) (((conf) >> 2) & 0xF)
+#define SIM_CONF_WL(conf) ((((conf) >> 7) & 0x1F) + 1)
+#define SIM_CONF_FFEW (1 << 27)
+#define SIM_CONF_FFER (1 << 28)
+#define SIM_CONF_CLKG (1 << 29)
+#define SIM_CTRL_EXTCLK(ctrl) (((ctrl) >> 8) & 0xFF)
+
+#define SIM_FIFO_BYTES 32
+#define SIM_MAX_NESTED_IRQS 1000
+#define SIM_MAX_TIMERS 4
+#define SIM_MAX_WORKS 4
+
+
+/** FIFO of words */
+typedef struct
+{
+    uint32_t words[SIM_FIFO_BYTES];
+    unsigned int head;
+    unsigned int count;
+} sim_fifo_t;
+
+
+/** BMP280 SPI slave */
+typedef struct
+{
+    uint8_t regs[256];
+    bool selected;
+    bool addressed; /* Control byte received */
+    bool reading;
+    uint8_t addr;
+} sim_bmp280_t;
+
+
+/** Kernel timer */
+typedef struct
+{
+    void *id;
+    spi_sim_callback_t fn;
+    uint64_t expires_ns;
+    bool armed;
+} sim_timer_t;
+
+
+/** Deferred work */
+typedef struct
+{
+    void *id;
+    spi_sim_callback_t fn;
+    bool pending;
+} sim_work_t;
+
+
+static struct
+{
+    uint32_t sysconfig;
+    uint32_t irqstatus;
+    uint32_t irqenable;
+    uint32_t modulctrl;
+    uint32_t chconf[SIM_CHANNELS];
+    uint32_t chctrl[SIM_CHANNELS];
+    unsigned int chan;       /* Channel using the shift register and the FIFO */
+    uint32_t xferlevel;
+    sim_fifo_t tx;
+    sim_fifo_t rx;
+    bool shifting;
+    bool stalled;            /* Shift register stuck until a soft reset */
+    uint32_t shift_word;
+    uint64_t shift_left_ns;
+    uint32_t words_done;     /* Words of the current WCNT */
+    spi_sim_irq_handler_t handler;
+    void *dev_id;
+    bool in_irq;
+    sim_timer_t timers[SIM_MAX_TIMERS];
+    sim_work_t works[SIM_MAX_WORKS];
+    bool in_timer;
+    bool in_work;
+    sim_bmp280_t bmp280[SPI_SIM_SLAVES];
+    spi_sim_stats_t stats;
+} sim;
+
+
+/* CS GPIO of each BMP280 */
+static const unsigned int sim_cs_gpio[SPI_SIM_SLAVES] = { SPI_SIM_CS_GPIO, SPI_SIM_CS1_GPIO };
+
+
+/**
+ * @brief Get the configuration of the channel using the shift register
+ *
+ * @return uint32_t CHiCONF
+ */
+static uint32_t _conf(void)
+{
+    return sim.chconf[sim.chan];
+}
+
+
+/**
+ * @brief Bytes one word takes in the FIFO
+ *
+ * @return unsigned int Bytes per word
+ */
+static unsigned int _word_bytes(void)
+{
+    unsigned int wl = SIM_CONF_WL(_conf());
+
+    return wl <= 8 ? 1 : wl <= 16 ? 2 : 4;
+}
+
+
+/**
+ * @brief Capacity of the TX or RX FIFO in words, 1 when the FIFO is disabled
+ *
+ * @param enable_bit FFEW or FFER
+ * @return unsigned int Capacity
+ */
+static unsigned int _capacity(uint32_t enable_bit)
+{
+    return (_conf() & enable_bit) ? SIM_FIFO_BYTES / _word_bytes() : 1;
+}
+
+
+/**
+ * @brief Almost empty level in words, TX empty when the FIFO is disabled
+ *
+ * @return unsigned int Free words that raise TX_EMPTY
+ */
+static unsigned int _tx_level(void)
+{
+    return (_conf() & SIM_CONF_FFEW) ? ((sim.xferlevel & 0x3F) + 1) / _word_bytes() : 1;
+}
+
+
+/**
+ * @brief Almost full level in words, RX full when the FIFO is disabled
+ *
+ * @return unsigned int Received words that raise RX_FULL
+ */
+static unsigned int _rx_level(void)
+{
+    return (_conf() & SIM_CONF_FFER) ? (((sim.xferlevel >> 8) & 0x3F) + 1) / _word_bytes() : 1;
+}
+
+
+static void _fifo_push(sim_fifo_t *fifo, uint32_t word)
+{
+    fifo->words[(fifo->head + fifo->count++) % SIM_FIFO_BYTES] = word;
+}
+
+
+static uint32_t _fifo_pop(sim_fifo_t *fifo)
+{
+    uint32_t word = fifo->words[fifo->head];
+
+    fifo->head = (fifo->head + 1) % SIM_FIFO_BYTES;
+    fifo->count--;
+    return word;
+}
+
+
+/**
+ * @brief Exchange a byte with a BMP280. SPI mode: a control byte (bit 7 set to read, the
+ * register is the control byte with bit 7 set), then data with auto increment when reading,
+ * or data and control byte pairs when writing
+ *
+ * @param slave BMP280
+ * @param mosi Byte from the master
+ * @return uint8_t Byte to the master, 0xFF when not selected
+ */
+static uint8_t _bmp280_exchange(unsigned int slave, uint8_t mosi)
+{
+    sim_bmp280_t *bmp = &sim.bmp280[slave];
+    uint8_t miso = 0xFF;
+
+    if(!bmp->selected)
+    {
+        return miso;
+    }
+
+    if(!bmp->addressed)
+    {
+        bmp->addressed = true;
+        bmp->reading = mosi & 0x80;
+        bmp->addr = mosi | 0x80;
+    }
+    else if(bmp->reading)
+    {
+        miso = spi_sim_bmp280_reg(slave, bmp->addr++);
+    }
+    else
+    {
+        bmp->regs[bmp->addr] = mosi;
+        bmp->addressed = false;
+    }
+
+    return miso;
+}
+
+
+/**
+ * @brief Shift a word MSB first through the BMP280s. MISO idles high, so a slave not selected
+ * reads as 0xFF and two selected slaves corrupt each other. The BMP280 only follows modes 0 and
+ * 3, in modes 1 and 2 it never sees a valid bit and stays silent
+ *
+ * @param word Word from the TX FIFO
+ * @return uint32_t Word for the RX FIFO
+ */
+static uint32_t _exchange_word(uint32_t word)
+{
+    unsigned int bytes = (SIM_CONF_WL(_conf()) + 7) / 8;
+    uint32_t rx = 0;
+    uint8_t miso;
+
+    if(!(_conf() & SIM_CONF_PHA) != !(_conf() & SIM_CONF_POL))
+    {
+        return ( uint32_t )((1ULL << (8 * bytes)) - 1);
+    }
+
+    for(int i = bytes - 1; i >= 0; i--)
+    {
+        miso = 0xFF;
+        for(unsigned int slave = 0; slave < SPI_SIM_SLAVES; slave++)
+        {
+            miso &= _bmp280_exchange(slave, (word >> (8 * i)) & 0xFF);
+        }
+        rx = (rx << 8) | miso;
+    }
+
+    return rx;
+}
+
+
+/**
+ * @brief SCLK of the channel that owns the shifter. With CLKG the divider is EXTCLK:CLKD + 1,
+ * otherwise a power of 2
+ *
+ * @return uint64_t SCLK in Hz
+ */
+static uint64_t _sclk(void)
+{
+    uint32_t conf = _conf();
+
+    if(conf & SIM_CONF_CLKG)
+    {
+        return SPI_SIM_FCLK /
+               (((SIM_CTRL_EXTCLK(sim.chctrl[sim.chan]) << 4) | SIM_CONF_CLKD(conf)) + 1);
+    }
+
+    return SPI_SIM_FCLK >> SIM_CONF_CLKD(conf);
+}
+
+
+/**
+ * @brief Start shifting the next word if the channel can
+ */
+static void _start_word(void)
+{
+    unsigned int wl = SIM_CONF_WL(_conf());
+    uint64_t sclk = _sclk();
+
+    if(sim.shifting || sim.stalled || !(sim.chctrl[sim.chan] & 1) || sim.tx.count == 0 ||
+       sim.rx.count >= _capacity(SIM_CONF_FFER))
+    {
+        return;
+    }
+
+    sim.shift_word = _fifo_pop(&sim.tx);
+    sim.shift_left_ns = wl * 1000000000ULL / sclk;
+    sim.shifting = true;
+
+    if(_capacity(SIM_CONF_FFEW) - sim.tx.count == _tx_level())
+    {
+        sim.irqstatus |= SIM_IRQ_TX_EMPTY(sim.chan);
+    }
+}
+
+
+/**
+ * @brief Finish the word being shifted
+ */
+static void _end_word(void)
+{
+    uint32_t wcnt = sim.xferlevel >> 16;
+
+    sim.shifting = false;
+    _fifo_push(&sim.rx, _exchange_word(sim.shift_word));
+    sim.stats.words++;
+
+    if(sim.rx.count == _rx_level())
+    {
+        sim.irqstatus |= SIM_IRQ_RX_FULL(sim.chan);
+    }
+
+    if(wcnt != 0 && ++sim.words_done == wcnt)
+    {
+        sim.irqstatus |= SIM_IRQ_EOW;
+    }
+
+    _start_word();
+}
+
+
+/**
+ * @brief Run the IRQ handler while an enabled status bit is set
+ */
+static void _dispatch_irq(void)
+{
+    int nested = 0;
+
+    while(!sim.in_irq && sim.handler != NULL && (sim.irqstatus & sim.irqenable) &&
+          nested++ < SIM_MAX_NESTED_IRQS)
+    {
+        sim.in_irq = true;
+        sim.stats.irqs++;
+        spi_sim_delay(SPI_SIM_IRQ_NS);
+        sim.handler(SPI_SIM_IRQ, sim.dev_id);
+        sim.in_irq = false;
+    }
+}
+
+
+/**
+ * @brief Get the armed timer that expires first
+ *
+ * @return sim_timer_t* Timer, NULL if none is armed
+ */
+static sim_timer_t *_next_timer(void)
+{
+    sim_timer_t *next = NULL;
+
+    for(int i = 0; i < SIM_MAX_TIMERS; i++)
+    {
+        if(sim.timers[i].armed && (next == NULL || sim.timers[i].expires_ns < next->expires_ns))
+        {
+            next = &sim.timers[i];
+        }
+    }
+
+    return next;
+}
+
+
+static void _advance(uint64_t ns);
+
+
+/**
+ * @brief Run the callbacks of the expired timers, they may arm themselves again
+ */
+static void _fire_timers(void)
+{
+    sim_timer_t *timer;
+
+    if(sim.in_timer)
+    {
+        return;
+    }
+
+    sim.in_timer = true;
+
+    while((timer = _next_timer()) != NULL && timer->expires_ns <= sim.stats.time_ns)
+    {
+        timer->armed = false;
+        sim.stats.timers++;
+        _advance(SPI_SIM_IRQ_NS);
+        timer->fn(timer->id);
+    }
+
+    sim.in_timer = false;
+}
+
+
+/**
+ * @brief Run one queued work item
+ *
+ * @return bool A work item ran
+ */
+static bool _run_work(void)
+{
+    for(int i = 0; i < SIM_MAX_WORKS; i++)
+    {
+        if(sim.works[i].pending)
+        {
+            sim.works[i].pending = false;
+            sim.in_work = true;
+            spi_sim_wakeup(); /* The worker thread */
+            sim.works[i].fn(sim.works[i].id);
+            sim.in_work = false;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/**
+ * @brief Advance the simulated time, shifting words and firing timers meanwhile
+ *
+ * @param ns Nanoseconds
+ */
+static void _advance(uint64_t ns)
+{
+    while(ns > 0)
+    {
+        uint64_t step = ns;
+        sim_timer_t *timer = _next_timer();
+
+        if(sim.shifting && sim.shift_left_ns < step)
+        {
+            step = sim.shift_left_ns;
+        }
+
+        if(timer != NULL && !sim.in_timer && timer->expires_ns > sim.stats.time_ns &&
+           timer->expires_ns - sim.stats.time_ns < step)
+        {
+            step = timer->expires_ns - sim.stats.time_ns;
+        }
+
+        sim.stats.time_ns += step;
+        ns -= step;
+
+        if(sim.shifting)
+        {
+            sim.shift_left_ns -= step;
+            if(sim.shift_left_ns == 0)
+            {
+                _end_word();
+            }
+        }
+
+        _fire_timers();
+    }
+}
+
+
+/**
+ * @brief Get CHiSTAT from the FIFO state, a channel without it is idle
+ *
+ * @param ch Channel
+ * @return uint32_t Channel status
+ */
+static uint32_t _chstat(unsigned int ch)
+{
+    uint32_t stat = 0;
+
+    if(ch != sim.chan)
+    {
+        return SIM_STAT_TXS | SIM_STAT_EOT | SIM_STAT_TXFFE | SIM_STAT_RXFFE;
+    }
+
+    stat |= sim.rx.count > 0 ? SIM_STAT_RXS : 0;
+    stat |= sim.tx.count == 0 ? SIM_STAT_TXS : 0;
+    stat |= sim.tx.count == 0 && !sim.shifting ? SIM_STAT_EOT : 0;
+    stat |= sim.tx.count == 0 ? SIM_STAT_TXFFE : 0;
+    stat |= sim.tx.count >= _capacity(SIM_CONF_FFEW) ? SIM_STAT_TXFFF : 0;
+    stat |= sim.rx.count == 0 ? SIM_STAT_RXFFE : 0;
+    stat |= sim.rx.count >= _capacity(SIM_CONF_FFER) ? SIM_STAT_RXFFF : 0;
+
+    return stat;
+}
+
+
+/**
+ * @brief Read a register of a channel
+ *
+ * @param ch Channel
+ * @param offset Offset inside the channel registers
+ * @return uint32_t Register value
+ */
+static uint32_t _ch_reg_read(unsigned int ch, uint32_t offset)
+{
+    uint32_t value = 0;
+
+    switch(offset)
+    {
+        case SIM_CHCONF: value = sim.chconf[ch]; break;
+        case SIM_CHSTAT: value = _chstat(ch); break;
+        case SIM_CHCTRL: value = sim.chctrl[ch]; break;
+        case SIM_RX:
+            if(ch != sim.chan || sim.rx.count == 0)
+            {
+                sim.stats.underruns++;
+                break;
+            }
+            value = _fifo_pop(&sim.rx);
+            _start_word();
+            break;
+        default: break;
+    }
+
+    return value;
+}
+
+
+/**
+ * @brief Write a register of a channel. The FIFO enabled on two channels, and words written to
+ * a channel without the shift register, are counted as overruns
+ *
+ * @param ch Channel
+ * @param offset Offset inside the channel registers
+ * @param value Register value
+ */
+static void _ch_reg_write(unsigned int ch, uint32_t offset, uint32_t value)
+{
+    uint32_t fifo = SIM_CONF_FFEW | SIM_CONF_FFER;
+
+    switch(offset)
+    {
+        case SIM_CHCONF:
+            for(unsigned int i = 0; i < SIM_CHANNELS; i++)
+            {
+                if(i != ch && (value & fifo) && (sim.chconf[i] & fifo))
+                {
+                    fprintf(stderr, "spi_sim: FIFO enabled on channels %u and %u\n", i, ch);
+                    sim.stats.overruns++;
+                }
+            }
+            sim.chconf[ch] = value;
+            break;
+        case SIM_CHCTRL:
+            if((value & 1) && !(sim.chctrl[ch] & 1))
+            {
+                /* Enabling the channel restarts the word count and raises TX empty */
+                sim.chan = ch;
+                sim.words_done = 0;
+                sim.chctrl[ch] = value;
+                if(_capacity(SIM_CONF_FFEW) - sim.tx.count >= _tx_level())
+                {
+                    sim.irqstatus |= SIM_IRQ_TX_EMPTY(ch);
+                }
+                _start_word();
+            }
+            else if(!(value & 1))
+            {
+                /* Disabling it drops whatever is left in the FIFOs */
+                sim.chctrl[ch] = value;
+                if(ch == sim.chan)
+                {
+                    sim.tx.count = sim.rx.count = 0;
+                    sim.shifting = false;
+                }
+            }
+            break;
+        case SIM_TX:
+            if(ch != sim.chan || sim.tx.count >= _capacity(SIM_CONF_FFEW))
+            {
+                sim.stats.overruns++;
+                break;
+            }
+            _fifo_push(&sim.tx, value);
+            _start_word();
+            break;
+        default: break;
+    }
+}
+
+
+/**
+ * @brief Soft reset, every register goes back to its reset value and the FIFOs are emptied
+ */
+static void _soft_reset(void)
+{
+    sim.sysconfig = sim.irqstatus = sim.irqenable = sim.modulctrl = sim.xferlevel = 0;
+    memset(sim.chconf, 0, sizeof(sim.chconf));
+    memset(sim.chctrl, 0, sizeof(sim.chctrl));
+    sim.chan = 0;
+    sim.tx.count = sim.rx.count = 0;
+    sim.shifting = sim.stalled = false;
+    sim.words_done = 0;
+}
+
+
+/**
+ * @brief Read a McSPI register
+ *
+ * @param reg Register offset
+ * @return uint32_t Register value
+ */
+uint32_t spi_sim_reg_read(uint32_t reg)
+{
+    uint32_t value = 0;
+
+    sim.stats.reg_reads++;
+    spi_sim_delay(SPI_SIM_REG_NS);
+
+    switch(reg)
+    {
+        case SIM_SYSCONFIG: value = sim.sysconfig; break;
+        case SIM_SYSSTATUS: value = 1; break; /* Reset done */
+        case SIM_IRQSTATUS: value = sim.irqstatus; break;
+        case SIM_IRQENABLE: value = sim.irqenable; break;
+        case SIM_MODULCTRL: value = sim.modulctrl; break;
+        case SIM_XFERLEVEL: value = sim.xferlevel; break;
+        default:
+            if(reg >= SIM_CH_BASE && reg < SIM_CH_BASE + SIM_CHANNELS * SIM_CH_STRIDE)
+            {
+                value = _ch_reg_read((reg - SIM_CH_BASE) / SIM_CH_STRIDE,
+                                     (reg - SIM_CH_BASE) % SIM_CH_STRIDE);
+            }
+            break;
+    }
+
+    return value;
+}
+
+
+/**
+ * @brief Write a McSPI register
+ *
+ * @param value Register value
+ * @param reg Register offset
+ */
+void spi_sim_reg_write(uint32_t value, uint32_t reg)
+{
+    sim.stats.reg_writes++;
+
+    switch(reg)
+    {
+        case SIM_SYSCONFIG:
+            if(value & 0x2)
+            {
+                _soft_reset(); /* Self clears */
+                break;
+            }
+            sim.sysconfig = value;
+            break;
+        case SIM_IRQSTATUS: sim.irqstatus &= ~value; break;
+        case SIM_IRQENABLE: sim.irqenable = value; break;
+        case SIM_MODULCTRL: sim.modulctrl = value; break;
+        case SIM_XFERLEVEL: sim.xferlevel = value; break;
+        default:
+            if(reg >= SIM_CH_BASE && reg < SIM_CH_BASE + SIM_CHANNELS * SIM_CH_STRIDE)
+            {
+                _ch_reg_write((reg - SIM_CH_BASE) / SIM_CH_STRIDE,
+                              (reg - SIM_CH_BASE) % SIM_CH_STRIDE,
+                              value);
+            }
+            break;
+    }
+
+    spi_sim_delay(SPI_SIM_REG_NS);
+}
+
+
+/**
+ * @brief Attach the IRQ handler
+ *
+ * @param irq IRQ number
+ * @param handler Handler
+ * @param dev_id Handler argument
+ * @return int Return value
+ */
+int spi_sim_request_irq(unsigned int irq, spi_sim_irq_handler_t handler, void *dev_id)
+{
+    if(irq != SPI_SIM_IRQ || sim.handler != NULL)
+    {
+        return -1;
+    }
+
+    sim.handler = handler;
+    sim.dev_id = dev_id;
+    return 0;
+}
+
+
+/**
+ * @brief Detach the IRQ handler
+ *
+ * @param irq IRQ number
+ */
+void spi_sim_free_irq(unsigned int irq)
+{
+    sim.handler = NULL;
+}
+
+
+/**
+ * @brief Drive a GPIO, the CS of the BMP280s are active low
+ *
+ * @param gpio GPIO number
+ * @param value Level
+ */
+void spi_sim_gpio_set(unsigned int gpio, int value)
+{
+    spi_sim_delay(SPI_SIM_REG_NS);
+
+    for(unsigned int slave = 0; slave < SPI_SIM_SLAVES; slave++)
+    {
+        /* Only an edge starts a new transaction */
+        if(gpio == sim_cs_gpio[slave] && sim.bmp280[slave].selected != !value)
+        {
+            sim.bmp280[slave].selected = !value;
+            sim.bmp280[slave].addressed = false;
+        }
+    }
+}
+
+
+/**
+ * @brief Spend time on the CPU, the hardware keeps running and may interrupt
+ *
+ * @param ns Nanoseconds
+ */
+void spi_sim_delay(uint64_t ns)
+{
+    _advance(ns);
+    _fire_timers();
+    _dispatch_irq();
+}
+
+
+/**
+ * @brief Sleep until the hardware does something. With the bus idle the queued work runs first,
+ * then the time skips to the next timer. Work never runs inside work
+ *
+ * @return int 0 when time advanced, -1 when nothing would ever wake the caller
+ */
+int spi_sim_wait(void)
+{
+    sim_timer_t *timer;
+
+    if(sim.shifting)
+    {
+        spi_sim_delay(sim.shift_left_ns);
+        return 0;
+    }
+
+    if(sim.in_work)
+    {
+        return -1;
+    }
+
+    if(_run_work())
+    {
+        return 0;
+    }
+
+    if((timer = _next_timer()) != NULL)
+    {
+        spi_sim_delay(timer->expires_ns > sim.stats.time_ns ? timer->expires_ns - sim.stats.time_ns
+                                                            : 0);
+        return 0;
+    }
+
+    return -1;
+}
+
+
+/**
+ * @brief Account for a sleeping task being woken up
+ */
+void spi_sim_wakeup(void)
+{
+    sim.stats.wakeups++;
+    _advance(SPI_SIM_WAKEUP_NS);
+}
+
+
+/**
+ * @brief Account for a signal sent to userspace
+ */
+void spi_sim_signal(void)
+{
+    sim.stats.signals++;
+}
+
+
+/**
+ * @brief Get the simulated time
+ *
+ * @return uint64_t Nanoseconds since the start
+ */
+uint64_t spi_sim_now(void)
+{
+    return sim.stats.time_ns;
+}
+
+
+/**
+ * @brief Arm a timer, or move it if it is already armed
+ *
+ * @param id Timer
+ * @param expires_ns Absolute expiry
+ * @param fn Callback
+ */
+void spi_sim_timer_start(void *id, uint64_t expires_ns, spi_sim_callback_t fn)
+{
+    sim_timer_t *slot = NULL;
+
+    for(int i = 0; i < SIM_MAX_TIMERS; i++)
+    {
+        if(sim.timers[i].id == id || (slot == NULL && sim.timers[i].id == NULL))
+        {
+            slot = &sim.timers[i];
+        }
+    }
+
+    if(slot == NULL)
+    {
+        fprintf(stderr, "spi_sim: too many timers\n");
+        return;
+    }
+
+    slot->id = id;
+    slot->fn = fn;
+    slot->expires_ns = expires_ns;
+    slot->armed = true;
+}
+
+
+/**
+ * @brief Disarm a timer
+ *
+ * @param id Timer
+ */
+void spi_sim_timer_cancel(void *id)
+{
+    for(int i = 0; i < SIM_MAX_TIMERS; i++)
+    {
+        if(sim.timers[i].id == id)
+        {
+            sim.timers[i].armed = false;
+        }
+    }
+}
+
+
+/**
+ * @brief Queue work, once until it runs
+ *
+ * @param id Work
+ * @param fn Function
+ * @return bool It was not already queued
+ */
+bool spi_sim_work_queue(void *id, spi_sim_callback_t fn)
+{
+    sim_work_t *slot = NULL;
+
+    for(int i = 0; i < SIM_MAX_WORKS; i++)
+    {
+        if(sim.works[i].id == id || (slot == NULL && sim.works[i].id == NULL))
+        {
+            slot = &sim.works[i];
+        }
+    }
+
+    if(slot == NULL || slot->pending)
+    {
+        return false;
+    }
+
+    slot->id = id;
+    slot->fn = fn;
+    slot->pending = true;
+    return true;
+}
+
+
+/**
+ * @brief Drop queued work. Work never runs concurrently here, so nothing has to be waited for
+ *
+ * @param id Work
+ */
+void spi_sim_work_cancel(void *id)
+{
+    for(int i = 0; i < SIM_MAX_WORKS; i++)
+    {
+        if(sim.works[i].id == id)
+        {
+            sim.works[i].pending = false;
+        }
+    }
+}
+
+
+/**
+ * @brief Stop the shift register in the middle of a word, no word ends and no IRQ is raised
+ * until the driver soft resets the controller
+ */
+void spi_sim_stall(void)
+{
+    sim.stalled = true;
+    sim.shifting = false;
+}
+
+
+/**
+ * @brief Account for a printk
+ */
+void spi_sim_printk(void)
+{
+    sim.stats.printks++;
+    _advance(SPI_SIM_PRINTK_NS);
+}
+
+
+/**
+ * @brief Allocate kernel memory, counted so the bench can check the transfer path allocates
+ * nothing
+ *
+ * @param size Size
+ * @param zero Zeroed like kzalloc
+ * @return void* Memory, NULL when out of memory
+ */
+void *spi_sim_alloc(size_t size, bool zero)
+{
+    sim.stats.allocs++;
+    return zero ? calloc(1, size) : malloc(size);
+}
+
+
+/**
+ * @brief Get a BMP280 register. Temperature slowly rises with the simulated time, each sensor
+ * a bit warmer than the one before
+ *
+ * @param slave BMP280
+ * @param reg Register
+ * @return uint8_t Register value
+ */
+uint8_t spi_sim_bmp280_reg(unsigned int slave, uint8_t reg)
+{
+    uint32_t adc_t = 519888 + slave * 4096 + (sim.stats.time_ns / 1000000000ULL) * 16;
+
+    switch(reg)
+    {
+        case 0xD0: return 0x58; /* Chip ID */
+        case 0x88: return 27641 & 0xFF; /* dig_T1 */
+        case 0x89: return 27641 >> 8;
+        case 0x8A: return 25684 & 0xFF; /* dig_T2 */
+        case 0x8B: return 25684 >> 8;
+        case 0x8C: return 50; /* dig_T3 */
+        case 0x8D: return 0;
+        case 0xFA: return (adc_t >> 12) & 0xFF;
+        case 0xFB: return (adc_t >> 4) & 0xFF;
+        case 0xFC: return (adc_t << 4) & 0xF0;
+        default: return sim.bmp280[slave].regs[reg];
+    }
+}
+
+
+/**
+ * @brief Get the counters
+ *
+ * @param stats Output counters
+ */
+void spi_sim_stats(spi_sim_stats_t *stats)
+{
+    *stats = sim.stats;
+}
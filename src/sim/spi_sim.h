@@ -0,0 +1,86 @@
+/**
+ * @file spi_sim.h
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief header file for spi_sim.c
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#ifndef SPI_SIM_H
+#define SPI_SIM_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+
+/* Board wiring */
+#define SPI_SIM_IRQ 0x41
+#define SPI_SIM_CS_GPIO 115   /* BMP280 on channel 0 */
+#define SPI_SIM_CS1_GPIO 117  /* BMP280 on channel 1 */
+#define SPI_SIM_SLAVES 2
+#define SPI_SIM_FCLK 48000000 /* McSPI functional clock */
+
+/* Costs used to advance the simulated time, in nanoseconds */
+#define SPI_SIM_REG_NS 150        /* L4 peripheral register access */
+#define SPI_SIM_IRQ_NS 2000       /* Interrupt entry and exit */
+#define SPI_SIM_WAKEUP_NS 20000   /* Waking a sleeping task */
+#define SPI_SIM_PRINTK_NS 10000   /* printk to the log buffer */
+
+
+/** Counters of the simulated hardware */
+typedef struct
+{
+    uint64_t time_ns;     /* Simulated time */
+    uint64_t reg_reads;
+    uint64_t reg_writes;
+    uint64_t irqs;
+    uint64_t timers;      /* Timer callbacks */
+    uint64_t wakeups;
+    uint64_t printks;
+    uint64_t allocs;      /* kmalloc and kzalloc calls */
+    uint64_t signals;     /* SIGIO sent to async readers */
+    uint64_t words;       /* Words shifted on the bus */
+    uint64_t overruns;    /* TX writes to a full FIFO */
+    uint64_t underruns;   /* RX reads from an empty FIFO */
+} spi_sim_stats_t;
+
+
+typedef int (*spi_sim_irq_handler_t)(int irq, void *dev_id);
+typedef void (*spi_sim_callback_t)(void *id);
+
+
+/* McSPI register file */
+uint32_t spi_sim_reg_read(uint32_t reg);
+void spi_sim_reg_write(uint32_t value, uint32_t reg);
+
+/* IRQ line */
+int spi_sim_request_irq(unsigned int irq, spi_sim_irq_handler_t handler, void *dev_id);
+void spi_sim_free_irq(unsigned int irq);
+
+/* Board */
+void spi_sim_gpio_set(unsigned int gpio, int value);
+void spi_sim_stall(void);
+void spi_sim_delay(uint64_t ns);
+int spi_sim_wait(void);
+void spi_sim_wakeup(void);
+void spi_sim_printk(void);
+void *spi_sim_alloc(size_t size, bool zero);
+void spi_sim_signal(void);
+uint64_t spi_sim_now(void);
+
+/* Timers run in interrupt context, work runs while the caller sleeps. Both keyed by id */
+void spi_sim_timer_start(void *id, uint64_t expires_ns, spi_sim_callback_t fn);
+void spi_sim_timer_cancel(void *id);
+bool spi_sim_work_queue(void *id, spi_sim_callback_t fn);
+void spi_sim_work_cancel(void *id);
+
+/* BMP280 */
+uint8_t spi_sim_bmp280_reg(unsigned int slave, uint8_t reg);
+
+void spi_sim_stats(spi_sim_stats_t *stats);
+
+#endif
@@ -0,0 +1,176 @@
+/**
+ * @file bench_gorilla.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Size and decode throughput of the history codec against the data.dat text format
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <math.h>
+#include <time.h>
+
+#include "../../inc/gorilla.h"
+#include "../../inc/ts_store.h"
+
+
+#define BENCH_SAMPLES (24 * 60 * 60) /* A day at 1 Hz */
+#define BENCH_ITERATIONS 20
+
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds
+ *
+ * @return uint64_t Timestamp
+ */
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( uint64_t )ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * @brief Generate a day of readings: 1 s interval with a few ms of jitter, temperature walking by
+ * hundredths of a degree
+ *
+ * @param records Output samples
+ * @param smooth Apply the plot handler moving average instead of keeping two decimals
+ */
+static void _generate(ts_record_t *records, bool smooth)
+{
+    int64_t timestamp = 1792191600000LL;
+    float reading = 24.0f, average = 24.0f;
+
+    srand(1);
+
+    for(size_t i = 0; i < BENCH_SAMPLES; i++)
+    {
+        timestamp += 1000 + rand() % 5 - 2;
+        reading += (rand() % 5 - 2) / 100.0f;
+        average += (reading - average) / 5;
+
+        records[i].timestamp = timestamp;
+        records[i].value = smooth ? average : roundf(reading * 100) / 100;
+    }
+}
+
+
+/**
+ * @brief Compare the formats on a generated day
+ *
+ * @param smooth Apply the moving average
+ */
+static void _bench(bool smooth)
+{
+    ts_record_t *records = malloc(BENCH_SAMPLES * sizeof(ts_record_t));
+    gorilla_encoder_t encoder;
+    gorilla_decoder_t decoder;
+    char *text = NULL, str[32];
+    size_t text_length = 0;
+    uint64_t start, text_ns, gorilla_ns;
+    double checksum = 0;
+    int64_t timestamp;
+    float value;
+    size_t decoded = 0;
+    int hour, min, sec;
+    FILE *fp;
+
+    _generate(records, smooth);
+
+    /* data.dat, as written by the old plot handler */
+    fp = open_memstream(&text, &text_length);
+    for(size_t i = 0; i < BENCH_SAMPLES; i++)
+    {
+        time_t rawtime = records[i].timestamp / 1000;
+        struct tm timeinfo;
+
+        localtime_r(&rawtime, &timeinfo);
+        fprintf(fp,
+                "%02d:%02d:%02d %.2f\n",
+                timeinfo.tm_hour,
+                timeinfo.tm_min,
+                timeinfo.tm_sec,
+                records[i].value);
+    }
+    fclose(fp);
+
+    gorilla_encoder_init(&encoder);
+    for(size_t i = 0; i < BENCH_SAMPLES; i++)
+    {
+        gorilla_encode(&encoder, records[i].timestamp, records[i].value);
+    }
+
+    start = _now_ns();
+    for(int it = 0; it < BENCH_ITERATIONS; it++)
+    {
+        fp = fmemopen(text, text_length, "r");
+        while(fgets(str, sizeof(str), fp) != NULL)
+        {
+            if(sscanf(str, "%d:%d:%d %f", &hour, &min, &sec, &value) == 4)
+            {
+                checksum += value;
+            }
+        }
+        fclose(fp);
+    }
+    text_ns = _now_ns() - start;
+
+    start = _now_ns();
+    for(int it = 0; it < BENCH_ITERATIONS; it++)
+    {
+        gorilla_decoder_init(&decoder, encoder.data, gorilla_encoder_size(&encoder), encoder.count);
+        while(gorilla_decode(&decoder, &timestamp, &value))
+        {
+            checksum += value;
+            decoded++;
+        }
+    }
+    gorilla_ns = _now_ns() - start;
+
+    /* Round trip check */
+    gorilla_decoder_init(&decoder, encoder.data, gorilla_encoder_size(&encoder), encoder.count);
+    for(size_t i = 0; i < BENCH_SAMPLES; i++)
+    {
+        if(!gorilla_decode(&decoder, &timestamp, &value) || timestamp != records[i].timestamp ||
+           value != records[i].value)
+        {
+            fprintf(stderr, "round trip mismatch at sample %zu\n", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    printf("%s values, %d samples\n", smooth ? "moving average" : "two decimal", BENCH_SAMPLES);
+    printf("  data.dat: %6.2f bytes/sample  decode: %7.2f Msamples/s\n",
+           ( double )text_length / BENCH_SAMPLES,
+           ( double )BENCH_SAMPLES * BENCH_ITERATIONS * 1000 / text_ns);
+    printf("  ts_store: %6.2f bytes/sample\n", ( double )sizeof(ts_record_t));
+    printf("  gorilla:  %6.2f bytes/sample  decode: %7.2f Msamples/s\n",
+           ( double )gorilla_encoder_size(&encoder) / BENCH_SAMPLES,
+           ( double )decoded * 1000 / gorilla_ns);
+    printf("  (checksum %.0f)\n", checksum);
+
+    gorilla_encoder_free(&encoder);
+    free(text);
+    free(records);
+}
+
+
+/**
+ * @brief Main function
+ *
+ * @return int Return value
+ */
+int main(void)
+{
+    _bench(false);
+    _bench(true);
+
+    return EXIT_SUCCESS;
+}
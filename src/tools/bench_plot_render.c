@@ -0,0 +1,82 @@
+/**
+ * @file bench_plot_render.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Render time benchmark for the SVG temperature plot
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "../../inc/plot_render.h"
+
+#include <math.h>
+
+
+#define BENCH_ITERATIONS 2000
+
+
+/**
+ * @brief Get a monotonic timestamp in nanoseconds
+ *
+ * @return uint64_t Timestamp
+ */
+static uint64_t _now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( uint64_t )ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+/**
+ * @brief Render the same window BENCH_ITERATIONS times and print the mean render time
+ *
+ * @param count Number of samples in the window
+ */
+static void _bench_render(size_t count)
+{
+    plot_sample_t *samples = malloc(count * sizeof(plot_sample_t));
+    plot_buffer_t svg = { NULL, 0, 0 };
+    time_t now = time(NULL);
+    uint64_t start, elapsed;
+
+    for(size_t i = 0; i < count; i++)
+    {
+        samples[i].timestamp = now - PLOT_WINDOW_BEFORE + ( time_t )(i * PLOT_WINDOW_BEFORE / count);
+        samples[i].value = 25 + 5 * sin(( double )i / 20);
+    }
+
+    plot_render_svg(&svg, samples, count, now - PLOT_WINDOW_BEFORE, now + PLOT_WINDOW_AFTER);
+
+    start = _now_ns();
+    for(int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        plot_render_svg(&svg, samples, count, now - PLOT_WINDOW_BEFORE, now + PLOT_WINDOW_AFTER);
+    }
+    elapsed = _now_ns() - start;
+
+    printf("samples: %5zu  svg: %7zu bytes  render: %8.1f us\n",
+           count,
+           svg.length,
+           ( double )elapsed / BENCH_ITERATIONS / 1000);
+
+    plot_buffer_free(&svg);
+    free(samples);
+}
+
+
+/**
+ * @brief Main function
+ *
+ * @return int Return value
+ */
+int main(void)
+{
+    _bench_render(PLOT_WINDOW_BEFORE);
+    _bench_render(PLOT_MAX_SAMPLES);
+
+    return EXIT_SUCCESS;
+}
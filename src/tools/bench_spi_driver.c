@@ -0,0 +1,837 @@
+/**
+ * @file bench_spi_driver.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief IRQs, register accesses and latency per transaction of spi_driver.c, run on the host
+ * against the McSPI and BMP280 model
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * The driver is built into this program with SPI_TD3_SIM, see src/sim.
+ *
+ */
+
+#include "../driver/spi_driver.c"
+
+
+#define BENCH_TRANSACTIONS 1000
+#define BENCH_SAMPLES 1000
+#define BMP280_READ 0x80
+#define BMP280_REG_CALIB 0x88
+#define BMP280_REG_TEMP 0xFA
+#define BMP280_REG_CTRL_MEAS 0xF4
+#define BMP280_SPEED_MAX 10000000
+#define BENCH_MAX_BYTES (4 * SPI_DRIVER_BUFF_SIZE)
+
+
+static unsigned int word_bytes = 1; /* Bits per word of the device / 8 */
+
+
+/**
+ * @brief Swap between the wire order of the bytes and CPU order words, on a little endian host
+ *
+ * @param buf Buffer
+ * @param length Size, a multiple of word_bytes
+ */
+static void _swap_words(char *buf, size_t length)
+{
+    char aux;
+
+    for(size_t i = 0; i < length; i += word_bytes)
+    {
+        for(size_t j = 0; j < word_bytes / 2; j++)
+        {
+            aux = buf[i + j];
+            buf[i + j] = buf[i + word_bytes - 1 - j];
+            buf[i + word_bytes - 1 - j] = aux;
+        }
+    }
+}
+
+
+/**
+ * @brief Read registers with read(), the first byte of the buffer is the control byte. With
+ * wider words the buffer holds CPU order words
+ *
+ * @param filp Open device
+ * @param reg First register to read
+ * @param data Register values
+ * @param length Registers to read
+ * @return bool Success
+ */
+static bool _read_regs(struct file *filp, uint8_t reg, uint8_t *data, size_t length)
+{
+    char buf[BENCH_MAX_BYTES];
+
+    memset(buf, 0, sizeof(buf));
+    buf[0] = reg | BMP280_READ;
+    _swap_words(buf, length + 1);
+
+    if(spi_driver_read(filp, buf, length + 1, NULL) != ( ssize_t )length + 1)
+    {
+        return false;
+    }
+
+    _swap_words(buf, length + 1);
+    memcpy(data, buf + 1, length);
+    return true;
+}
+
+
+/**
+ * @brief Read registers with a two segment message, control byte then data under the same CS
+ *
+ * @param filp Open device
+ * @param reg First register to read
+ * @param data Register values
+ * @param length Registers to read
+ * @return bool Success
+ */
+static bool _message_regs(struct file *filp, uint8_t reg, uint8_t *data, size_t length)
+{
+    struct spi_td3_segment msg[2];
+    uint8_t control = reg | BMP280_READ;
+
+    memset(msg, 0, sizeof(msg));
+    msg[0].tx_buf = ( uintptr_t )&control;
+    msg[0].len = 1;
+    msg[0].keep_cs = 1;
+    msg[1].rx_buf = ( uintptr_t )data;
+    msg[1].len = length;
+
+    return spi_driver_ioctl(filp, SPI_TD3_IOC_MESSAGE(2), ( unsigned long )msg) ==
+           ( long )length + 1;
+}
+
+
+/**
+ * @brief Run transactions of the same size and check the data returned against the model
+ *
+ * @param filp Open device
+ * @param name Access method
+ * @param access Access function
+ * @param reg First register to read
+ * @param length Registers to read
+ * @return int Number of mismatches
+ */
+static int _bench(struct file *filp,
+                  const char *name,
+                  bool (*access)(struct file *, uint8_t, uint8_t *, size_t),
+                  uint8_t reg,
+                  size_t length)
+{
+    uint8_t data[BENCH_MAX_BYTES];
+    spi_sim_stats_t before, after;
+    int errors = 0;
+
+    spi_sim_stats(&before);
+
+    for(int i = 0; i < BENCH_TRANSACTIONS; i++)
+    {
+        if(!access(filp, reg, data, length))
+        {
+            errors++;
+            continue;
+        }
+
+        /* The temperature moves with the simulated time, the address wraps after 0xFF */
+        for(size_t j = 0; j < length; j++)
+        {
+            uint8_t addr = reg + j;
+
+            if(data[j] != spi_sim_bmp280_reg(0, addr) &&
+               (addr < BMP280_REG_TEMP || addr > BMP280_REG_TEMP + 2))
+            {
+                errors++;
+                break;
+            }
+        }
+    }
+
+    spi_sim_stats(&after);
+
+    printf("%-7s %5zu bytes | %7.2f irqs | %6.1f reg rd | %6.1f reg wr | %4.2f wakeups | "
+           "%4.2f printk | %7.1f us\n",
+           name,
+           length + 1,
+           ( double )(after.irqs - before.irqs) / BENCH_TRANSACTIONS,
+           ( double )(after.reg_reads - before.reg_reads) / BENCH_TRANSACTIONS,
+           ( double )(after.reg_writes - before.reg_writes) / BENCH_TRANSACTIONS,
+           ( double )(after.wakeups - before.wakeups) / BENCH_TRANSACTIONS,
+           ( double )(after.printks - before.printks) / BENCH_TRANSACTIONS,
+           ( double )(after.time_ns - before.time_ns) / BENCH_TRANSACTIONS / 1000);
+
+    if(after.overruns != before.overruns || after.underruns != before.underruns)
+    {
+        printf("       FIFO overruns: %llu underruns: %llu\n",
+               ( unsigned long long )(after.overruns - before.overruns),
+               ( unsigned long long )(after.underruns - before.underruns));
+        errors++;
+    }
+
+    return errors;
+}
+
+
+/**
+ * @brief Wait like epoll_wait does for the device to become readable
+ *
+ * @param filp Open device
+ * @return bool Readable, false when nothing would ever wake the caller
+ */
+static bool _poll_in(struct file *filp)
+{
+    return wait_event_interruptible(spi_rx_queue, spi_driver_poll(filp, NULL) & POLLIN) == 0;
+}
+
+
+/**
+ * @brief Let the driver sample the calibration block and drain it with read()
+ *
+ * @param filp Open device
+ * @param rate_hz Samples per second
+ * @param batch Samples per read
+ * @param poll Wait with poll and SIGIO, then read without blocking
+ * @return int Number of wrong or missing samples
+ */
+static int _bench_sampling(struct file *filp, uint32_t rate_hz, uint16_t batch, bool poll)
+{
+    struct spi_td3_sampling cfg = { rate_hz, batch, BMP280_REG_CALIB | BMP280_READ, 6 };
+    struct spi_td3_sample samples[SPI_TD3_FIFO_SAMPLES];
+    int64_t period = NSEC_PER_SEC / rate_hz, min_gap = INT64_MAX, max_gap = 0, prev = 0;
+    spi_sim_stats_t before, after;
+    int errors = 0, reads = 0;
+    uint32_t expected = 0;
+    ssize_t rv;
+
+    if(spi_driver_ioctl(filp, SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg) != 0)
+    {
+        return BENCH_SAMPLES;
+    }
+
+    if(poll)
+    {
+        filp->f_flags |= O_NONBLOCK;
+        spi_driver_fasync(3, filp, 1);
+    }
+
+    spi_sim_stats(&before);
+
+    while(expected < BENCH_SAMPLES)
+    {
+        if(poll && !_poll_in(filp))
+        {
+            errors += BENCH_SAMPLES - expected;
+            break;
+        }
+
+        rv = spi_driver_read(filp, ( char * )samples, sizeof(samples), NULL);
+        reads++;
+
+        if(rv <= 0)
+        {
+            errors += BENCH_SAMPLES - expected;
+            break;
+        }
+
+        for(size_t i = 0; i < rv / sizeof(samples[0]); i++, expected++)
+        {
+            if(samples[i].sequence != expected || samples[i].len != cfg.len ||
+               samples[i].data[0] != spi_sim_bmp280_reg(0, BMP280_REG_CALIB))
+            {
+                errors++;
+            }
+
+            if(expected > 0)
+            {
+                min_gap = min(min_gap, samples[i].timestamp_ns - prev);
+                max_gap = max(max_gap, samples[i].timestamp_ns - prev);
+            }
+            prev = samples[i].timestamp_ns;
+        }
+    }
+
+    spi_sim_stats(&after);
+
+    cfg.rate_hz = 0;
+    spi_driver_ioctl(filp, SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg);
+
+    if(poll)
+    {
+        filp->f_flags &= ~O_NONBLOCK;
+        spi_driver_fasync(-1, filp, 0);
+    }
+
+    printf("%-5s %5u Hz batch %3u | %5.3f reads | %4.2f wakeups | %4.2f SIGIO | period %+6.2f "
+           "%+6.2f us\n",
+           poll ? "poll" : "read",
+           rate_hz,
+           batch,
+           ( double )reads / BENCH_SAMPLES,
+           ( double )(after.wakeups - before.wakeups) / BENCH_SAMPLES,
+           ( double )(after.signals - before.signals) / BENCH_SAMPLES,
+           (min_gap - period) / 1000.0,
+           (max_gap - period) / 1000.0);
+
+    return errors;
+}
+
+
+/**
+ * @brief Let the driver sample the calibration block and consume it from the mapped ring, the
+ * consumer spins on the header instead of sleeping in the driver
+ *
+ * @param filp Open device
+ * @param rate_hz Samples per second
+ * @return int Number of wrong or missing samples
+ */
+static int _bench_ring(struct file *filp, uint32_t rate_hz)
+{
+    struct spi_td3_sampling cfg = { rate_hz, 1, BMP280_REG_CALIB | BMP280_READ, 6 };
+    struct vm_area_struct vma = { 0, SPI_TD3_RING_SIZE, 0 };
+    struct spi_td3_sample samples[64];
+    struct spi_td3_ring_header *ring;
+    spi_sim_stats_t before, after;
+    unsigned int n, consumed = 0;
+    uint32_t expected = 0;
+    uint64_t overruns;
+    int errors = 0;
+
+    if(spi_driver_mmap(filp, &vma) != 0)
+    {
+        return BENCH_SAMPLES;
+    }
+
+    ring = ( struct spi_td3_ring_header * )vma.vm_start;
+    ring->tail = ring->head; /* Only the samples of this run */
+    overruns = ring->overruns;
+
+    if(ring->magic != SPI_TD3_RING_MAGIC ||
+       spi_driver_ioctl(filp, SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg) != 0)
+    {
+        return BENCH_SAMPLES;
+    }
+
+    spi_sim_stats(&before);
+
+    while(consumed < BENCH_SAMPLES)
+    {
+        if((n = spi_td3_ring_consume(ring, samples, 64)) == 0 && spi_sim_wait() < 0)
+        {
+            break;
+        }
+
+        for(unsigned int i = 0; i < n; i++, consumed++)
+        {
+            if(samples[i].sequence != expected++ ||
+               samples[i].data[0] != spi_sim_bmp280_reg(0, BMP280_REG_CALIB))
+            {
+                errors++;
+            }
+        }
+    }
+
+    spi_sim_stats(&after);
+
+    cfg.rate_hz = 0;
+    spi_driver_ioctl(filp, SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg);
+
+    printf("mmap  %5u Hz           | 0     reads | %4.2f wakeups | %llu overruns\n",
+           rate_hz,
+           ( double )(after.wakeups - before.wakeups) / BENCH_SAMPLES,
+           ( unsigned long long )(ring->overruns - overruns));
+
+    return errors + BENCH_SAMPLES - consumed;
+}
+
+
+/**
+ * @brief Share the bus between a file sampling and another one reading the calibration block
+ * between samples. Each sample waits at most for the transaction ahead of it in the queue
+ *
+ * @param inode Device inode
+ * @param rate_hz Samples per second
+ * @param length Registers per read of the second file
+ * @return int Number of wrong or missing samples and reads
+ */
+static int _bench_shared(struct inode *inode, uint32_t rate_hz, size_t length)
+{
+    struct spi_td3_sampling cfg = { rate_hz, 1, BMP280_REG_CALIB | BMP280_READ, 6 };
+    struct file sampler = { 0 }, reader = { 0 };
+    struct spi_td3_sample samples[SPI_TD3_FIFO_SAMPLES];
+    int64_t period = NSEC_PER_SEC / rate_hz, late = 0, read_max = 0, prev = 0, start;
+    uint8_t data[BENCH_MAX_BYTES];
+    uint32_t expected = 0;
+    int errors = 0, reads = 0;
+    ssize_t rv;
+
+    if(spi_driver_open(inode, &sampler) != 0 || spi_driver_open(inode, &reader) != 0)
+    {
+        return BENCH_SAMPLES;
+    }
+
+    sampler.f_flags = O_NONBLOCK;
+
+    if(spi_driver_ioctl(&sampler, SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg) != 0 ||
+       spi_driver_ioctl(&reader, SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg) != -EBUSY)
+    {
+        errors++;
+    }
+
+    while(expected < BENCH_SAMPLES)
+    {
+        start = spi_sim_now();
+        if(!_read_regs(&reader, BMP280_REG_CALIB, data, length) ||
+           data[0] != spi_sim_bmp280_reg(0, BMP280_REG_CALIB))
+        {
+            errors++;
+        }
+        read_max = max(read_max, ( int64_t )spi_sim_now() - start);
+        reads++;
+
+        /* The reader sleeps, the sampling work gets the bus */
+        if(spi_sim_wait() < 0)
+        {
+            break;
+        }
+
+        if((rv = spi_driver_read(&sampler, ( char * )samples, sizeof(samples), NULL)) < 0)
+        {
+            continue;
+        }
+
+        for(size_t i = 0; i < rv / sizeof(samples[0]); i++, expected++)
+        {
+            if(samples[i].sequence != expected ||
+               samples[i].data[0] != spi_sim_bmp280_reg(0, BMP280_REG_CALIB))
+            {
+                errors++;
+            }
+
+            if(expected > 0)
+            {
+                late = max(late, samples[i].timestamp_ns - prev - period);
+            }
+            prev = samples[i].timestamp_ns;
+        }
+    }
+
+    spi_driver_close(inode, &reader);
+    spi_driver_close(inode, &sampler);
+
+    printf("share %5u Hz + %3zu byte reads | %5.2f reads per sample | sample late %6.1f us | "
+           "read max %6.1f us\n",
+           rate_hz,
+           length + 1,
+           ( double )reads / BENCH_SAMPLES,
+           late / 1000.0,
+           read_max / 1000.0);
+
+    return errors + BENCH_SAMPLES - expected;
+}
+
+
+/**
+ * @brief Sample every BMP280 at the same rate, each one through its own minor. Each sensor gets
+ * a different ctrl_meas first, so a sample read through the wrong chip select is caught
+ *
+ * @param rate_hz Samples per second of each sensor
+ * @return int Number of wrong or missing samples
+ */
+static int _bench_sensors(uint32_t rate_hz)
+{
+    static const uint8_t ctrl_meas[SPI_SIM_SLAVES] = { 0x27, 0x57 };
+    struct spi_td3_sampling cfg = { rate_hz, 1, BMP280_REG_CTRL_MEAS | BMP280_READ, 1 };
+    struct spi_td3_sample samples[SPI_TD3_FIFO_SAMPLES];
+    struct inode inodes[SPI_SIM_SLAVES + 1];
+    struct file files[SPI_SIM_SLAVES + 1];
+    int64_t period = NSEC_PER_SEC / rate_hz, late = 0, prev[SPI_SIM_SLAVES];
+    uint32_t expected[SPI_SIM_SLAVES] = { 0 };
+    spi_sim_stats_t before, after;
+    unsigned int done = 0;
+    int errors = 0;
+    char config[2];
+    ssize_t rv;
+
+    memset(files, 0, sizeof(files));
+
+    for(unsigned int s = 0; s <= SPI_SIM_SLAVES; s++)
+    {
+        inodes[s].i_rdev = MKDEV(MAJOR(spi_driver_dev), MINOR(spi_driver_dev) + s);
+    }
+
+    /* One minor per slave node, no more */
+    if(spi_driver_open(&inodes[SPI_SIM_SLAVES], &files[SPI_SIM_SLAVES]) != -ENODEV)
+    {
+        errors++;
+    }
+
+    for(unsigned int s = 0; s < SPI_SIM_SLAVES; s++)
+    {
+        config[0] = BMP280_REG_CTRL_MEAS & ~BMP280_READ;
+        config[1] = ctrl_meas[s];
+
+        if(spi_driver_open(&inodes[s], &files[s]) != 0 ||
+           spi_driver_write(&files[s], config, sizeof(config), NULL) != sizeof(config) ||
+           spi_driver_ioctl(&files[s], SPI_TD3_IOC_SAMPLING, ( unsigned long )&cfg) != 0)
+        {
+            return SPI_SIM_SLAVES * BENCH_SAMPLES;
+        }
+
+        files[s].f_flags = O_NONBLOCK;
+    }
+
+    spi_sim_stats(&before);
+
+    while(done < SPI_SIM_SLAVES && spi_sim_wait() == 0)
+    {
+        done = 0;
+
+        for(unsigned int s = 0; s < SPI_SIM_SLAVES; s++)
+        {
+            rv = spi_driver_read(&files[s], ( char * )samples, sizeof(samples), NULL);
+
+            for(ssize_t i = 0; i < rv / ( ssize_t )sizeof(samples[0]); i++, expected[s]++)
+            {
+                if(samples[i].sequence != expected[s] || samples[i].data[0] != ctrl_meas[s])
+                {
+                    errors++;
+                }
+
+                if(expected[s] > 0)
+                {
+                    late = max(late, samples[i].timestamp_ns - prev[s] - period);
+                }
+                prev[s] = samples[i].timestamp_ns;
+            }
+
+            done += expected[s] >= BENCH_SAMPLES;
+        }
+    }
+
+    spi_sim_stats(&after);
+
+    for(unsigned int s = 0; s < SPI_SIM_SLAVES; s++)
+    {
+        spi_driver_close(&inodes[s], &files[s]);
+        errors += expected[s] < BENCH_SAMPLES ? BENCH_SAMPLES - expected[s] : 0;
+    }
+
+    printf("%u CS  %5u Hz each       | %4.2f wakeups | %6.1f reg wr | sample late %6.1f us\n",
+           SPI_SIM_SLAVES,
+           rate_hz,
+           ( double )(after.wakeups - before.wakeups) / (expected[0] + expected[1]),
+           ( double )(after.reg_writes - before.reg_writes) / (expected[0] + expected[1]),
+           late / 1000.0);
+
+    return errors;
+}
+
+
+/**
+ * @brief Change the bus configuration of the first chip select: SCLK through sysfs, word length
+ * and mode through the ioctl. The default configuration is restored at the end
+ *
+ * @param filp Open device
+ * @return int Number of errors
+ */
+static int _bench_config(struct file *filp)
+{
+    struct spi_td3_config saved, cfg;
+    struct spi_td3_segment msg[2];
+    spi_sim_stats_t before, after;
+    uint8_t data[8];
+    char name[16], page[PAGE_SIZE];
+    int errors = 0;
+
+    if(spi_driver_ioctl(filp, SPI_TD3_IOC_RD_CONFIG, ( unsigned long )&saved) != 0)
+    {
+        return 1;
+    }
+
+    /* The divider rounds 10 MHz down to 48 MHz / 5 */
+    snprintf(page, sizeof(page), "%u\n", BMP280_SPEED_MAX);
+    dev_attr_speed_hz.store(dev.ch[0].device, &dev_attr_speed_hz, page, strlen(page));
+    dev_attr_speed_hz.show(dev.ch[0].device, &dev_attr_speed_hz, page);
+    spi_driver_ioctl(filp, SPI_TD3_IOC_RD_CONFIG, ( unsigned long )&cfg);
+    errors += cfg.speed_hz != SPI_TD3_SPEED_MAX / 5 || ( unsigned int )atoi(page) != cfg.speed_hz;
+
+    printf("\nPer transaction, SCLK %u Hz\n", cfg.speed_hz);
+
+    errors += _bench(filp, "read", _read_regs, BMP280_REG_TEMP, 3);
+    errors += _bench(filp, "read", _read_regs, BMP280_REG_CALIB, 24);
+    errors += _bench(filp, "message", _message_regs, BMP280_REG_CALIB, 24);
+
+    /* Fewer FIFO words for the same bytes */
+    for(unsigned int bits = 16; bits <= 32; bits *= 2)
+    {
+        cfg.bits_per_word = bits;
+        errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&cfg) != 0;
+        word_bytes = bits / 8;
+
+        snprintf(name, sizeof(name), "read/%u", bits);
+        errors += _bench(filp, name, _read_regs, BMP280_REG_CALIB, 23);
+        errors += _bench(filp, name, _read_regs, BMP280_REG_CALIB, 63);
+    }
+
+    /* A transfer must hold whole words, a message is rejected before its first segment runs */
+    errors += _read_regs(filp, BMP280_REG_CALIB, data, 4);
+    memset(msg, 0, sizeof(msg));
+    msg[0].rx_buf = msg[1].rx_buf = ( uintptr_t )data;
+    msg[0].len = 4;
+    msg[1].len = 3;
+    spi_sim_stats(&before);
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_MESSAGE(2), ( unsigned long )msg) != -EINVAL;
+    spi_sim_stats(&after);
+    errors += after.words != before.words;
+    word_bytes = 1;
+
+    /* The BMP280 does not follow mode 1, MISO stays high */
+    cfg.bits_per_word = 8;
+    cfg.mode = SPI_TD3_CPHA;
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&cfg) != 0;
+    errors += !_read_regs(filp, BMP280_REG_CALIB, data, 2) || data[0] != 0xFF || data[1] != 0xFF;
+
+    cfg.mode = SPI_TD3_MODE_0;
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&cfg) != 0;
+    errors += !_read_regs(filp, BMP280_REG_CALIB, data, 2) ||
+              data[0] != spi_sim_bmp280_reg(0, BMP280_REG_CALIB);
+
+    /* Invalid configurations leave the current one */
+    cfg.bits_per_word = 12;
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&cfg) != -EINVAL;
+    cfg.bits_per_word = 8;
+    cfg.cs_hold_ns = SPI_TD3_CS_DELAY_MAX + 1;
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&cfg) != -EINVAL;
+    errors += dev_attr_mode.store(dev.ch[0].device, &dev_attr_mode, "4", 1) != -EINVAL;
+    errors += dev_attr_speed_hz.store(dev.ch[0].device, &dev_attr_speed_hz, "0", 1) != -EINVAL;
+
+    /* CS held 1 us around the transfer and released 1 us before the next one */
+    cfg.cs_setup_ns = cfg.cs_hold_ns = cfg.cs_inactive_ns = 1000;
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&cfg) != 0;
+    errors += _bench(filp, "cs+3us", _read_regs, BMP280_REG_TEMP, 3);
+
+    errors += spi_driver_ioctl(filp, SPI_TD3_IOC_WR_CONFIG, ( unsigned long )&saved) != 0;
+
+    return errors;
+}
+
+
+/**
+ * @brief Count the allocations of a transaction, and of a sampler that opens the device for each
+ * sample
+ *
+ * @param inode Device inode
+ * @param filp Open device
+ * @return int Number of errors
+ */
+static int _bench_allocs(struct inode *inode, struct file *filp)
+{
+    uint8_t data[3];
+    spi_sim_stats_t before, middle, after;
+    struct file once;
+    int errors = 0;
+
+    spi_sim_stats(&before);
+
+    for(int i = 0; i < BENCH_TRANSACTIONS; i++)
+    {
+        errors += !_read_regs(filp, BMP280_REG_TEMP, data, sizeof(data));
+        errors += !_message_regs(filp, BMP280_REG_TEMP, data, sizeof(data));
+    }
+
+    spi_sim_stats(&middle);
+
+    for(int i = 0; i < BENCH_TRANSACTIONS; i++)
+    {
+        memset(&once, 0, sizeof(once));
+        errors += spi_driver_open(inode, &once) != 0;
+        errors += !_read_regs(&once, BMP280_REG_TEMP, data, sizeof(data));
+        spi_driver_close(inode, &once);
+    }
+
+    spi_sim_stats(&after);
+
+    printf("allocs  %4.2f per read or message | %4.2f per open, read and close\n",
+           ( double )(middle.allocs - before.allocs) / (2 * BENCH_TRANSACTIONS),
+           ( double )(after.allocs - middle.allocs) / BENCH_TRANSACTIONS);
+
+    return errors + (middle.allocs != before.allocs);
+}
+
+
+/**
+ * @brief Stall the shift register in the middle of a read. The read must fail by its deadline,
+ * and the next one must find the controller reset and CS released
+ *
+ * @param filp Open device
+ * @param reg First register to read
+ * @param length Registers to read
+ * @return int Number of errors
+ */
+static int _bench_stall(struct file *filp, uint8_t reg, size_t length)
+{
+    uint8_t data[BENCH_MAX_BYTES];
+    s64 timeouts = atomic64_read(&dev.stats.counters[SPI_CNT_TIMEOUTS]);
+    uint64_t start = spi_sim_now();
+    int errors = 0;
+
+    spi_sim_stall();
+    errors += _read_regs(filp, reg, data, length);
+
+    printf("stalled read %5zu bytes | failed after %7.1f us | ",
+           length + 1,
+           ( double )(spi_sim_now() - start) / 1000);
+
+    errors += atomic64_read(&dev.stats.counters[SPI_CNT_TIMEOUTS]) != timeouts + 1;
+    errors += !_read_regs(filp, reg, data, length) || data[0] != spi_sim_bmp280_reg(0, reg);
+
+    printf("%s\n", errors == 0 ? "next read ok" : "next read failed");
+
+    return errors;
+}
+
+
+/**
+ * @brief Print and clear the stats file of debugfs
+ *
+ * @return int Number of errors, the model never raises a spurious IRQ nor stalls
+ */
+static int _print_debug_stats(void)
+{
+    char page[PAGE_SIZE];
+    struct seq_file m = { page, sizeof(page), 0 };
+    int errors = atomic64_read(&dev.stats.counters[SPI_CNT_SPURIOUS]) != 0 ||
+                 atomic64_read(&dev.stats.counters[SPI_CNT_TIMEOUTS]) != 0;
+
+    page[0] = '\0';
+    spi_driver_stats_show(&m, NULL);
+    spi_driver_stats_write(NULL, "0", 1, NULL);
+
+    printf("%s", page);
+    return errors;
+}
+
+
+/**
+ * @brief Print and clear the xfer_stats attribute of a chip select
+ *
+ * @param minor Minor of the chip select
+ */
+static void _print_xfer_stats(unsigned int minor)
+{
+    char page[PAGE_SIZE];
+
+    dev_attr_xfer_stats.show(dev.ch[minor].device, &dev_attr_xfer_stats, page);
+    dev_attr_xfer_stats.store(dev.ch[minor].device, &dev_attr_xfer_stats, "0", 1);
+
+    printf("%s", page);
+}
+
+
+/**
+ * @brief Main function
+ *
+ * @return int Return value
+ */
+int main(void)
+{
+    struct inode inode = { 0 };
+    struct file filp = { 0 };
+    int errors = 0;
+
+    if(spi_sim_module_init() != 0)
+    {
+        fprintf(stderr, "module init failed\n");
+        return EXIT_FAILURE;
+    }
+
+    if(spi_driver_open(&inode, &filp) != 0)
+    {
+        fprintf(stderr, "open failed\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("Per transaction, SCLK %d Hz, polled up to %u bytes, packed from %u bytes\n",
+           SPI_SIM_FCLK >> 7,
+           poll_bytes,
+           pack_bytes);
+
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_TEMP, 3);     /* Temperature */
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_TEMP - 3, 6); /* Pressure, temperature */
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, 24);   /* Calibration */
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, 31);   /* A full FIFO */
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, 63);
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, 119);
+    errors += _bench(&filp, "message", _message_regs, BMP280_REG_TEMP, 3);
+    errors += _bench(&filp, "message", _message_regs, BMP280_REG_CALIB, 24);
+    errors += _bench_allocs(&inode, &filp);
+
+    printf("\nPer transaction, 8 bit words only\n");
+
+    pack_bytes = 0;
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_TEMP - 3, 6);
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, 24);
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, 119);
+    errors += _bench(&filp, "message", _message_regs, BMP280_REG_CALIB, 24);
+    pack_bytes = MCSPI_PACK_BYTES_DEFAULT;
+
+    printf("\nPer transaction, chunks of %lu bytes under one CS\n",
+           ( unsigned long )SPI_DRIVER_BUFF_SIZE);
+
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, SPI_DRIVER_BUFF_SIZE - 1);
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, SPI_DRIVER_BUFF_SIZE);
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_CALIB, BENCH_MAX_BYTES - 1);
+    errors += _bench(&filp, "message", _message_regs, BMP280_REG_CALIB, BENCH_MAX_BYTES - 1);
+
+    printf("\nPer transaction, interrupts only\n");
+
+    poll_bytes = 0;
+    errors += _bench(&filp, "read", _read_regs, BMP280_REG_TEMP, 3);
+    errors += _bench(&filp, "message", _message_regs, BMP280_REG_TEMP, 3);
+    poll_bytes = MCSPI_POLL_BYTES_DEFAULT;
+
+    errors += _bench_config(&filp);
+
+    printf("\nLatency per mode, /sys/class/%s/%s/xfer_stats\n",
+           SPI_DRIVER_CLASS,
+           SPI_DRIVER_NAME_SHORT);
+    _print_xfer_stats(0);
+
+    printf("\nPer sample, driver sampling\n");
+
+    errors += _bench_sampling(&filp, 1, 1, false);
+    errors += _bench_sampling(&filp, 1000, 1, false);
+    errors += _bench_sampling(&filp, 1000, 32, false);
+    errors += _bench_sampling(&filp, SPI_TD3_RATE_MAX, 64, false);
+    errors += _bench_sampling(&filp, 1000, 1, true);
+    errors += _bench_sampling(&filp, 1000, 32, true);
+    errors += _bench_ring(&filp, 1000);
+    errors += _bench_shared(&inode, 1000, 24);
+
+    printf("\nPer sample, one BMP280 per chip select\n");
+
+    errors += _bench_sensors(1000);
+    errors += _bench_sensors(SPI_TD3_RATE_MAX);
+
+    printf("\nController, /sys/kernel/debug/%s/stats\n", SPI_DRIVER_NAME_SHORT);
+    errors += _print_debug_stats();
+
+    printf("\nStalled controller, reset and recovered\n");
+
+    errors += _bench_stall(&filp, BMP280_REG_TEMP, 3);    /* Polled */
+    errors += _bench_stall(&filp, BMP280_REG_CALIB, 24);  /* Sleeping */
+    spi_driver_stats_write(NULL, "0", 1, NULL);
+
+    spi_driver_close(&inode, &filp);
+    spi_sim_module_exit();
+
+    if(errors != 0)
+    {
+        printf("%d transactions returned wrong data\n", errors);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,204 @@
+/**
+ * @file dat2ts.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Import a legacy data.dat text file into the binary time series store
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Usage: dat2ts <data.dat> [store] [YYYY-MM-DD]
+ *
+ * data.dat only keeps HH:MM:SS, so every time of day going backwards is taken as a new day. The
+ * first line is placed on the given date, or if none is given the last line is placed at or
+ * before the modification time of the file. Samples not newer than the store are skipped.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/stat.h>
+#include <time.h>
+
+#include "../../inc/ts_store.h"
+
+
+/** Parsed line */
+typedef struct
+{
+    int day;         /* Days after the first line */
+    int hour, min, sec;
+    float value;
+} dat_line_t;
+
+
+/**
+ * @brief Seconds since midnight of a parsed line
+ *
+ * @param line Parsed line
+ * @return int Seconds of the day
+ */
+static int _second_of_day(const dat_line_t *line)
+{
+    return line->hour * 3600 + line->min * 60 + line->sec;
+}
+
+
+/**
+ * @brief Parse the whole file
+ *
+ * @param fp Input file
+ * @param count Number of lines parsed
+ * @return dat_line_t* Lines, must be freed by the caller
+ */
+static dat_line_t *_parse_dat(FILE *fp, size_t *count)
+{
+    dat_line_t *lines = NULL, *tmp;
+    size_t capacity = 0;
+    char str[64];
+    int day = 0, prev_sod = -1;
+
+    *count = 0;
+
+    while(fgets(str, sizeof(str), fp) != NULL)
+    {
+        dat_line_t line;
+
+        if(sscanf(str, "%d:%d:%d %f", &line.hour, &line.min, &line.sec, &line.value) != 4)
+        {
+            continue;
+        }
+
+        if(_second_of_day(&line) < prev_sod)
+        {
+            day++; /* Crossed midnight */
+        }
+        prev_sod = _second_of_day(&line);
+        line.day = day;
+
+        if(*count == capacity)
+        {
+            capacity = capacity ? 2 * capacity : 1024;
+            if((tmp = realloc(lines, capacity * sizeof(dat_line_t))) == NULL)
+            {
+                perror("realloc error");
+                free(lines);
+                return NULL;
+            }
+            lines = tmp;
+        }
+
+        lines[(*count)++] = line;
+    }
+
+    return lines;
+}
+
+
+/**
+ * @brief Main function
+ *
+ * @param argc Argument count
+ * @param argv Input file, store and optional date of the first line
+ * @return int Return value
+ */
+int main(int argc, char *argv[])
+{
+    const char *store_path = argc > 2 ? argv[2] : TS_STORE_PATH;
+    struct stat filestat;
+    struct tm base = { 0 }, timeinfo;
+    ts_record_t record = { 0 };
+    ts_store_t store;
+    const ts_record_t *latest;
+    int64_t last_stored = INT64_MIN;
+    dat_line_t *lines;
+    size_t count, imported = 0;
+    FILE *fp;
+
+    if(argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <data.dat> [store] [YYYY-MM-DD]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if((fp = fopen(argv[1], "r")) == NULL || fstat(fileno(fp), &filestat) == ERROR)
+    {
+        perror("open error");
+        return EXIT_FAILURE;
+    }
+
+    lines = _parse_dat(fp, &count);
+    fclose(fp);
+
+    if(lines == NULL || count == 0)
+    {
+        fprintf(stderr, "No samples in %s\n", argv[1]);
+        free(lines);
+        return EXIT_FAILURE;
+    }
+
+    /* Midnight of the day of the first line */
+    if(argc > 3)
+    {
+        if(sscanf(argv[3], "%d-%d-%d", &base.tm_year, &base.tm_mon, &base.tm_mday) != 3)
+        {
+            fprintf(stderr, "Invalid date %s\n", argv[3]);
+            free(lines);
+            return EXIT_FAILURE;
+        }
+        base.tm_year -= 1900;
+        base.tm_mon -= 1;
+    }
+    else
+    {
+        localtime_r(&filestat.st_mtime, &base);
+        if(_second_of_day(&lines[count - 1]) >
+           base.tm_hour * 3600 + base.tm_min * 60 + base.tm_sec)
+        {
+            base.tm_mday--; /* Last line was written the day before */
+        }
+        base.tm_mday -= lines[count - 1].day;
+        base.tm_hour = base.tm_min = base.tm_sec = 0;
+    }
+
+    if(ts_store_open(&store, store_path, sizeof(ts_record_t), true) == ERROR)
+    {
+        free(lines);
+        return EXIT_FAILURE;
+    }
+
+    /* Importing the same file twice must not duplicate samples */
+    if((latest = ts_store_latest(&store)) != NULL)
+    {
+        last_stored = latest->timestamp;
+    }
+
+    for(size_t i = 0; i < count; i++)
+    {
+        timeinfo = base;
+        timeinfo.tm_mday += lines[i].day;
+        timeinfo.tm_hour = lines[i].hour;
+        timeinfo.tm_min = lines[i].min;
+        timeinfo.tm_sec = lines[i].sec;
+        timeinfo.tm_isdst = -1;
+
+        record.timestamp = ( int64_t )mktime(&timeinfo) * 1000;
+        record.value = lines[i].value;
+
+        if(record.timestamp > last_stored && ts_store_append(&store, &record) == EXIT_SUCCESS)
+        {
+            imported++;
+        }
+    }
+
+    printf("Imported %zu of %zu samples into %s, %llu records stored\n",
+           imported,
+           count,
+           store_path,
+           ( unsigned long long )ts_store_count(&store));
+
+    ts_store_close(&store);
+    free(lines);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,124 @@
+/**
+ * @file spi_td3_ring.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Print the samples of the ring mapped from /dev/spi_td3
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Usage: spi_td3_ring [-f] [device]
+ *
+ * Prints the samples the driver wrote since the last consumer stopped, and with -f keeps
+ * printing the new ones. The samples are read straight from the mapping, no syscall is made on
+ * the device after mmap.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/mman.h>
+#include <time.h>
+
+#include "../../inc/common_inc.h"
+#include "../../inc/spi_td3_ioctl.h"
+
+
+#define RING_POLL_MS 100 /* Follow mode */
+
+
+/**
+ * @brief Print samples
+ *
+ * @param samples Samples
+ * @param count Number of samples
+ */
+static void _print_samples(const struct spi_td3_sample *samples, unsigned int count)
+{
+    for(unsigned int i = 0; i < count; i++)
+    {
+        printf("%lld.%09lld %10u ",
+               ( long long )samples[i].timestamp_ns / 1000000000,
+               ( long long )samples[i].timestamp_ns % 1000000000,
+               samples[i].sequence);
+
+        for(unsigned int j = 0; j < samples[i].len && j < SPI_TD3_SAMPLE_MAX; j++)
+        {
+            printf(" %02x", samples[i].data[j]);
+        }
+
+        printf("\n");
+    }
+}
+
+
+/**
+ * @brief Main function
+ *
+ * @param argc Argument count
+ * @param argv Options and device
+ * @return int Return value
+ */
+int main(int argc, char *argv[])
+{
+    const char *dev_path = "/dev/spi_td3";
+    struct timespec poll_time = { 0, RING_POLL_MS * 1000000L };
+    struct spi_td3_sample samples[64];
+    struct spi_td3_ring_header *ring;
+    bool follow = false;
+    unsigned int count;
+    int fd;
+
+    for(int i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-f") == 0)
+        {
+            follow = true;
+        }
+        else
+        {
+            dev_path = argv[i];
+        }
+    }
+
+    if((fd = open(dev_path, O_RDWR)) == ERROR)
+    {
+        perror("open error");
+        return EXIT_FAILURE;
+    }
+
+    ring = mmap(NULL, SPI_TD3_RING_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd); /* The mapping stays */
+
+    if(ring == MAP_FAILED)
+    {
+        perror("mmap error");
+        return EXIT_FAILURE;
+    }
+
+    if(ring->magic != SPI_TD3_RING_MAGIC || ring->version != SPI_TD3_RING_VERSION ||
+       ring->sample_size != sizeof(struct spi_td3_sample))
+    {
+        fprintf(stderr, "Unknown ring in %s\n", dev_path);
+        munmap(ring, SPI_TD3_RING_SIZE);
+        return EXIT_FAILURE;
+    }
+
+    do
+    {
+        while((count = spi_td3_ring_consume(ring, samples, 64)) > 0)
+        {
+            _print_samples(samples, count);
+        }
+
+        fflush(stdout);
+    } while(follow && nanosleep(&poll_time, NULL) == 0);
+
+    fprintf(stderr, "%llu samples written, %llu overwritten before being read\n",
+            ( unsigned long long )ring->head,
+            ( unsigned long long )ring->overruns);
+
+    munmap(ring, SPI_TD3_RING_SIZE);
+
+    return EXIT_SUCCESS;
+}
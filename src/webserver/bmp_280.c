@@ -10,72 +10,88 @@
  */
 
 #include "../../inc/bmp_280.h"
+#include <sys/ioctl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+/* Calibration of the samples taken by the driver */
+static bmp280_calib_t sampling_calib = { .dig_T1 = 27641, .dig_T2 = 25684, .dig_T3 = 50 };
+
 /**
- * @brief Read bytes from dev
+ * @brief Read a block of registers in a single round trip: the control byte and the data are
+ * two segments of one message, under the same CS
  *
  * @param fd File descriptor
- * @param data Data to read
- * @param length Length of data
- * @return size_t Return Value
+ * @param reg First register
+ * @param data Register values
+ * @param length Number of registers
+ * @return ssize_t Bytes transferred, ERROR on failure
  */
-static size_t _bmp280_read_bytes(int fd, unsigned char *data, char length)
+static ssize_t _bmp280_read_bytes(int fd, uint8_t reg, uint8_t *data, size_t length)
 {
-    char *buf = malloc(length + 1);
-    char bytes_read;
+    struct spi_td3_segment msg[2];
+    uint8_t control = reg | MASK_READ;
 
-    buf[0] = data[0] | MASK_READ;
+    memset(msg, 0, sizeof(msg));
 
-    for(size_t i = 0; i < length; i++)
-    {
-        buf[i] = buf[i - 1] + 1;
-        buf[i] |= MASK_READ;
-    }
+    msg[0].tx_buf = ( uintptr_t )&control;
+    msg[0].len = 1;
+    msg[0].keep_cs = 1;
 
-    bytes_read = read(fd, buf, length + 1);
-    memcpy(data, buf + 1, length);
+    msg[1].rx_buf = ( uintptr_t )data;
+    msg[1].len = length;
 
-    return bytes_read;
+    return ioctl(fd, SPI_TD3_IOC_MESSAGE(2), msg);
 }
 
 
 /**
- * @brief Write bytes to dev
+ * @brief Write a register
  *
  * @param fd File descriptor
- * @param data Data to write
- * @param length Length of data
- * @return size_t Return Value
+ * @param reg Register
+ * @param value Value to write
+ * @return ssize_t Bytes transferred, ERROR on failure
  */
-static size_t _bmp280_write_bytes(const char *dev_path, unsigned char *data, char length)
+static ssize_t _bmp280_write_byte(int fd, uint8_t reg, uint8_t value)
 {
-    int fd = 0;
-    char *buf = malloc(length + 1);
-    char bytes_written = 0;
-    
-    if(fd < 0)
-    {
-        printf("open error %s\n", dev_path);
-        return EXIT_FAILURE;
-    }
+    struct spi_td3_segment msg;
+    uint8_t buf[2] = { reg & MASK_WRITE, value };
 
-    buf[0] = data[0] & MASK_WRITE;
+    memset(&msg, 0, sizeof(msg));
 
-    for(size_t i = 0; i < length; i++)
-    {
-        buf[i] = buf[i - 1] + 1;
-        buf[i] &= MASK_WRITE;
-    }
+    msg.tx_buf = ( uintptr_t )buf;
+    msg.len = sizeof(buf);
 
-    bytes_written = write(fd, buf, length + 1);
-    memcpy(data, buf + 1, length);
+    return ioctl(fd, SPI_TD3_IOC_MESSAGE(1), &msg);
+}
 
-    close(fd);
 
-    return bytes_written;
+/**
+ * @brief Read the temperature calibration block, once
+ *
+ * @param fd File descriptor
+ * @param calib Calibration data, left untouched on failure
+ */
+static void _read_bmp280_calib(int fd, bmp280_calib_t *calib)
+{
+    static bmp280_calib_t cached;
+    static bool valid = false;
+    uint8_t data[6];
+
+    if(!valid && _bmp280_read_bytes(fd, BMP280_REG_CALIB, data, sizeof(data)) == sizeof(data) + 1)
+    {
+        cached.dig_T1 = ( uint16_t )(data[0] | data[1] << 8);
+        cached.dig_T2 = ( int16_t )(data[2] | data[3] << 8);
+        cached.dig_T3 = ( int16_t )(data[4] | data[5] << 8);
+        valid = cached.dig_T1 != 0;
+    }
+
+    if(valid)
+    {
+        *calib = cached;
+    }
 }
 
 
@@ -83,39 +99,33 @@ static size_t _bmp280_write_bytes(const char *dev_path, unsigned char *data, cha
  * @brief Get raw temperature from device
  *
  * @param dev_path Device path in FS
- * @return float Raw Temp
+ * @param calib Calibration data
+ * @return int32_t Raw 20 bit ADC temperature, ERROR on failure
  */
-static float _read_bmp280_temp(const char *dev_path)
+static int32_t _read_bmp280_temp(const char *dev_path, bmp280_calib_t *calib)
 {
-    float raw_temp = 0;
+    int32_t raw_temp = ERROR;
     int fd = 0;
-    unsigned char data[3];
-    double value;
+    uint8_t data[3];
 
-    time_t t;
-    srand(( unsigned )time(&t));  // test
-
-    
     fd = open(dev_path, O_RDWR);
 
     if(fd < 0)
     {
         printf("open error %s\n", dev_path);
-        return EXIT_FAILURE;
+        return ERROR;
     }
 
-    data[0] = BMP280_REG_RESULT_TEMPRERATURE;
+    _read_bmp280_calib(fd, calib);
 
-    if(_bmp280_read_bytes(fd, data, 3))  // MSB 0xFA, LSB 0xFB, XLSB 0xFC
-    {
-        value = ( double )(int16_t)((( unsigned int )data[1] << 8) | ( unsigned int )data[0]);
-    }
-    else
+    // MSB 0xFA, LSB 0xFB, XLSB 0xFC
+    if(_bmp280_read_bytes(fd, BMP280_REG_RESULT_TEMPRERATURE, data, sizeof(data)) ==
+       sizeof(data) + 1)
     {
-        value = 0;
+        raw_temp = (( int32_t )data[0] << 12) | (( int32_t )data[1] << 4) | (data[2] >> 4);
     }
     close(fd);
-    
+
     return raw_temp;
 }
 
@@ -123,27 +133,26 @@ static float _read_bmp280_temp(const char *dev_path)
 /**
  * @brief Compensate raw temperature of bmp280 with calibration data from manufacturer
  *
- * @param raw_temp Uncompensated temperature
+ * @param raw_temp Uncompensated 20 bit temperature
+ * @param calib_data Calibration data
  * @return float Compensated temperature
  */
-static float _compensate_temperature(uint32_t raw_temp)
+static float _compensate_temperature(int32_t raw_temp, const bmp280_calib_t *calib_data)
 {
-    bmp280_calib_t calib_data = { .dig_T1 = 27641, .dig_T2 = 25684, .dig_T3 = 50 };
     int32_t var1, var2;
     int32_t t_fine;
     float T;
 
     int32_t adc_T = raw_temp;
-    adc_T >>= 4;
 
     var1 =
-      ((((adc_T >> 3) - (( int32_t )calib_data.dig_T1 << 1))) * (( int32_t )calib_data.dig_T2)) >>
+      ((((adc_T >> 3) - (( int32_t )calib_data->dig_T1 << 1))) * (( int32_t )calib_data->dig_T2)) >>
       11;
 
-    var2 = (((((adc_T >> 4) - (( int32_t )calib_data.dig_T1)) *
-              ((adc_T >> 4) - (( int32_t )calib_data.dig_T1))) >>
+    var2 = (((((adc_T >> 4) - (( int32_t )calib_data->dig_T1)) *
+              ((adc_T >> 4) - (( int32_t )calib_data->dig_T1))) >>
              12) *
-            (( int32_t )calib_data.dig_T3)) >>
+            (( int32_t )calib_data->dig_T3)) >>
            14;
 
     t_fine = var1 + var2;
@@ -157,36 +166,107 @@ static float _compensate_temperature(uint32_t raw_temp)
 /**
  * @brief Get the bmp280 temp in user friendly mode
  *
+ * @param raw_adc Raw ADC reading the temperature comes from, may be NULL
  * @return float Temperature
  */
-float get_bmp280_temp()
+float get_bmp280_temp(int32_t *raw_adc)
 {
     const char *dev_path = "/dev/spi_td3";
+    bmp280_calib_t calib = { .dig_T1 = 27641, .dig_T2 = 25684, .dig_T3 = 50 };
 
-    float raw_temp;
+    int32_t raw_temp;
     float comp_temp;
 
-    raw_temp = _read_bmp280_temp(dev_path);
+    raw_temp = _read_bmp280_temp(dev_path, &calib);
     if(raw_temp < 0)
     {
         raw_temp = 0;
     }
-    comp_temp = _compensate_temperature(raw_temp);
+    comp_temp = _compensate_temperature(raw_temp, &calib);
+
+    if(raw_adc != NULL)
+    {
+        *raw_adc = raw_temp;
+    }
 
     return comp_temp;
 }
 
 
+/**
+ * @brief Open the device and let the driver sample the temperature registers periodically
+ *
+ * @param rate_hz Samples per second
+ * @param batch Samples each read waits for
+ * @return int File descriptor to read struct spi_td3_sample from, ERROR on failure
+ */
+int bmp280_start_sampling(uint32_t rate_hz, uint16_t batch)
+{
+    const char *dev_path = "/dev/spi_td3";
+    struct spi_td3_sampling cfg = { 0 };
+    int fd;
+
+    if((fd = open(dev_path, O_RDWR)) < 0)
+    {
+        printf("open error %s\n", dev_path);
+        return ERROR;
+    }
+
+    _read_bmp280_calib(fd, &sampling_calib);
+
+    cfg.rate_hz = rate_hz;
+    cfg.batch = batch;
+    cfg.command = BMP280_REG_RESULT_TEMPRERATURE | MASK_READ;
+    cfg.len = 3;
+
+    if(ioctl(fd, SPI_TD3_IOC_SAMPLING, &cfg) == ERROR)
+    {
+        perror("SPI_TD3_IOC_SAMPLING error");
+        close(fd);
+        return ERROR;
+    }
+
+    return fd;
+}
+
+
+/**
+ * @brief Get the temperature of a sample taken by the driver
+ *
+ * @param sample Sample read from the device
+ * @param raw_adc Raw ADC reading the temperature comes from, may be NULL
+ * @return float Temperature
+ */
+float bmp280_sample_temp(const struct spi_td3_sample *sample, int32_t *raw_adc)
+{
+    int32_t raw_temp;
+
+    raw_temp = (( int32_t )sample->data[0] << 12) | (( int32_t )sample->data[1] << 4) |
+               (sample->data[2] >> 4);
+
+    if(raw_adc != NULL)
+    {
+        *raw_adc = raw_temp;
+    }
+
+    return _compensate_temperature(raw_temp, &sampling_calib);
+}
+
+
 ssize_t set_bmp280_control_reg(uint32_t value)
 {
     const char *dev_path = "/dev/spi_td3";
-    uint32_t rv;
-    unsigned char data[2];
+    ssize_t rv;
+    int fd;
 
-    data[0] = BMP280_REG_CONTROL;
-    data[1] = value;
+    if((fd = open(dev_path, O_RDWR)) < 0)
+    {
+        printf("open error %s\n", dev_path);
+        return ERROR;
+    }
 
-    rv = _bmp280_write_bytes(dev_path, data, sizeof(data));
+    rv = _bmp280_write_byte(fd, BMP280_REG_CONTROL, value);
+    close(fd);
 
     return rv;
 }
\ No newline at end of file
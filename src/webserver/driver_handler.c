@@ -11,6 +11,8 @@
 
 #include "../../inc/driver_handler.h"
 #include "../../inc/bmp_280.h"
+#include <errno.h>
+#include <sys/epoll.h>
 #include <sys/time.h>
 
 
@@ -32,6 +34,138 @@ void msleep(unsigned int ms)
 }
 
 
+/**
+ * @brief Publish a sample to the ring and the latest sample slot
+ *
+ * @param ctx Process context
+ * @param latest Latest sample, raw already set
+ * @param value Temperature
+ * @param monotonic_ns CLOCK_MONOTONIC of the reading
+ * @param wall_time Epoch of the reading in milliseconds
+ */
+static void _publish_sample(ctx_t *ctx,
+                            latest_sample_t *latest,
+                            float value,
+                            int64_t monotonic_ns,
+                            int64_t wall_time)
+{
+    sample_t sample;
+
+    sample.value = value;
+    sample.timestamp = wall_time;
+
+    /* Never waits for the readers, they catch up from the ring */
+    sample_ring_publish(&ctx->shared_data_1->ring, &sample);
+
+    latest->value = value;
+    latest->timestamp = monotonic_ns;
+    latest->wall_time = wall_time;
+    latest->sequence++;
+    latest_sample_publish(&ctx->shared_data_1->latest, latest);
+}
+
+
+/**
+ * @brief Publish every sample queued in the driver
+ *
+ * @param ctx Process context
+ * @param fd Non blocking device
+ * @param latest Latest sample
+ * @return ssize_t Return value
+ */
+static ssize_t _read_driver_samples(ctx_t *ctx, int fd, latest_sample_t *latest)
+{
+    struct spi_td3_sample samples[DRIVER_SAMPLE_BATCH];
+    int64_t age_ms;
+    float value;
+    ssize_t rv;
+
+    while(1)
+    {
+        if((rv = read(fd, samples, sizeof(samples))) <= 0)
+        {
+            if(rv == ERROR && errno == EINTR)
+            {
+                continue;
+            }
+            if(rv == ERROR && errno == EAGAIN)
+            {
+                return EXIT_SUCCESS;
+            }
+            perror("driver sample read error");
+            return ERROR;
+        }
+
+        for(size_t i = 0; i < rv / sizeof(samples[0]); i++)
+        {
+            /* Driver timestamps are CLOCK_MONOTONIC, the ring keeps wall time */
+            age_ms = (latest_sample_monotonic_now() - samples[i].timestamp_ns) / 1000000;
+            value = bmp280_sample_temp(&samples[i], &latest->raw);
+
+            _publish_sample(
+              ctx, latest, value, samples[i].timestamp_ns, sample_time_now() - age_ms);
+        }
+    }
+}
+
+
+/**
+ * @brief Publish the samples the driver takes on its own timer. The device is polled, so a
+ * batch is published as soon as it is queued
+ *
+ * @param ctx Process context
+ * @param fd Device sampling the sensor
+ * @param latest Latest sample
+ */
+static void _drain_driver_samples(ctx_t *ctx, int fd, latest_sample_t *latest)
+{
+    struct epoll_event ev = { .events = EPOLLIN };
+    int epoll_fd, nbr_fds;
+
+    if(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == ERROR ||
+       (epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == ERROR)
+    {
+        perror("driver epoll error");
+        return;
+    }
+
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) == ERROR)
+    {
+        perror("driver epoll_ctl error");
+        close(epoll_fd);
+        return;
+    }
+
+    while(1)
+    {
+        nbr_fds = epoll_wait(epoll_fd, &ev, 1, DRIVER_SAMPLE_TIMEOUT_MS);
+
+        if(nbr_fds == ERROR)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("driver epoll_wait error");
+            break;
+        }
+
+        if(nbr_fds == 0)
+        {
+            TRACE_MID("No sample from the driver in %d ms\n", DRIVER_SAMPLE_TIMEOUT_MS);
+            continue;
+        }
+
+        if(_read_driver_samples(ctx, fd, latest) == ERROR)
+        {
+            break;
+        }
+    }
+
+    close(epoll_fd);
+}
+
+
 /**
  * @brief Procces that handles the spi hardware
  *
@@ -41,19 +175,24 @@ void child_driver_handler(ctx_t *ctx)
 {
     TRACE_MID("Child Driver Handler started with PID: %d\n", getpid());
 
-    float current_temp = 0;
+    latest_sample_t latest = { 0 };
     uint32_t control_reg_value = 0x02;
+    float value;
+    int fd;
 
     set_bmp280_control_reg(control_reg_value); /* Write in control register */
 
-    while(1)
+    /* The driver times the readings itself, the loop below is for drivers without sampling */
+    if((fd = bmp280_start_sampling(DRIVER_SAMPLE_RATE_HZ, DRIVER_SAMPLE_BATCH)) != ERROR)
     {
-        current_temp = get_bmp280_temp();
+        _drain_driver_samples(ctx, fd, &latest);
+        close(fd);
+    }
 
-        sem_take(SEM_MUTEX);
-        ctx->shared_data_1->current_temp = current_temp; /* Update the value in shared memory */
-        sem_give(SEM_MUTEX);
-        sem_give(SEM_FULL);
+    while(1)
+    {
+        value = get_bmp280_temp(&latest.raw);
+        _publish_sample(ctx, &latest, value, latest_sample_monotonic_now(), sample_time_now());
 
         msleep(1000);
     }
@@ -0,0 +1,482 @@
+/**
+ * @file event_loop.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Single thread epoll connection engine for the webserver
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "../../inc/event_loop.h"
+
+
+/** Total number of live connections */
+static uint32_t g_number_of_conns = 0;
+
+
+/**
+ * @brief Set the O_NONBLOCK flag on a file descriptor
+ *
+ * @param fd File descriptor
+ * @return ssize_t Return value
+ */
+static ssize_t _set_nonblocking(int fd)
+{
+    int flags = fcntl(fd, F_GETFL, 0);
+
+    if(flags == ERROR || fcntl(fd, F_SETFL, flags | O_NONBLOCK) == ERROR)
+    {
+        perror("fcntl error");
+        return ERROR;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Release a connection. Closing the socket also removes it from the epoll set, but events
+ * already returned by epoll_wait may still point to it, so the memory is freed after the batch
+ *
+ * @param conn Connection
+ */
+static void _conn_close(conn_t *conn)
+{
+    event_loop_t *loop = conn->loop;
+
+    close(conn->fd);
+    conn->state = CONN_CLOSED;
+    conn->next = loop->closed_head;
+    loop->closed_head = conn;
+    g_number_of_conns--;
+}
+
+
+/**
+ * @brief Free the connections closed in the last epoll batch
+ *
+ * @param loop Event loop
+ */
+static void _free_closed(event_loop_t *loop)
+{
+    conn_t *conn, *next;
+
+    for(conn = loop->closed_head; conn != NULL; conn = next)
+    {
+        next = conn->next;
+        free(conn->write_buf);
+        free(conn);
+    }
+
+    loop->closed_head = NULL;
+}
+
+
+/**
+ * @brief Accept every pending client, the listen socket is edge triggered
+ *
+ * @param loop Event loop
+ */
+static void _accept_clients(event_loop_t *loop)
+{
+    struct epoll_event ev;
+    conn_t *conn;
+    int sock_client;
+
+    while(1)
+    {
+        sock_client = accept4(loop->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+
+        if(sock_client == ERROR)
+        {
+            if(errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("accept error");
+            }
+            return;
+        }
+
+        if(g_number_of_conns >= loop->ctx->max_conn)
+        {
+            printf("Cannot accept more clients\n");
+            close(sock_client);
+            continue;
+        }
+
+        if((conn = calloc(1, sizeof(conn_t))) == NULL)
+        {
+            perror("calloc error");
+            close(sock_client);
+            continue;
+        }
+
+        conn->fd = sock_client;
+        conn->loop = loop;
+        conn->state = CONN_READING;
+
+        /* Register once for both directions, the edges drive the state machine */
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = conn;
+
+        if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, sock_client, &ev) == ERROR)
+        {
+            perror("epoll_ctl error");
+            close(sock_client);
+            free(conn);
+            continue;
+        }
+
+        g_number_of_conns++;
+        TRACE_MID("New client with socket_id: %d\n", sock_client);
+    }
+}
+
+
+/**
+ * @brief Flush as much of the response as the socket accepts
+ *
+ * @param conn Connection
+ */
+static void _conn_write(conn_t *conn)
+{
+    ssize_t nwrite;
+
+    while(conn->write_pos < conn->write_len)
+    {
+        nwrite = send(conn->fd,
+                      conn->write_buf + conn->write_pos,
+                      conn->write_len - conn->write_pos,
+                      MSG_NOSIGNAL);
+
+        if(nwrite == ERROR)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("send error");
+                conn->state = CONN_CLOSING;
+            }
+            return; /* Wait for the next EPOLLOUT edge */
+        }
+
+        conn->write_pos += nwrite;
+    }
+
+    conn->state = CONN_CLOSING; /* Response sent, Connection: Closed */
+}
+
+
+/**
+ * @brief Worker job, builds the response and hands the connection back to the event loop
+ *
+ * @param arg Connection
+ */
+static void _conn_process(void *arg)
+{
+    conn_t *conn = arg;
+    event_loop_t *loop = conn->loop;
+    uint64_t one = 1;
+
+    conn->write_buf = build_client_response(loop->ctx, conn->read_buf, &conn->write_len);
+
+    pthread_mutex_lock(&loop->done_lock);
+    conn->next = loop->done_head;
+    loop->done_head = conn;
+    pthread_mutex_unlock(&loop->done_lock);
+
+    if(write(loop->done_fd, &one, sizeof(one)) == ERROR)
+    {
+        perror("eventfd write error");
+    }
+}
+
+
+/**
+ * @brief Write the responses finished by the workers
+ *
+ * @param loop Event loop
+ */
+static void _drain_completions(event_loop_t *loop)
+{
+    uint64_t value;
+    conn_t *conn, *next;
+
+    if(read(loop->done_fd, &value, sizeof(value)) == ERROR && errno != EAGAIN)
+    {
+        perror("eventfd read error");
+    }
+
+    pthread_mutex_lock(&loop->done_lock);
+    conn = loop->done_head;
+    loop->done_head = NULL;
+    pthread_mutex_unlock(&loop->done_lock);
+
+    for(; conn != NULL; conn = next)
+    {
+        next = conn->next;
+
+        if(conn->write_buf == NULL)
+        {
+            _conn_close(conn);
+            continue;
+        }
+
+        conn->write_pos = 0;
+        conn->state = CONN_WRITING;
+
+        _conn_write(conn);
+
+        if(conn->state == CONN_CLOSING)
+        {
+            _conn_close(conn);
+        }
+    }
+}
+
+
+/**
+ * @brief Drain the socket and queue the request once the header is complete
+ *
+ * @param conn Connection
+ */
+static void _conn_read(conn_t *conn)
+{
+    ssize_t nread;
+    bool peer_closed = false;
+
+    while(conn->read_len < sizeof(conn->read_buf) - 1)
+    {
+        nread = read(conn->fd,
+                     conn->read_buf + conn->read_len,
+                     sizeof(conn->read_buf) - 1 - conn->read_len);
+
+        if(nread == 0)
+        {
+            peer_closed = true;
+            break;
+        }
+        if(nread == ERROR)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            if(errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                perror("rcv");
+                conn->state = CONN_CLOSING;
+                return;
+            }
+            break;
+        }
+
+        conn->read_len += nread;
+    }
+
+    conn->read_buf[conn->read_len] = '\0';
+
+    if(conn->read_len == 0)
+    {
+        if(peer_closed)
+        {
+            printf("Client ended connection\n");
+            conn->state = CONN_CLOSING;
+        }
+        return;
+    }
+
+    /* Wait for the whole header unless the peer is done or the buffer is full */
+    if(!strstr(conn->read_buf, "\r\n\r\n") && !strstr(conn->read_buf, "\n\n") && !peer_closed &&
+       conn->read_len < sizeof(conn->read_buf) - 1)
+    {
+        return;
+    }
+
+    conn->state = CONN_PROCESSING;
+
+    if(worker_pool_submit(&conn->loop->pool, &_conn_process, conn) == EXIT_SUCCESS)
+    {
+        return;
+    }
+
+    /* Queue full, shed the request instead of letting the latency grow */
+    TRACE_MID("Work queue full, rejecting socket_id: %d\n", conn->fd);
+
+    if((conn->write_buf = build_busy_response(&conn->write_len)) == NULL)
+    {
+        conn->state = CONN_CLOSING;
+        return;
+    }
+
+    conn->write_pos = 0;
+    conn->state = CONN_WRITING;
+
+    _conn_write(conn);
+}
+
+
+/**
+ * @brief Apply a config file reload to the connection engine
+ *
+ * @param loop Event loop
+ */
+static void _reload_config(event_loop_t *loop)
+{
+    ctx_t *ctx = loop->ctx;
+
+    reload_config(ctx);
+    worker_pool_resize(&loop->pool,
+                       ctx->workers < ctx->max_conn ? ctx->workers : ctx->max_conn,
+                       ctx->queue_depth);
+}
+
+
+/**
+ * @brief Run the connection engine. Owns accept, read, parse and write of every client, the
+ * responses are built by the worker pool
+ *
+ * @param ctx Process context
+ * @param listen_fd Listen socket
+ * @return ssize_t Return value, only returns on error
+ */
+ssize_t event_loop_run(ctx_t *ctx, int listen_fd)
+{
+    static event_loop_t loop_a;
+    event_loop_t *loop = &loop_a;
+    struct epoll_event ev, events[EVENT_LOOP_MAX_EVENTS];
+    int nbr_fds;
+    conn_t *conn;
+
+    loop->ctx = ctx;
+    loop->listen_fd = listen_fd;
+    loop->done_head = NULL;
+    loop->closed_head = NULL;
+    pthread_mutex_init(&loop->done_lock, NULL);
+
+    if(_set_nonblocking(listen_fd) == ERROR)
+    {
+        return ERROR;
+    }
+
+    if((loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == ERROR)
+    {
+        perror("epoll_create1 error");
+        return ERROR;
+    }
+
+    if((loop->done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == ERROR)
+    {
+        perror("eventfd error");
+        close(loop->epoll_fd);
+        return ERROR;
+    }
+
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; /* NULL identifies the listen socket */
+
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev) == ERROR)
+    {
+        perror("epoll_ctl error");
+        goto loop_error;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = loop; /* The loop itself identifies the completion eventfd */
+
+    if(epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->done_fd, &ev) == ERROR)
+    {
+        perror("epoll_ctl error");
+        goto loop_error;
+    }
+
+    if(worker_pool_init(&loop->pool,
+                        ctx->workers < ctx->max_conn ? ctx->workers : ctx->max_conn,
+                        ctx->queue_depth) == ERROR)
+    {
+        perror("worker_pool_init error");
+        goto loop_error;
+    }
+
+    while(1)
+    {
+        if(flag_sigusr1 == true)
+        {
+            _reload_config(loop);
+        }
+
+        nbr_fds = epoll_wait(loop->epoll_fd, events, EVENT_LOOP_MAX_EVENTS, EVENT_LOOP_TIMEOUT_MS);
+
+        if(nbr_fds == ERROR)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            perror("epoll_wait error");
+            goto loop_error;
+        }
+
+        for(int i = 0; i < nbr_fds; i++)
+        {
+            if(events[i].data.ptr == NULL)
+            {
+                _accept_clients(loop);
+                continue;
+            }
+
+            if(events[i].data.ptr == loop)
+            {
+                _drain_completions(loop);
+                continue;
+            }
+
+            conn = events[i].data.ptr;
+
+            if(conn->state == CONN_CLOSED)
+            {
+                continue; /* Closed earlier in this batch */
+            }
+
+            if(conn->state == CONN_PROCESSING)
+            {
+                continue; /* A worker owns it, errors show up when writing the response */
+            }
+
+            if(events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                conn->state = CONN_CLOSING;
+            }
+
+            if((events[i].events & (EPOLLIN | EPOLLRDHUP)) && conn->state == CONN_READING)
+            {
+                _conn_read(conn);
+            }
+
+            if((events[i].events & EPOLLOUT) && conn->state == CONN_WRITING)
+            {
+                _conn_write(conn);
+            }
+
+            if(conn->state == CONN_CLOSING)
+            {
+                _conn_close(conn);
+            }
+        }
+
+        _free_closed(loop);
+    }
+
+loop_error:
+    close(loop->done_fd);
+    close(loop->epoll_fd);
+    return ERROR;
+}
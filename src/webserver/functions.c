@@ -144,7 +144,7 @@ void update_ctx_from_file(ctx_t *ctx)
     else if(fdinfo[0].revents & (POLLIN) && rv > 0)
     {
         fdinfo[0].revents = 0;
-        nread = read(ctx->pipefd[READ], ctx->config_file, 2 * sizeof(ctx->config_file));
+        nread = read(ctx->pipefd[READ], ctx->config_file, sizeof(config_file_t));
 
         if(nread == ERROR)
         {
@@ -157,33 +157,13 @@ void update_ctx_from_file(ctx_t *ctx)
             ctx->max_conn = ctx->config_file->max_conn;
             ctx->read_interval = ctx->config_file->read_interval;
             ctx->samples = ctx->config_file->samples;
+            ctx->workers = ctx->config_file->workers;
+            ctx->queue_depth = ctx->config_file->queue_depth;
         }
     }
 }
 
 
-/**
- * @brief Get the current temp object from shared memory segment
- *
- * @param ctx Process context
- * @return float Current temperature
- */
-float get_current_temp(ctx_t *ctx)
-{
-    float current_temp;
-
-    /* Access critical data */
-    sem_take(SEM_FULL);
-    sem_take(SEM_MUTEX);
-    current_temp = ctx->shared_data_1->current_temp;
-    sem_give(SEM_MUTEX);
-
-    TRACE_LOW("Temperature readed: %f\n", current_temp);
-
-    return current_temp;
-}
-
-
 /* Shared mem pointer */
 void *shared_mem_1 = ( void * )0;
 void *shared_mem_2 = ( void * )0;
@@ -196,22 +176,12 @@ void *shared_mem_2 = ( void * )0;
  */
 ssize_t configure_shared_mem(void)
 {
-    key_t key, key2;
     int shm_id, shm_id_2;
 
-    /* Obtain shared memory key */
-    key = ftok("/dev/zero", 'Y');
-    key2 = ftok("/dev/zero", 'Z');
-
-    if(key == ( key_t )ERROR || key2 == ( key_t )ERROR)
-    {
-        perror("ftok error");
-        return ERROR;
-    }
-
-    /* Allocate shared memory segment */
-    shm_id = shmget(key, sizeof(shared_mem_t), 0666 | IPC_CREAT);
-    shm_id_2 = shmget(key2, sizeof(shared_mem_t), 0666 | IPC_CREAT);
+    /* Allocate private segments, the childs inherit the attachments on fork. A fixed key would
+     * pick up a stale segment with an old shared_mem_t layout */
+    shm_id = shmget(IPC_PRIVATE, sizeof(shared_mem_t), 0666 | IPC_CREAT);
+    shm_id_2 = shmget(IPC_PRIVATE, sizeof(shared_mem_t), 0666 | IPC_CREAT);
 
     if(shm_id == ERROR || shm_id_2 == ERROR)
     {
@@ -221,7 +191,7 @@ ssize_t configure_shared_mem(void)
 
     /* Assign shared memory */
     shared_mem_1 = shmat(shm_id, ( void * )0, 0);
-    shared_mem_2 = shmat(shm_id, ( void * )0, 0);
+    shared_mem_2 = shmat(shm_id_2, ( void * )0, 0);
 
     if(shared_mem_1 == ( char * )(-1) || shared_mem_2 == ( char * )(-1))
     {
@@ -229,6 +199,10 @@ ssize_t configure_shared_mem(void)
         return ERROR;
     }
 
+    /* Destroyed once the last process detaches */
+    shmctl(shm_id, IPC_RMID, NULL);
+    shmctl(shm_id_2, IPC_RMID, NULL);
+
     return EXIT_SUCCESS;
 }
 
@@ -308,6 +282,8 @@ ssize_t read_config_file(config_file_t *config_file, const char *file)
     [max_conn] = 1000
     [read_interval] = 1
     [samples] = 5
+    [workers] = 4
+    [queue_depth] = 64
     */
     const char *file_name = "./sup/file.cfg";
     FILE *fd_cfg;
@@ -354,6 +330,16 @@ ssize_t read_config_file(config_file_t *config_file, const char *file)
                 token = strtok(NULL, "=");
                 config_file->read_interval = ( int )strtol(token + 1, ( char ** )NULL, 10);
             }
+            if(strstr(token, "workers"))
+            {
+                token = strtok(NULL, "=");
+                config_file->workers = ( int )strtol(token + 1, ( char ** )NULL, 10);
+            }
+            if(strstr(token, "queue_depth"))
+            {
+                token = strtok(NULL, "=");
+                config_file->queue_depth = ( int )strtol(token + 1, ( char ** )NULL, 10);
+            }
             token = strtok(NULL, "=");
         }
     }
@@ -362,6 +348,8 @@ ssize_t read_config_file(config_file_t *config_file, const char *file)
     TRACE_LOW("Backlog: %d\n", config_file->backlog);
     TRACE_LOW("Max_conn: %d\n", config_file->max_conn);
     TRACE_LOW("Samples: %d\n", config_file->samples);
+    TRACE_LOW("Workers: %d\n", config_file->workers);
+    TRACE_LOW("Queue depth: %d\n", config_file->queue_depth);
     TRACE_LOW("Read interval: %f\n", config_file->read_interval);
 
     fclose(fd_cfg);
@@ -412,6 +400,8 @@ char *base64_encode(const unsigned char *data, size_t input_length, size_t *outp
     for(int i = 0; i < mod_table[input_length % 3]; i++)
         encoded_data[*output_length - 1 - i] = '=';
 
+    encoded_data[*output_length] = '\0';
+
     return encoded_data;
 }
 
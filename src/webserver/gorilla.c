@@ -0,0 +1,399 @@
+/**
+ * @file gorilla.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Gorilla style compression of (timestamp, float) samples
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Timestamps are stored as the delta of the delta to the previous one:
+ *   0                        dod == 0
+ *   10   + 7 bits            dod in [-64, 63]
+ *   110  + 9 bits            dod in [-256, 255]
+ *   1110 + 12 bits           dod in [-2048, 2047]
+ *   1111 + 64 bits           anything else
+ * Values are XORed with the previous one:
+ *   0                        same value
+ *   10 + meaningful bits     XOR fits in the previous leading/trailing zero window
+ *   11 + 5 bits leading zeros + 5 bits length - 1 + meaningful bits
+ * The first sample is stored whole. Bits are written MSB first.
+ *
+ */
+
+#include "../../inc/gorilla.h"
+
+
+#define GORILLA_INITIAL_CAPACITY 256
+#define GORILLA_NO_WINDOW 0xff
+
+
+/**
+ * @brief Append bits to the encoder output
+ *
+ * @param encoder Encoder
+ * @param value Bits, right aligned
+ * @param n Number of bits, up to 64
+ * @return ssize_t Return value
+ */
+static ssize_t _write_bits(gorilla_encoder_t *encoder, uint64_t value, unsigned n)
+{
+    size_t needed = (encoder->bits + n + 7) / 8;
+    uint8_t *tmp;
+
+    if(needed > encoder->capacity)
+    {
+        size_t capacity = encoder->capacity ? encoder->capacity : GORILLA_INITIAL_CAPACITY;
+
+        while(capacity < needed)
+        {
+            capacity *= 2;
+        }
+
+        if((tmp = realloc(encoder->data, capacity)) == NULL)
+        {
+            perror("realloc error");
+            return ERROR;
+        }
+
+        memset(tmp + encoder->capacity, 0, capacity - encoder->capacity);
+        encoder->data = tmp;
+        encoder->capacity = capacity;
+    }
+
+    while(n > 0)
+    {
+        unsigned free_bits = 8 - encoder->bits % 8;
+        unsigned take = n < free_bits ? n : free_bits;
+        uint8_t chunk = (value >> (n - take)) & ((1u << take) - 1);
+
+        encoder->data[encoder->bits / 8] |= chunk << (free_bits - take);
+        encoder->bits += take;
+        n -= take;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Read bits from the decoder input
+ *
+ * @param decoder Decoder
+ * @param n Number of bits, up to 64
+ * @param value Bits read, right aligned
+ * @return true Bits read
+ * @return false Not enough input left
+ */
+static bool _read_bits(gorilla_decoder_t *decoder, unsigned n, uint64_t *value)
+{
+    if(decoder->pos + n > decoder->size)
+    {
+        return false;
+    }
+
+    *value = 0;
+
+    while(n > 0)
+    {
+        unsigned avail = 8 - decoder->pos % 8;
+        unsigned take = n < avail ? n : avail;
+        uint8_t byte = decoder->data[decoder->pos / 8];
+
+        *value = (*value << take) | ((byte >> (avail - take)) & ((1u << take) - 1));
+        decoder->pos += take;
+        n -= take;
+    }
+
+    return true;
+}
+
+
+/**
+ * @brief Sign extend a two's complement field
+ *
+ * @param value Field
+ * @param n Field width
+ * @return int64_t Signed value
+ */
+static int64_t _sign_extend(uint64_t value, unsigned n)
+{
+    uint64_t sign = 1ULL << (n - 1);
+
+    return ( int64_t )((value ^ sign) - sign);
+}
+
+
+/**
+ * @brief Get the bits of a float
+ *
+ * @param value Float
+ * @return uint32_t Bits
+ */
+static uint32_t _float_bits(float value)
+{
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+
+/**
+ * @brief Initialise an empty encoder
+ *
+ * @param encoder Encoder
+ */
+void gorilla_encoder_init(gorilla_encoder_t *encoder)
+{
+    memset(encoder, 0, sizeof(gorilla_encoder_t));
+    encoder->prev_leading = GORILLA_NO_WINDOW;
+}
+
+
+/**
+ * @brief Release the encoder output
+ *
+ * @param encoder Encoder
+ */
+void gorilla_encoder_free(gorilla_encoder_t *encoder)
+{
+    free(encoder->data);
+    gorilla_encoder_init(encoder);
+}
+
+
+/**
+ * @brief Encode a sample. Timestamps are expected to grow by a near constant interval
+ *
+ * @param encoder Encoder
+ * @param timestamp Timestamp
+ * @param value Value
+ * @return ssize_t Return value
+ */
+ssize_t gorilla_encode(gorilla_encoder_t *encoder, int64_t timestamp, float value)
+{
+    uint32_t bits = _float_bits(value);
+    uint32_t xor = bits ^ encoder->prev_value;
+    int64_t delta, dod;
+    ssize_t ret = EXIT_SUCCESS;
+    unsigned leading, trailing;
+
+    if(encoder->count == 0)
+    {
+        ret |= _write_bits(encoder, ( uint64_t )timestamp, 64);
+        ret |= _write_bits(encoder, bits, 32);
+        goto encoded;
+    }
+
+    delta = timestamp - encoder->prev_timestamp;
+    dod = delta - encoder->prev_delta;
+    encoder->prev_delta = delta;
+
+    if(dod == 0)
+    {
+        ret |= _write_bits(encoder, 0x0, 1);
+    }
+    else if(dod >= -64 && dod <= 63)
+    {
+        ret |= _write_bits(encoder, 0x2, 2);
+        ret |= _write_bits(encoder, dod & 0x7f, 7);
+    }
+    else if(dod >= -256 && dod <= 255)
+    {
+        ret |= _write_bits(encoder, 0x6, 3);
+        ret |= _write_bits(encoder, dod & 0x1ff, 9);
+    }
+    else if(dod >= -2048 && dod <= 2047)
+    {
+        ret |= _write_bits(encoder, 0xe, 4);
+        ret |= _write_bits(encoder, dod & 0xfff, 12);
+    }
+    else
+    {
+        ret |= _write_bits(encoder, 0xf, 4);
+        ret |= _write_bits(encoder, ( uint64_t )dod, 64);
+    }
+
+    if(xor == 0)
+    {
+        ret |= _write_bits(encoder, 0x0, 1);
+        goto encoded;
+    }
+
+    leading = __builtin_clz(xor);
+    trailing = __builtin_ctz(xor);
+
+    if(encoder->prev_leading != GORILLA_NO_WINDOW && leading >= encoder->prev_leading &&
+       trailing >= encoder->prev_trailing)
+    {
+        ret |= _write_bits(encoder, 0x2, 2);
+        ret |= _write_bits(encoder,
+                           xor >> encoder->prev_trailing,
+                           32 - encoder->prev_leading - encoder->prev_trailing);
+    }
+    else
+    {
+        ret |= _write_bits(encoder, 0x3, 2);
+        ret |= _write_bits(encoder, leading, 5);
+        ret |= _write_bits(encoder, 32 - leading - trailing - 1, 5);
+        ret |= _write_bits(encoder, xor >> trailing, 32 - leading - trailing);
+        encoder->prev_leading = leading;
+        encoder->prev_trailing = trailing;
+    }
+
+encoded:
+    if(ret != EXIT_SUCCESS)
+    {
+        return ERROR;
+    }
+
+    encoder->prev_timestamp = timestamp;
+    encoder->prev_value = bits;
+    encoder->count++;
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Get the encoded size
+ *
+ * @param encoder Encoder
+ * @return size_t Bytes used by the encoded samples
+ */
+size_t gorilla_encoder_size(const gorilla_encoder_t *encoder)
+{
+    return (encoder->bits + 7) / 8;
+}
+
+
+/**
+ * @brief Start decoding a block
+ *
+ * @param decoder Decoder
+ * @param data Encoded block
+ * @param size Size of the block in bytes
+ * @param count Number of samples in the block
+ */
+void gorilla_decoder_init(gorilla_decoder_t *decoder,
+                          const uint8_t *data,
+                          size_t size,
+                          uint32_t count)
+{
+    memset(decoder, 0, sizeof(gorilla_decoder_t));
+    decoder->data = data;
+    decoder->size = ( uint64_t )size * 8;
+    decoder->remaining = count;
+    decoder->prev_leading = GORILLA_NO_WINDOW;
+}
+
+
+/**
+ * @brief Decode the next sample
+ *
+ * @param decoder Decoder
+ * @param timestamp Decoded timestamp
+ * @param value Decoded value
+ * @return true A sample was decoded
+ * @return false No samples left or the block is corrupt
+ */
+bool gorilla_decode(gorilla_decoder_t *decoder, int64_t *timestamp, float *value)
+{
+    uint64_t bits, field;
+    unsigned prefix = 0, leading, length;
+
+    if(decoder->remaining == 0)
+    {
+        return false;
+    }
+
+    if(decoder->decoded == 0)
+    {
+        if(!_read_bits(decoder, 64, &field) || !_read_bits(decoder, 32, &bits))
+        {
+            return false;
+        }
+        decoder->prev_timestamp = ( int64_t )field;
+        decoder->prev_value = bits;
+        goto decoded;
+    }
+
+    /* Count the leading ones of the timestamp prefix, up to four */
+    while(prefix < 4)
+    {
+        if(!_read_bits(decoder, 1, &bits))
+        {
+            return false;
+        }
+        if(bits == 0)
+        {
+            break;
+        }
+        prefix++;
+    }
+
+    if(prefix > 0)
+    {
+        static const unsigned widths[] = { 0, 7, 9, 12, 64 };
+
+        if(!_read_bits(decoder, widths[prefix], &field))
+        {
+            return false;
+        }
+        decoder->prev_delta += prefix == 4 ? ( int64_t )field : _sign_extend(field, widths[prefix]);
+    }
+    decoder->prev_timestamp += decoder->prev_delta;
+
+    if(!_read_bits(decoder, 1, &bits))
+    {
+        return false;
+    }
+
+    if(bits == 1)
+    {
+        if(!_read_bits(decoder, 1, &bits))
+        {
+            return false;
+        }
+
+        if(bits == 1)
+        {
+            if(!_read_bits(decoder, 5, &field))
+            {
+                return false;
+            }
+            leading = field;
+            if(!_read_bits(decoder, 5, &field))
+            {
+                return false;
+            }
+            length = field + 1;
+            if(leading + length > 32)
+            {
+                return false;
+            }
+            decoder->prev_leading = leading;
+            decoder->prev_trailing = 32 - leading - length;
+        }
+        else if(decoder->prev_leading == GORILLA_NO_WINDOW)
+        {
+            return false;
+        }
+
+        length = 32 - decoder->prev_leading - decoder->prev_trailing;
+        if(!_read_bits(decoder, length, &field))
+        {
+            return false;
+        }
+        decoder->prev_value ^= ( uint32_t )field << decoder->prev_trailing;
+    }
+
+decoded:
+    *timestamp = decoder->prev_timestamp;
+    memcpy(value, &decoder->prev_value, sizeof(*value));
+    decoder->remaining--;
+    decoder->decoded++;
+
+    return true;
+}
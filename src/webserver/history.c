@@ -0,0 +1,415 @@
+/**
+ * @file history.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Sealed, Gorilla compressed history segments of the stored samples
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ * Samples are encoded into the segment of their hour, which is sealed into HISTORY_DIR once a
+ * sample of a later hour arrives. The raw store is then trimmed to the samples not sealed yet, so
+ * each sample is only kept raw until its hour is sealed. The open segment lives in memory only,
+ * after a restart it is rebuilt from the raw store.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../inc/history.h"
+
+
+/** Mapped sealed segment */
+typedef struct
+{
+    void *map;
+    size_t map_size;
+    const history_header_t *header;
+    const uint8_t *data;
+} history_segment_t;
+
+
+/**
+ * @brief scandir filter for the segment files
+ *
+ * @param entry Directory entry
+ * @return int Non zero for segment files
+ */
+static int _segment_filter(const struct dirent *entry)
+{
+    size_t length = strlen(entry->d_name);
+
+    return length > 4 && !strcmp(entry->d_name + length - 4, ".seg");
+}
+
+
+/**
+ * @brief List the segment files, oldest first. Names are the zero padded start of their span
+ *
+ * @param entries Directory entries, must be freed by the caller
+ * @return int Number of segments, ERROR when the directory can not be read
+ */
+static int _list_segments(struct dirent ***entries)
+{
+    return scandir(HISTORY_DIR, entries, _segment_filter, alphasort);
+}
+
+
+/**
+ * @brief Free a segment listing
+ *
+ * @param entries Directory entries
+ * @param count Number of entries
+ */
+static void _free_segments(struct dirent **entries, int count)
+{
+    for(int i = 0; i < count; i++)
+    {
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+
+/**
+ * @brief Map a sealed segment and validate its header
+ *
+ * @param name File name inside HISTORY_DIR
+ * @param segment Mapped segment
+ * @return ssize_t Return value
+ */
+static ssize_t _segment_open(const char *name, history_segment_t *segment)
+{
+    struct stat filestat;
+    char path[PATH_MAX];
+    int fd;
+
+    snprintf(path, sizeof(path), "%s/%s", HISTORY_DIR, name);
+
+    if((fd = open(path, O_RDONLY)) == ERROR)
+    {
+        perror("history open error");
+        return ERROR;
+    }
+
+    if(fstat(fd, &filestat) == ERROR || ( size_t )filestat.st_size < sizeof(history_header_t))
+    {
+        fprintf(stderr, "history: invalid segment %s\n", name);
+        close(fd);
+        return ERROR;
+    }
+
+    segment->map_size = filestat.st_size;
+    segment->map = mmap(NULL, segment->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(segment->map == MAP_FAILED)
+    {
+        perror("mmap error");
+        return ERROR;
+    }
+
+    segment->header = segment->map;
+    segment->data = ( const uint8_t * )segment->map + sizeof(history_header_t);
+
+    if(segment->header->magic != HISTORY_MAGIC || segment->header->version != HISTORY_VERSION ||
+       sizeof(history_header_t) + segment->header->size > segment->map_size)
+    {
+        fprintf(stderr, "history: invalid segment %s\n", name);
+        munmap(segment->map, segment->map_size);
+        return ERROR;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Unmap a segment
+ *
+ * @param segment Mapped segment
+ */
+static void _segment_close(history_segment_t *segment)
+{
+    munmap(segment->map, segment->map_size);
+}
+
+
+/**
+ * @brief Write the open segment to disk. It is renamed into place so readers never see a partial
+ * segment
+ *
+ * @param writer History writer
+ * @return ssize_t Return value
+ */
+static ssize_t _seal(history_writer_t *writer)
+{
+    history_header_t header = { 0 };
+    char path[64], tmp_path[72];
+    int fd;
+
+    header.magic = HISTORY_MAGIC;
+    header.version = HISTORY_VERSION;
+    header.count = writer->encoder.count;
+    header.size = gorilla_encoder_size(&writer->encoder);
+    header.first = writer->first;
+    header.last = writer->last;
+
+    snprintf(path, sizeof(path), "%s/%013lld.seg", HISTORY_DIR, ( long long )writer->start);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    if((fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == ERROR)
+    {
+        perror("history open error");
+        return ERROR;
+    }
+
+    if(write(fd, &header, sizeof(header)) != sizeof(header) ||
+       write(fd, writer->encoder.data, header.size) != ( ssize_t )header.size || fsync(fd) == ERROR)
+    {
+        perror("history write error");
+        close(fd);
+        unlink(tmp_path);
+        return ERROR;
+    }
+
+    close(fd);
+
+    if(rename(tmp_path, path) == ERROR)
+    {
+        perror("history rename error");
+        unlink(tmp_path);
+        return ERROR;
+    }
+
+    writer->sealed = writer->last;
+    gorilla_encoder_free(&writer->encoder);
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Drop the sealed samples from the raw store. If it fails they are dropped after the next
+ * seal, queries skip the raw samples already sealed
+ *
+ * @param writer History writer
+ */
+static void _trim_raw(history_writer_t *writer)
+{
+    if(writer->raw != NULL && writer->sealed != INT64_MIN &&
+       ts_store_trim(writer->raw, TS_STORE_PATH, writer->sealed + 1) == ERROR)
+    {
+        fprintf(stderr, "history: raw store not trimmed\n");
+    }
+}
+
+
+/**
+ * @brief Open the history, rebuilding the open segment from the samples of the raw store that
+ * are not sealed yet
+ *
+ * @param writer History writer
+ * @param raw Raw sample store
+ * @return ssize_t Return value
+ */
+ssize_t history_writer_open(history_writer_t *writer, ts_store_t *raw)
+{
+    history_segment_t segment;
+    struct dirent **entries;
+    const ts_record_t *record;
+    uint64_t count;
+    int n;
+
+    memset(writer, 0, sizeof(history_writer_t));
+    gorilla_encoder_init(&writer->encoder);
+    writer->sealed = INT64_MIN;
+
+    if(mkdir(HISTORY_DIR, 0755) == ERROR && errno != EEXIST)
+    {
+        perror("history mkdir error");
+        return ERROR;
+    }
+
+    if((n = _list_segments(&entries)) == ERROR)
+    {
+        perror("scandir error");
+        return ERROR;
+    }
+
+    if(n > 0 && _segment_open(entries[n - 1]->d_name, &segment) == EXIT_SUCCESS)
+    {
+        writer->sealed = segment.header->last;
+        _segment_close(&segment);
+    }
+    _free_segments(entries, n);
+
+    /* The raw store is trimmed once, after every hour it holds is sealed */
+    count = ts_store_count(raw);
+    for(uint64_t i = ts_store_lower_bound(raw, writer->sealed); i < count; i++)
+    {
+        record = ts_store_get(raw, i);
+        history_add(writer, record->timestamp, record->value);
+    }
+
+    writer->raw = raw;
+    _trim_raw(writer);
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Drop the open segment, the raw store still holds its samples
+ *
+ * @param writer History writer
+ */
+void history_writer_close(history_writer_t *writer)
+{
+    gorilla_encoder_free(&writer->encoder);
+}
+
+
+/**
+ * @brief Add a sample, sealing the open segment when the sample belongs to a later span
+ *
+ * @param writer History writer
+ * @param timestamp Epoch in milliseconds, must not go backwards
+ * @param value Sample value
+ * @return ssize_t Return value
+ */
+ssize_t history_add(history_writer_t *writer, int64_t timestamp, float value)
+{
+    int64_t start = timestamp - timestamp % HISTORY_SPAN;
+
+    /* Already sealed before a restart */
+    if(timestamp <= writer->sealed)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    /* If sealing fails the samples stay in the open segment and it is tried again */
+    if(writer->encoder.count > 0 && start != writer->start && _seal(writer) == EXIT_SUCCESS)
+    {
+        _trim_raw(writer);
+    }
+
+    if(writer->encoder.count == 0)
+    {
+        writer->start = start;
+        writer->first = timestamp;
+    }
+
+    writer->last = timestamp;
+
+    return gorilla_encode(&writer->encoder, timestamp, value);
+}
+
+
+/**
+ * @brief Stream the samples of a time range, decoding the sealed segments it covers and
+ * reading the samples not sealed yet from the raw store. Segments are skipped by the span in
+ * their name, only the ones in the range and the latest one are mapped
+ *
+ * @param from First timestamp, included
+ * @param to Last timestamp, excluded
+ * @param callback Called for each sample in time order
+ * @param arg Callback argument
+ * @return ssize_t Return value
+ */
+ssize_t history_query(int64_t from, int64_t to, history_callback_t callback, void *arg)
+{
+    history_segment_t segment;
+    gorilla_decoder_t decoder;
+    struct dirent **entries;
+    const ts_record_t *record;
+    ts_store_t raw;
+    int64_t timestamp, start, sealed = INT64_MIN;
+    uint64_t count;
+    float value;
+    bool more = true, in_range, has_raw;
+    int n;
+
+    /* Opened before listing, a segment sealed meanwhile is either listed or still in this file */
+    has_raw = access(TS_STORE_PATH, F_OK) == EXIT_SUCCESS;
+
+    if(has_raw && ts_store_open(&raw, TS_STORE_PATH, sizeof(ts_record_t), false) == ERROR)
+    {
+        return ERROR;
+    }
+
+    if((n = _list_segments(&entries)) == ERROR)
+    {
+        n = 0;
+        entries = NULL;
+    }
+
+    for(int i = 0; i < n && more; i++)
+    {
+        start = strtoll(entries[i]->d_name, NULL, 10);
+        in_range = start < to && start + HISTORY_SPAN > from;
+
+        /* The latest one tells where the raw samples start */
+        if(!in_range && i != n - 1)
+        {
+            continue;
+        }
+
+        if(_segment_open(entries[i]->d_name, &segment) == ERROR)
+        {
+            continue;
+        }
+
+        sealed = segment.header->last;
+
+        if(in_range && segment.header->last >= from && segment.header->first < to)
+        {
+            gorilla_decoder_init(
+              &decoder, segment.data, segment.header->size, segment.header->count);
+
+            while(more && gorilla_decode(&decoder, &timestamp, &value))
+            {
+                if(timestamp >= to)
+                {
+                    more = false;
+                }
+                else if(timestamp >= from)
+                {
+                    more = callback(timestamp, value, arg);
+                }
+            }
+        }
+
+        _segment_close(&segment);
+    }
+    _free_segments(entries, n);
+
+    if(!has_raw)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    /* Samples of the open segment */
+    count = ts_store_count(&raw);
+    for(uint64_t i = ts_store_lower_bound(&raw, sealed >= from ? sealed + 1 : from);
+        i < count && more;
+        i++)
+    {
+        record = ts_store_get(&raw, i);
+        if(record->timestamp >= to)
+        {
+            break;
+        }
+        more = callback(record->timestamp, record->value, arg);
+    }
+
+    ts_store_close(&raw);
+
+    return EXIT_SUCCESS;
+}
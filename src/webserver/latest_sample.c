@@ -0,0 +1,85 @@
+/**
+ * @file latest_sample.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Seqlock protected latest sample shared between processes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <time.h>
+
+#include "../../inc/latest_sample.h"
+
+
+/**
+ * @brief Publish a new reading. Single writer, it never waits for the readers
+ *
+ * @param slot Latest sample slot
+ * @param sample Reading to publish
+ */
+void latest_sample_publish(latest_slot_t *slot, const latest_sample_t *sample)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store(&slot->sample.value, &sample->value, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sample.raw, &sample->raw, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sample.timestamp, &sample->timestamp, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sample.wall_time, &sample->wall_time, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sample.sequence, &sample->sequence, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Read the latest reading in constant time, without syscalls or locks. Retries only while
+ * the writer is in the middle of an update
+ *
+ * @param slot Latest sample slot
+ * @param sample Output reading
+ * @return true A reading was published
+ * @return false Nothing published yet
+ */
+bool latest_sample_read(latest_slot_t *slot, latest_sample_t *sample)
+{
+    uint32_t seq;
+
+    do
+    {
+        while((seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE)) & 1)
+        {
+        }
+
+        __atomic_load(&slot->sample.value, &sample->value, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sample.raw, &sample->raw, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sample.timestamp, &sample->timestamp, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sample.wall_time, &sample->wall_time, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sample.sequence, &sample->sequence, __ATOMIC_RELAXED);
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while(__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq);
+
+    return seq != 0;
+}
+
+
+/**
+ * @brief Get the monotonic timestamp for a new reading
+ *
+ * @return int64_t CLOCK_MONOTONIC in nanoseconds
+ */
+int64_t latest_sample_monotonic_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ( int64_t )ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
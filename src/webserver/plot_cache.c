@@ -0,0 +1,185 @@
+/**
+ * @file plot_cache.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Render-once cache of the encoded temperature plot
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "../../inc/plot_cache.h"
+
+
+/** Cache state, shared by the worker threads */
+static struct
+{
+    pthread_mutex_t lock;
+    pthread_cond_t rendered;
+    bool rendering;      /* A worker is rendering, the rest wait for it */
+    bool valid;          /* generation holds the last attempt */
+    uint64_t generation; /* Generation of the last render attempt */
+    plot_image_t *image; /* Last good image, NULL if none */
+} g_plot_cache = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, false, false, 0, NULL };
+
+
+/**
+ * @brief Render the plot and encode it. Only the single flight leader calls it, so the static
+ * render buffers are never shared
+ *
+ * @param ctx Process context
+ * @param generation Sample generation being rendered
+ * @return plot_image_t* New image, NULL on error
+ */
+static plot_image_t *_render_plot(ctx_t *ctx, uint64_t generation)
+{
+    static sample_t ring_samples[SAMPLE_RING_SIZE];
+    static plot_sample_t samples[SAMPLE_RING_SIZE];
+    static plot_buffer_t svg = { NULL, 0, 0 };
+    plot_image_t *image;
+    uint64_t cursor;
+    size_t nread, count = 0;
+    time_t now;
+
+    time(&now);
+
+    /* Take the whole history still in the ring, it covers the plot window */
+    cursor = generation > SAMPLE_RING_SIZE ? generation - SAMPLE_RING_SIZE : 0;
+    nread = sample_ring_read(
+      &ctx->shared_data_2->ring, &cursor, ring_samples, SAMPLE_RING_SIZE, NULL);
+
+    for(size_t i = 0; i < nread; i++)
+    {
+        if(ring_samples[i].timestamp / 1000 >= now - PLOT_WINDOW_BEFORE - PLOT_X_TIC)
+        {
+            samples[count].timestamp = ring_samples[i].timestamp / 1000;
+            samples[count].value = ring_samples[i].value;
+            count++;
+        }
+    }
+
+    if(plot_render_svg(
+         &svg, samples, count, now - PLOT_WINDOW_BEFORE, now + PLOT_WINDOW_AFTER) == ERROR)
+    {
+        return NULL;
+    }
+
+    if((image = malloc(sizeof(plot_image_t))) == NULL)
+    {
+        perror("malloc error");
+        return NULL;
+    }
+
+    if((image->data = image_base64_encode(( unsigned char * )svg.data, svg.length)) == NULL)
+    {
+        free(image);
+        return NULL;
+    }
+
+    image->refcount = 1;
+    image->generation = generation;
+    image->length = strlen(image->data);
+
+    TRACE_LOW("Plot rendered for generation %llu\n", ( unsigned long long )generation);
+
+    return image;
+}
+
+
+/**
+ * @brief Drop a reference. Called with the cache lock held
+ *
+ * @param image Image
+ */
+static void _plot_image_put(plot_image_t *image)
+{
+    if(--image->refcount == 0)
+    {
+        free(image->data);
+        free(image);
+    }
+}
+
+
+/**
+ * @brief Get the plot for the current sample generation. It is rendered at most once per
+ * generation and concurrent callers wait for the one rendering it
+ *
+ * @param ctx Process context
+ * @return plot_image_t* Image to release with plot_cache_put, NULL if no plot is available
+ */
+plot_image_t *plot_cache_get(ctx_t *ctx)
+{
+    uint64_t generation = sample_ring_head(&ctx->shared_data_2->ring);
+    plot_image_t *image;
+
+    pthread_mutex_lock(&g_plot_cache.lock);
+
+    while(g_plot_cache.rendering)
+    {
+        pthread_cond_wait(&g_plot_cache.rendered, &g_plot_cache.lock);
+    }
+
+    if(g_plot_cache.valid && g_plot_cache.generation >= generation)
+    {
+        image = g_plot_cache.image;
+        if(image != NULL)
+        {
+            image->refcount++;
+        }
+        pthread_mutex_unlock(&g_plot_cache.lock);
+        return image;
+    }
+
+    /* Become the leader for this generation */
+    g_plot_cache.rendering = true;
+    pthread_mutex_unlock(&g_plot_cache.lock);
+
+    image = _render_plot(ctx, generation);
+
+    pthread_mutex_lock(&g_plot_cache.lock);
+
+    g_plot_cache.rendering = false;
+    g_plot_cache.valid = true;
+    g_plot_cache.generation = generation;
+
+    if(image != NULL)
+    {
+        if(g_plot_cache.image != NULL)
+        {
+            _plot_image_put(g_plot_cache.image);
+        }
+        g_plot_cache.image = image;
+    }
+
+    /* Keep serving the last good image if the render failed */
+    image = g_plot_cache.image;
+    if(image != NULL)
+    {
+        image->refcount++;
+    }
+
+    pthread_cond_broadcast(&g_plot_cache.rendered);
+    pthread_mutex_unlock(&g_plot_cache.lock);
+
+    return image;
+}
+
+
+/**
+ * @brief Release an image returned by plot_cache_get
+ *
+ * @param image Image, may be NULL
+ */
+void plot_cache_put(plot_image_t *image)
+{
+    if(image == NULL)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&g_plot_cache.lock);
+    _plot_image_put(image);
+    pthread_mutex_unlock(&g_plot_cache.lock);
+}
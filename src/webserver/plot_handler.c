@@ -8,60 +8,10 @@
  * @copyright Copyright (c) 2019
  *
  */
-#include "../../inc/plot_handler.h"
-
-/* Includes to avoid gcc warnings */
-extern FILE *popen(const char *command, const char *modes);
-extern int pclose(FILE *stream);
-
-
-/**
- * @brief Generate the temperature plot based on the .dat file and store it in a png image
- *
- */
-void generate_temperature_plot()
-{
-    time_t rawtime;
-    struct tm *timeinfo;
-
-    time(&rawtime);
-    timeinfo = localtime(&rawtime);
 
-    char *setup_gnuplot[] = { "set style lines 2",
-                              "set terminal png size 640,480",
-                              "set title 'Sensor Temperature'",
-                              "set xlabel 'time [m]'",
-                              "set ylabel 'temperature [°C]'",
-                              "set output \"./sup/data.png\"",
-                              "set yrange[10:45]",
-                              "set timefmt '%H:%M:%S'",
-                              "set xdata time",
-                              "set xtics format '%H:%M'" };
-
-    uint32_t number_of_commands = 10;
-
-    FILE *handler = popen("gnuplot -persistent", "w");
-
-    for(int i = 0; i < number_of_commands; i++)
-    {
-        fprintf(handler, "%s \n", setup_gnuplot[i]);
-    }
-
-    fprintf(handler,
-            "set xrange['%02d:%02d:%02d':'%02d:%02d:%02d']\n",
-            timeinfo->tm_hour,
-            timeinfo->tm_min - 2,
-            timeinfo->tm_sec,
-            timeinfo->tm_hour,
-            timeinfo->tm_min,
-            timeinfo->tm_sec + 30);
-
-    fprintf(handler,
-            "plot \"./sup/data.dat\" using 1:2 with lines notitle linecolor rgb 'red' lw 2");
-
-    pclose(handler);
-}
+#define _GNU_SOURCE
 
+#include "../../inc/plot_handler.h"
 
 /**
  * @brief Get the moving average object
@@ -80,26 +30,28 @@ double _get_moving_average(double avg, double input, uint32_t samples)
 
 
 /**
- * @brief Get the last temp object
+ * @brief Get the last temp object from the latest sample slot, in constant time
  *
+ * @param ctx Process context
  * @param last_temp Pointer to struct to store the last temp and the timestamp
  */
-void get_last_temp(last_temp_t *last_temp)
+void get_last_temp(ctx_t *ctx, last_temp_t *last_temp)
 {
-    FILE *fp_read;
-    char str[30];
+    latest_sample_t latest;
+    struct tm timeinfo;
+    time_t rawtime;
 
-    if((fp_read = fopen("./sup/data.dat", "r")) == NULL)
+    if(!latest_sample_read(&ctx->shared_data_1->latest, &latest))
     {
-        perror("fopen error");
-        exit(EXIT_FAILURE);
+        strcpy(last_temp->timestamp, "--:--:--");
+        last_temp->temp = 0;
+        return;
     }
 
-    while(fgets(str, sizeof(str), fp_read) != NULL)
-    {
-    }
-    sscanf(str, "%s %f", last_temp->timestamp, &last_temp->temp);
-    fclose(fp_read);
+    rawtime = latest.wall_time / 1000;
+    localtime_r(&rawtime, &timeinfo);
+    strftime(last_temp->timestamp, sizeof(last_temp->timestamp), "%H:%M:%S", &timeinfo);
+    last_temp->temp = latest.value;
 }
 
 
@@ -110,51 +62,75 @@ void get_last_temp(last_temp_t *last_temp)
  */
 void child_plot_handler(ctx_t *ctx)
 {
-    float current_temp;
-    uint32_t rv;
+    sample_t raw_samples[SAMPLE_RING_SIZE];
+    sample_t stored_sample;
+    ts_record_t record = { 0 };
+    ts_store_t store;
+    rollup_writer_t rollups;
+    history_writer_t history;
+    uint64_t cursor = 0;
+    uint64_t missed;
+    size_t count;
     uint32_t nread = 1;
-    float moving_average;
+    float moving_average = 0;
     uint32_t samples = 0;
 
-    FILE *fp_dat;
+    if(ts_store_open(&store, TS_STORE_PATH, sizeof(ts_record_t), true) == ERROR)
+    {
+        perror("ts_store_open error");
+        exit(EXIT_FAILURE);
+    }
 
-    time_t rawtime;
-    struct tm *timeinfo;
+    if(history_writer_open(&history, &store) == ERROR)
+    {
+        perror("history_writer_open error");
+        exit(EXIT_FAILURE);
+    }
 
-    fclose(fopen("./sup/data.dat", "w"));
+    if(rollup_writer_open(&rollups) == ERROR)
+    {
+        perror("rollup_writer_open error");
+        exit(EXIT_FAILURE);
+    }
 
     while(1)
     {
         update_ctx_from_file(ctx);
 
-        current_temp = get_current_temp(ctx);
+        /* Catch up with every sample published since the last pass */
+        count = sample_ring_read(
+          &ctx->shared_data_1->ring, &cursor, raw_samples, SAMPLE_RING_SIZE, &missed);
 
-        time(&rawtime);
-        timeinfo = localtime(&rawtime);
-
-        /* Start writing data on plot */
-        fp_dat = fopen("./sup/data.dat", "a");
+        if(missed > 0)
+        {
+            TRACE_HIG("%llu samples overwritten before being stored\n", ( unsigned long long )missed);
+        }
 
-        if(fp_dat == NULL)
+        if(count == 0)
         {
-            perror("fopen error");
-            exit(EXIT_FAILURE);
+            sleep(ctx->read_interval);
+            continue;
         }
 
-        samples = nread < ctx->samples ? nread : ctx->samples;
+        for(size_t i = 0; i < count; i++)
+        {
+            samples = nread < ctx->samples ? nread : ctx->samples;
 
-        moving_average = _get_moving_average(moving_average, current_temp, samples);
+            moving_average = _get_moving_average(moving_average, raw_samples[i].value, samples);
 
-        fprintf(fp_dat,
-                "%02d:%02d:%02d %.2f\n",
-                timeinfo->tm_hour,
-                timeinfo->tm_min,
-                timeinfo->tm_sec,
-                moving_average);
+            record.timestamp = raw_samples[i].timestamp;
+            record.value = moving_average;
+            ts_store_append(&store, &record);
+            rollup_add(&rollups, record.timestamp, record.value);
+            history_add(&history, record.timestamp, record.value);
 
-        fclose(fp_dat);
+            /* Publish the stored sample, the plot cache renders again on a new head */
+            stored_sample.timestamp = raw_samples[i].timestamp;
+            stored_sample.value = moving_average;
+            sample_ring_publish(&ctx->shared_data_2->ring, &stored_sample);
 
-        nread++;
+            nread++;
+        }
 
         sleep(ctx->read_interval);
     }
@@ -0,0 +1,261 @@
+/**
+ * @file plot_render.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief In process SVG renderer for the temperature plot
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "../../inc/plot_render.h"
+
+#include <stdarg.h>
+
+
+/* Plot area inside the image */
+#define PLOT_AREA_LEFT 80
+#define PLOT_AREA_RIGHT (PLOT_WIDTH - 30)
+#define PLOT_AREA_TOP 50
+#define PLOT_AREA_BOTTOM (PLOT_HEIGHT - 70)
+#define PLOT_TIC_LENGTH 6
+
+
+/**
+ * @brief Append formatted text to the buffer, growing it when needed
+ *
+ * @param buf Output buffer
+ * @param fmt Format string
+ * @param ... Format arguments
+ * @return ssize_t Return value
+ */
+static ssize_t _buffer_printf(plot_buffer_t *buf, const char *fmt, ...)
+{
+    va_list args;
+    size_t available;
+    char *data;
+    int size;
+
+    while(1)
+    {
+        available = buf->capacity - buf->length;
+
+        va_start(args, fmt);
+        size = vsnprintf(buf->data ? buf->data + buf->length : NULL, available, fmt, args);
+        va_end(args);
+
+        if(size < 0)
+        {
+            return ERROR;
+        }
+
+        if(( size_t )size < available)
+        {
+            buf->length += size;
+            return EXIT_SUCCESS;
+        }
+
+        if((data = realloc(buf->data, 2 * buf->capacity + size + 1)) == NULL)
+        {
+            perror("realloc error");
+            return ERROR;
+        }
+
+        buf->data = data;
+        buf->capacity = 2 * buf->capacity + size + 1;
+    }
+}
+
+
+/**
+ * @brief Map a timestamp to the x pixel coordinate
+ *
+ * @param t Timestamp
+ * @param start First timestamp of the axis
+ * @param end Last timestamp of the axis
+ * @return double X coordinate
+ */
+static double _x_coord(time_t t, time_t start, time_t end)
+{
+    return PLOT_AREA_LEFT +
+           ( double )(t - start) * (PLOT_AREA_RIGHT - PLOT_AREA_LEFT) / ( double )(end - start);
+}
+
+
+/**
+ * @brief Map a temperature to the y pixel coordinate
+ *
+ * @param value Temperature
+ * @return double Y coordinate
+ */
+static double _y_coord(double value)
+{
+    return PLOT_AREA_BOTTOM -
+           (value - PLOT_Y_MIN) * (PLOT_AREA_BOTTOM - PLOT_AREA_TOP) / (PLOT_Y_MAX - PLOT_Y_MIN);
+}
+
+
+/**
+ * @brief Render the temperature plot as SVG. Same look as the old gnuplot plot: 640x480, red
+ * line, fixed y range and a HH:MM time axis
+ *
+ * @param buf Output buffer, reused between calls to avoid allocations
+ * @param samples Samples sorted by timestamp
+ * @param count Number of samples
+ * @param start First timestamp of the time axis
+ * @param end Last timestamp of the time axis
+ * @return ssize_t Return value
+ */
+ssize_t plot_render_svg(plot_buffer_t *buf,
+                        const plot_sample_t *samples,
+                        size_t count,
+                        time_t start,
+                        time_t end)
+{
+    ssize_t rv = EXIT_SUCCESS;
+    struct tm timeinfo;
+    char tic_label[8];
+    double x, y;
+    size_t points = 0;
+
+    if(end <= start)
+    {
+        return ERROR;
+    }
+
+    buf->length = 0;
+
+    rv |= _buffer_printf(buf,
+                         "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"%d\" height=\"%d\" "
+                         "viewBox=\"0 0 %d %d\" font-family=\"sans-serif\" font-size=\"12\">"
+                         "<rect width=\"100%%\" height=\"100%%\" fill=\"white\"/>"
+                         "<clipPath id=\"area\"><rect x=\"%d\" y=\"%d\" width=\"%d\" "
+                         "height=\"%d\"/></clipPath>",
+                         PLOT_WIDTH,
+                         PLOT_HEIGHT,
+                         PLOT_WIDTH,
+                         PLOT_HEIGHT,
+                         PLOT_AREA_LEFT,
+                         PLOT_AREA_TOP,
+                         PLOT_AREA_RIGHT - PLOT_AREA_LEFT,
+                         PLOT_AREA_BOTTOM - PLOT_AREA_TOP);
+
+    /* Title and labels */
+    rv |= _buffer_printf(buf,
+                         "<text x=\"%d\" y=\"30\" text-anchor=\"middle\" font-size=\"16\">"
+                         "Sensor Temperature</text>"
+                         "<text x=\"%d\" y=\"%d\" text-anchor=\"middle\">time [m]</text>"
+                         "<text x=\"25\" y=\"%d\" text-anchor=\"middle\" "
+                         "transform=\"rotate(-90 25 %d)\">temperature [°C]</text>",
+                         PLOT_WIDTH / 2,
+                         (PLOT_AREA_LEFT + PLOT_AREA_RIGHT) / 2,
+                         PLOT_HEIGHT - 20,
+                         (PLOT_AREA_TOP + PLOT_AREA_BOTTOM) / 2,
+                         (PLOT_AREA_TOP + PLOT_AREA_BOTTOM) / 2);
+
+    /* Border */
+    rv |= _buffer_printf(buf,
+                         "<g stroke=\"black\" fill=\"none\"><rect x=\"%d\" y=\"%d\" width=\"%d\" "
+                         "height=\"%d\"/>",
+                         PLOT_AREA_LEFT,
+                         PLOT_AREA_TOP,
+                         PLOT_AREA_RIGHT - PLOT_AREA_LEFT,
+                         PLOT_AREA_BOTTOM - PLOT_AREA_TOP);
+
+    /* Tics, mirrored on both sides like gnuplot does */
+    for(int value = PLOT_Y_MIN; value <= PLOT_Y_MAX; value += PLOT_Y_TIC)
+    {
+        y = _y_coord(value);
+        rv |= _buffer_printf(buf,
+                             "<path d=\"M%d %.1fh%dM%d %.1fh-%d\"/>",
+                             PLOT_AREA_LEFT,
+                             y,
+                             PLOT_TIC_LENGTH,
+                             PLOT_AREA_RIGHT,
+                             y,
+                             PLOT_TIC_LENGTH);
+    }
+
+    for(time_t t = ((start + PLOT_X_TIC - 1) / PLOT_X_TIC) * PLOT_X_TIC; t <= end; t += PLOT_X_TIC)
+    {
+        x = _x_coord(t, start, end);
+        rv |= _buffer_printf(buf,
+                             "<path d=\"M%.1f %dv-%dM%.1f %dv%d\"/>",
+                             x,
+                             PLOT_AREA_BOTTOM,
+                             PLOT_TIC_LENGTH,
+                             x,
+                             PLOT_AREA_TOP,
+                             PLOT_TIC_LENGTH);
+    }
+
+    rv |= _buffer_printf(buf, "</g>");
+
+    /* Tic labels */
+    for(int value = PLOT_Y_MIN; value <= PLOT_Y_MAX; value += PLOT_Y_TIC)
+    {
+        rv |= _buffer_printf(buf,
+                             "<text x=\"%d\" y=\"%.1f\" text-anchor=\"end\">%d</text>",
+                             PLOT_AREA_LEFT - 8,
+                             _y_coord(value) + 4,
+                             value);
+    }
+
+    for(time_t t = ((start + PLOT_X_TIC - 1) / PLOT_X_TIC) * PLOT_X_TIC; t <= end; t += PLOT_X_TIC)
+    {
+        localtime_r(&t, &timeinfo);
+        strftime(tic_label, sizeof(tic_label), "%H:%M", &timeinfo);
+        rv |= _buffer_printf(buf,
+                             "<text x=\"%.1f\" y=\"%d\" text-anchor=\"middle\">%s</text>",
+                             _x_coord(t, start, end),
+                             PLOT_AREA_BOTTOM + 20,
+                             tic_label);
+    }
+
+    /* Temperature line, clipped to the plot area */
+    for(size_t i = 0; i < count; i++)
+    {
+        /* Keep one sample on each side so the line reaches the borders */
+        if((i + 1 < count && samples[i + 1].timestamp < start) ||
+           (i > 0 && samples[i - 1].timestamp > end))
+        {
+            continue;
+        }
+
+        if(points++ == 0)
+        {
+            rv |= _buffer_printf(buf,
+                                 "<polyline clip-path=\"url(#area)\" fill=\"none\" "
+                                 "stroke=\"red\" stroke-width=\"2\" points=\"");
+        }
+
+        rv |= _buffer_printf(buf,
+                             "%.1f,%.1f ",
+                             _x_coord(samples[i].timestamp, start, end),
+                             _y_coord(samples[i].value));
+    }
+
+    if(points > 0)
+    {
+        rv |= _buffer_printf(buf, "\"/>");
+    }
+
+    rv |= _buffer_printf(buf, "</svg>");
+
+    return rv == EXIT_SUCCESS ? EXIT_SUCCESS : ERROR;
+}
+
+
+/**
+ * @brief Release the buffer storage
+ *
+ * @param buf Output buffer
+ */
+void plot_buffer_free(plot_buffer_t *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->length = 0;
+    buf->capacity = 0;
+}
@@ -0,0 +1,352 @@
+/**
+ * @file rollup.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Min, max and mean rollups of the stored samples at 1 s, 1 min and 1 h resolution
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include "../../inc/rollup.h"
+
+
+/** Tier description */
+typedef struct
+{
+    int64_t resolution; /* Bucket width in milliseconds */
+    const char *name;   /* File name suffix */
+} rollup_tier_t;
+
+
+static const rollup_tier_t tiers[ROLLUP_TIERS] = {
+    { 1000, "1s" },
+    { 60 * 1000, "1m" },
+    { 60 * 60 * 1000, "1h" },
+};
+
+
+/**
+ * @brief Build the file path of a tier
+ *
+ * @param path Output buffer
+ * @param size Size of the output buffer
+ * @param tier Tier index
+ */
+static void _tier_path(char *path, size_t size, size_t tier)
+{
+    snprintf(path, size, ROLLUP_PATH_FORMAT, tiers[tier].name);
+}
+
+
+/**
+ * @brief Start of the bucket holding a timestamp
+ *
+ * @param timestamp Timestamp
+ * @param resolution Bucket width
+ * @return int64_t Bucket start
+ */
+static int64_t _bucket_start(int64_t timestamp, int64_t resolution)
+{
+    int64_t start = timestamp - timestamp % resolution;
+
+    return start > timestamp ? start - resolution : start;
+}
+
+
+/**
+ * @brief Store a finished bucket
+ *
+ * @param writer Rollup writer
+ * @param tier Tier index
+ */
+static void _flush_bucket(rollup_writer_t *writer, size_t tier)
+{
+    rollup_bucket_t *bucket = &writer->open[tier];
+    rollup_record_t record;
+
+    record.timestamp = bucket->start;
+    record.min = bucket->min;
+    record.max = bucket->max;
+    record.mean = bucket->sum / bucket->count;
+    record.count = bucket->count;
+
+    if(ts_store_append(&writer->stores[tier], &record) == EXIT_SUCCESS)
+    {
+        writer->flushed[tier] = bucket->start;
+    }
+
+    bucket->count = 0;
+}
+
+
+/**
+ * @brief Merge a bucket into another one, weighting the means by their count
+ *
+ * @param dst Accumulated bucket
+ * @param src Bucket to add
+ */
+static void _merge_record(rollup_record_t *dst, const rollup_record_t *src)
+{
+    uint32_t count = dst->count + src->count;
+
+    dst->mean = (( double )dst->mean * dst->count + ( double )src->mean * src->count) / count;
+    dst->min = src->min < dst->min ? src->min : dst->min;
+    dst->max = src->max > dst->max ? src->max : dst->max;
+    dst->count = count;
+}
+
+
+/**
+ * @brief Open the tier files for writing, resuming after the last stored bucket
+ *
+ * @param writer Rollup writer
+ * @return ssize_t Return value
+ */
+ssize_t rollup_writer_open(rollup_writer_t *writer)
+{
+    const rollup_record_t *latest;
+    char path[64];
+
+    memset(writer, 0, sizeof(rollup_writer_t));
+
+    for(size_t i = 0; i < ROLLUP_TIERS; i++)
+    {
+        _tier_path(path, sizeof(path), i);
+
+        if(ts_store_open(&writer->stores[i], path, sizeof(rollup_record_t), true) == ERROR)
+        {
+            while(i-- > 0)
+            {
+                ts_store_close(&writer->stores[i]);
+            }
+            return ERROR;
+        }
+
+        latest = ts_store_latest(&writer->stores[i]);
+        writer->flushed[i] = latest != NULL ? latest->timestamp : INT64_MIN;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Close the tier files. Buckets still open are lost
+ *
+ * @param writer Rollup writer
+ */
+void rollup_writer_close(rollup_writer_t *writer)
+{
+    for(size_t i = 0; i < ROLLUP_TIERS; i++)
+    {
+        ts_store_close(&writer->stores[i]);
+    }
+}
+
+
+/**
+ * @brief Add a sample to every tier. A bucket is stored once a sample of a later bucket arrives
+ *
+ * @param writer Rollup writer
+ * @param timestamp Epoch in milliseconds, must not go backwards
+ * @param value Sample value
+ */
+void rollup_add(rollup_writer_t *writer, int64_t timestamp, float value)
+{
+    for(size_t i = 0; i < ROLLUP_TIERS; i++)
+    {
+        rollup_bucket_t *bucket = &writer->open[i];
+        int64_t start = _bucket_start(timestamp, tiers[i].resolution);
+
+        /* Already stored before a restart */
+        if(start <= writer->flushed[i])
+        {
+            continue;
+        }
+
+        if(bucket->count > 0 && bucket->start != start)
+        {
+            _flush_bucket(writer, i);
+        }
+
+        if(bucket->count == 0)
+        {
+            bucket->start = start;
+            bucket->min = bucket->max = value;
+            bucket->sum = 0;
+        }
+
+        bucket->min = value < bucket->min ? value : bucket->min;
+        bucket->max = value > bucket->max ? value : bucket->max;
+        bucket->sum += value;
+        bucket->count++;
+    }
+}
+
+
+/** Buckets built by a query */
+typedef struct
+{
+    int64_t step;
+    rollup_record_t *out;
+    size_t count;
+    size_t capacity;
+    bool error;
+} rollup_query_t;
+
+
+/**
+ * @brief Add a record to the buckets of a query, merging it into the last one when it falls in
+ * the same step
+ *
+ * @param query Query
+ * @param record Raw sample or tier bucket
+ * @return bool False to stop the query
+ */
+static bool _query_add(rollup_query_t *query, rollup_record_t *record)
+{
+    rollup_record_t *tmp;
+    int64_t start;
+
+    if(query->step > 0)
+    {
+        start = _bucket_start(record->timestamp, query->step);
+
+        if(query->count > 0 && query->out[query->count - 1].timestamp == start)
+        {
+            _merge_record(&query->out[query->count - 1], record);
+            return true;
+        }
+
+        record->timestamp = start;
+    }
+
+    /* Raw samples are not bounded by the step */
+    if(query->count >= ROLLUP_MAX_POINTS)
+    {
+        query->error = true;
+        return false;
+    }
+
+    if(query->count == query->capacity)
+    {
+        query->capacity = query->capacity ? 2 * query->capacity : 1024;
+        if((tmp = realloc(query->out, query->capacity * sizeof(rollup_record_t))) == NULL)
+        {
+            perror("realloc error");
+            query->error = true;
+            return false;
+        }
+        query->out = tmp;
+    }
+
+    query->out[query->count++] = *record;
+
+    return true;
+}
+
+
+/**
+ * @brief history_query callback for the raw samples
+ *
+ * @param timestamp Sample timestamp
+ * @param value Sample value
+ * @param arg Query
+ * @return bool False to stop the query
+ */
+static bool _query_sample(int64_t timestamp, float value, void *arg)
+{
+    rollup_record_t record;
+
+    record.timestamp = timestamp;
+    record.min = record.max = record.mean = value;
+    record.count = 1;
+
+    return _query_add(arg, &record);
+}
+
+
+/**
+ * @brief Aggregate a time range into buckets of the requested step. The coarsest tier whose
+ * resolution fits in the step is read. Below a second the samples come from the history, the
+ * sealed segments and the raw samples not sealed yet. Tier buckets are assigned by their start,
+ * so the range edges are only as exact as the tier used
+ *
+ * @param from First timestamp, included
+ * @param to Last timestamp, excluded
+ * @param step Output bucket width in milliseconds, 0 for the raw samples
+ * @param out Buckets holding samples, must be freed by the caller
+ * @param count Number of buckets
+ * @return ssize_t Return value
+ */
+ssize_t rollup_query(int64_t from, int64_t to, int64_t step, rollup_record_t **out, size_t *count)
+{
+    rollup_query_t query = { step, NULL, 0, 0, false };
+    rollup_record_t record;
+    ts_store_t store;
+    char path[64];
+    uint64_t first, n;
+    int tier = ERROR;
+    ssize_t rv = EXIT_SUCCESS;
+
+    *out = NULL;
+    *count = 0;
+
+    if(to <= from || step < 0 || (step > 0 && (to - from) / step >= ROLLUP_MAX_POINTS))
+    {
+        return ERROR;
+    }
+
+    for(size_t i = 0; i < ROLLUP_TIERS; i++)
+    {
+        if(tiers[i].resolution <= step)
+        {
+            tier = i;
+        }
+    }
+
+    if(tier == ERROR)
+    {
+        rv = history_query(from, to, _query_sample, &query);
+    }
+    else
+    {
+        _tier_path(path, sizeof(path), tier);
+
+        /* Nothing stored yet */
+        if(access(path, F_OK) == ERROR)
+        {
+            return EXIT_SUCCESS;
+        }
+
+        if(ts_store_open(&store, path, sizeof(rollup_record_t), false) == ERROR)
+        {
+            return ERROR;
+        }
+
+        n = ts_store_range(&store, from, to, &first);
+
+        for(uint64_t i = first; i < first + n && !query.error; i++)
+        {
+            memcpy(&record, ts_store_get(&store, i), sizeof(rollup_record_t));
+            _query_add(&query, &record);
+        }
+
+        ts_store_close(&store);
+    }
+
+    if(rv == ERROR || query.error)
+    {
+        free(query.out);
+        return ERROR;
+    }
+
+    *out = query.out;
+    *count = query.count;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,139 @@
+/**
+ * @file sample_ring.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Lock free ring of timestamped samples shared between processes
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <time.h>
+
+#include "../../inc/sample_ring.h"
+
+
+/**
+ * @brief Publish a sample. Only one process may publish on a ring, it never waits for readers
+ *
+ * @param ring Sample ring
+ * @param sample Sample to publish
+ */
+void sample_ring_publish(sample_ring_t *ring, const sample_t *sample)
+{
+    uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_RELAXED);
+    sample_slot_t *slot = &ring->slots[head & SAMPLE_RING_MASK];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+
+    /* Odd sequence marks the slot as being written */
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    __atomic_store(&slot->sample.timestamp, &sample->timestamp, __ATOMIC_RELAXED);
+    __atomic_store(&slot->sample.value, &sample->value, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Get the number of samples published so far
+ *
+ * @param ring Sample ring
+ * @return uint64_t Head index
+ */
+uint64_t sample_ring_head(sample_ring_t *ring)
+{
+    return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+}
+
+
+/**
+ * @brief Read the samples published since the cursor and advance it. When the producer lapped
+ * the reader the cursor jumps to the oldest sample still in the ring
+ *
+ * @param ring Sample ring
+ * @param cursor Index of the next sample to read, private to each reader
+ * @param samples Output samples
+ * @param max_samples Size of samples
+ * @param missed Samples overwritten before they could be read, may be NULL
+ * @return size_t Number of samples read
+ */
+size_t sample_ring_read(sample_ring_t *ring,
+                        uint64_t *cursor,
+                        sample_t *samples,
+                        size_t max_samples,
+                        uint64_t *missed)
+{
+    uint64_t head;
+    sample_slot_t *slot;
+    uint32_t seq, expected_seq;
+    size_t count = 0;
+
+    if(missed != NULL)
+    {
+        *missed = 0;
+    }
+
+    while(count < max_samples)
+    {
+        head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+        if(*cursor >= head)
+        {
+            break;
+        }
+
+        if(head - *cursor > SAMPLE_RING_SIZE)
+        {
+            if(missed != NULL)
+            {
+                *missed += head - *cursor - SAMPLE_RING_SIZE;
+            }
+            *cursor = head - SAMPLE_RING_SIZE;
+        }
+
+        /* The slot holding sample n was written n / SIZE + 1 times */
+        slot = &ring->slots[*cursor & SAMPLE_RING_MASK];
+        expected_seq = 2 * ( uint32_t )(*cursor / SAMPLE_RING_SIZE + 1);
+
+        seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        __atomic_load(&slot->sample.timestamp, &samples[count].timestamp, __ATOMIC_RELAXED);
+        __atomic_load(&slot->sample.value, &samples[count].value, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if(seq != expected_seq || __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq)
+        {
+            /* Overwritten before or while reading, skip it instead of waiting for the writer */
+            (*cursor)++;
+            if(missed != NULL)
+            {
+                (*missed)++;
+            }
+            continue;
+        }
+
+        (*cursor)++;
+        count++;
+    }
+
+    return count;
+}
+
+
+/**
+ * @brief Get the sample timestamp for now
+ *
+ * @return int64_t Epoch in milliseconds
+ */
+int64_t sample_time_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ( int64_t )ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
@@ -0,0 +1,374 @@
+/**
+ * @file ts_store.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Append only, memory mapped store of fixed size timestamped records
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../inc/ts_store.h"
+
+
+/**
+ * @brief Get the header inside the mapping
+ *
+ * @param store Store
+ * @return ts_store_header_t* Header
+ */
+static ts_store_header_t *_header(ts_store_t *store)
+{
+    return ( ts_store_header_t * )store->map;
+}
+
+
+/**
+ * @brief Map the whole file again, it grows while it is being written
+ *
+ * @param store Store
+ * @return ssize_t Return value
+ */
+static ssize_t _remap(ts_store_t *store)
+{
+    struct stat filestat;
+    void *map;
+
+    if(fstat(store->fd, &filestat) == ERROR)
+    {
+        perror("fstat error");
+        return ERROR;
+    }
+
+    if(( size_t )filestat.st_size < TS_STORE_HEADER_SIZE)
+    {
+        fprintf(stderr, "ts_store: truncated file\n");
+        return ERROR;
+    }
+
+    map = mmap(NULL,
+               filestat.st_size,
+               PROT_READ | (store->writable ? PROT_WRITE : 0),
+               MAP_SHARED,
+               store->fd,
+               0);
+
+    if(map == MAP_FAILED)
+    {
+        perror("mmap error");
+        return ERROR;
+    }
+
+    if(store->map != NULL)
+    {
+        munmap(store->map, store->map_size);
+    }
+
+    store->map = map;
+    store->map_size = filestat.st_size;
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Open a store, creating it when writable
+ *
+ * @param store Store
+ * @param path File path
+ * @param record_size Size of each record, 0 to take it from the file
+ * @param writable Open for appending. Only one writer per file
+ * @return ssize_t Return value
+ */
+ssize_t ts_store_open(ts_store_t *store, const char *path, uint32_t record_size, bool writable)
+{
+    ts_store_header_t header = { 0 };
+    struct stat filestat;
+
+    memset(store, 0, sizeof(ts_store_t));
+    store->writable = writable;
+
+    if((store->fd = open(path, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644)) == ERROR)
+    {
+        perror("ts_store open error");
+        return ERROR;
+    }
+
+    if(fstat(store->fd, &filestat) == ERROR)
+    {
+        perror("fstat error");
+        goto open_error;
+    }
+
+    if(filestat.st_size == 0 && writable)
+    {
+        header.magic = TS_STORE_MAGIC;
+        header.version = TS_STORE_VERSION;
+        header.record_size = record_size;
+
+        if(record_size < sizeof(int64_t) ||
+           ftruncate(store->fd, TS_STORE_HEADER_SIZE + TS_STORE_GROW * record_size) == ERROR ||
+           pwrite(store->fd, &header, sizeof(header), 0) != sizeof(header))
+        {
+            perror("ts_store create error");
+            goto open_error;
+        }
+    }
+
+    if(pread(store->fd, &header, sizeof(header), 0) != sizeof(header) ||
+       header.magic != TS_STORE_MAGIC || header.version != TS_STORE_VERSION ||
+       header.record_size < sizeof(int64_t) ||
+       (record_size != 0 && header.record_size != record_size))
+    {
+        fprintf(stderr, "ts_store: invalid file %s\n", path);
+        goto open_error;
+    }
+
+    store->record_size = header.record_size;
+
+    if(_remap(store) == ERROR)
+    {
+        goto open_error;
+    }
+
+    return EXIT_SUCCESS;
+
+open_error:
+    close(store->fd);
+    store->fd = ERROR;
+    return ERROR;
+}
+
+
+/**
+ * @brief Close a store
+ *
+ * @param store Store
+ */
+void ts_store_close(ts_store_t *store)
+{
+    if(store->map != NULL)
+    {
+        munmap(store->map, store->map_size);
+        store->map = NULL;
+    }
+
+    if(store->fd != ERROR)
+    {
+        close(store->fd);
+        store->fd = ERROR;
+    }
+}
+
+
+/**
+ * @brief Get the number of committed records, remapping if the file grew
+ *
+ * @param store Store
+ * @return uint64_t Number of records
+ */
+uint64_t ts_store_count(ts_store_t *store)
+{
+    uint64_t count = __atomic_load_n(&_header(store)->count, __ATOMIC_ACQUIRE);
+
+    if(TS_STORE_HEADER_SIZE + count * store->record_size > store->map_size)
+    {
+        if(_remap(store) == ERROR)
+        {
+            return (store->map_size - TS_STORE_HEADER_SIZE) / store->record_size;
+        }
+    }
+
+    return count;
+}
+
+
+/**
+ * @brief Append a record. Timestamps must not go backwards so the records stay sorted
+ *
+ * @param store Store
+ * @param record Record, starting with its int64_t timestamp
+ * @return ssize_t Return value
+ */
+ssize_t ts_store_append(ts_store_t *store, const void *record)
+{
+    uint64_t count = ts_store_count(store);
+    size_t needed = TS_STORE_HEADER_SIZE + (count + 1) * store->record_size;
+
+    if(!store->writable)
+    {
+        return ERROR;
+    }
+
+    if(count > 0 && *( const int64_t * )record < *( const int64_t * )ts_store_latest(store))
+    {
+        fprintf(stderr, "ts_store: timestamp went backwards, record dropped\n");
+        return ERROR;
+    }
+
+    if(needed > store->map_size)
+    {
+        if(ftruncate(store->fd, store->map_size + TS_STORE_GROW * store->record_size) == ERROR)
+        {
+            perror("ftruncate error");
+            return ERROR;
+        }
+
+        if(_remap(store) == ERROR)
+        {
+            return ERROR;
+        }
+    }
+
+    memcpy(store->map + TS_STORE_HEADER_SIZE + count * store->record_size,
+           record,
+           store->record_size);
+
+    /* Readers only look at records below count */
+    __atomic_store_n(&_header(store)->count, count + 1, __ATOMIC_RELEASE);
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Get a record, index must be below ts_store_count
+ *
+ * @param store Store
+ * @param index Record index
+ * @return const void* Record inside the mapping
+ */
+const void *ts_store_get(ts_store_t *store, uint64_t index)
+{
+    return store->map + TS_STORE_HEADER_SIZE + index * store->record_size;
+}
+
+
+/**
+ * @brief Get the latest record in O(1)
+ *
+ * @param store Store
+ * @return const void* Latest record, NULL if the store is empty
+ */
+const void *ts_store_latest(ts_store_t *store)
+{
+    uint64_t count = ts_store_count(store);
+
+    return count == 0 ? NULL : ts_store_get(store, count - 1);
+}
+
+
+/**
+ * @brief Binary search the first record at or after a timestamp. Records are appended in time
+ * order, so they are their own timestamp index
+ *
+ * @param store Store
+ * @param timestamp Timestamp
+ * @return uint64_t Index of the first record with timestamp >= the given one
+ */
+uint64_t ts_store_lower_bound(ts_store_t *store, int64_t timestamp)
+{
+    uint64_t low = 0, high = ts_store_count(store), mid;
+
+    while(low < high)
+    {
+        mid = low + (high - low) / 2;
+
+        if(*( const int64_t * )ts_store_get(store, mid) < timestamp)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    return low;
+}
+
+
+/**
+ * @brief Find the records in a time range
+ *
+ * @param store Store
+ * @param from First timestamp, included
+ * @param to Last timestamp, excluded
+ * @param first Index of the first record in the range
+ * @return uint64_t Number of records in the range
+ */
+uint64_t ts_store_range(ts_store_t *store, int64_t from, int64_t to, uint64_t *first)
+{
+    uint64_t last;
+
+    *first = ts_store_lower_bound(store, from);
+    last = to > from ? ts_store_lower_bound(store, to) : *first;
+
+    return last - *first;
+}
+
+
+/**
+ * @brief Drop the records older than a timestamp. The records kept are copied to a new file that
+ * is renamed over the old one, so readers that already opened it keep a consistent view
+ *
+ * @param store Store open for writing, replaced by the trimmed one
+ * @param path File path the store was opened from
+ * @param before Records with an older timestamp are dropped
+ * @return ssize_t Return value
+ */
+ssize_t ts_store_trim(ts_store_t *store, const char *path, int64_t before)
+{
+    char tmp_path[PATH_MAX];
+    ts_store_t trimmed;
+    uint64_t first = ts_store_lower_bound(store, before), count = ts_store_count(store);
+
+    if(!store->writable)
+    {
+        return ERROR;
+    }
+
+    if(first == 0)
+    {
+        return EXIT_SUCCESS; /* Nothing older */
+    }
+
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+    unlink(tmp_path);
+
+    if(ts_store_open(&trimmed, tmp_path, store->record_size, true) == ERROR)
+    {
+        return ERROR;
+    }
+
+    for(uint64_t i = first; i < count; i++)
+    {
+        if(ts_store_append(&trimmed, ts_store_get(store, i)) == ERROR)
+        {
+            goto trim_error;
+        }
+    }
+
+    if(fsync(trimmed.fd) == ERROR || rename(tmp_path, path) == ERROR)
+    {
+        perror("ts_store trim error");
+        goto trim_error;
+    }
+
+    ts_store_close(store);
+    *store = trimmed;
+
+    return EXIT_SUCCESS;
+
+trim_error:
+    ts_store_close(&trimmed);
+    unlink(tmp_path);
+    return ERROR;
+}
@@ -11,10 +11,20 @@
 
 
 #include "../../inc/webserver.h"
+#include "../../inc/event_loop.h"
+#include "../../inc/plot_cache.h"
 
 
 bool flag_sigusr1 = false;
 
+struct pollfd fdinfo[1];
+int semaphore_set;
+
+/* Webserver variables */
+uint32_t sock_fd;
+socklen_t socket_length;
+struct sockaddr_in server_addr;
+
 
 /**
  * @brief Web server initialization
@@ -82,146 +92,240 @@ ssize_t web_server_init(ctx_t *ctx)
 
 
 /**
- * @brief Generate an ok response data with the given parameters
+ * @brief Format into a buffer allocated with the exact size needed
  *
- * @param sock_client Client socket number
- * @param student_name Student name for the template
- * @param legajo Legajo for the template
- * @param last_temp Struct with the last temperature and timestamp
+ * @param length Length of the formatted string
+ * @param fmt Format string
+ * @param ... Format arguments
+ * @return char* Formatted buffer, must be freed by the caller
  */
-void send_response_data(uint32_t sock_client,
-                        const char *student_name,
-                        const char *legajo,
-                        last_temp_t *last_temp)
+static char *_format_alloc(size_t *length, const char *fmt, ...)
 {
-    char write_buf[8192] = { 0 }, write_buf2[8192] = { 0 };
-    char out_buf[8192] = { 0 }, out_buf2[8192] = { 0 };
-    char dev_temp[10];
-    char *image_data;
-    struct stat filestat;
-    char filesize[7];
-    int fd;
-    char file_buf[1024] = { 0 };
-    char result;
-    FILE *fp;
+    va_list args;
+    char *buf;
+    int size;
+
+    va_start(args, fmt);
+    size = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
 
-    if(((fd = open("./sup/data.png", O_RDONLY)) < -1) || (fstat(fd, &filestat) < 0))
+    if(size < 0 || (buf = malloc(size + 1)) == NULL)
     {
-        printf("Error in measuring the size of the file");
+        perror("format error");
+        return NULL;
     }
 
-    sprintf(filesize, "%zd", filestat.st_size);
+    va_start(args, fmt);
+    vsnprintf(buf, size + 1, fmt, args);
+    va_end(args);
 
-    fp = fopen("./sup/data.png", "r");
-    if(fp == NULL)
-    {
-        perror("fopen error");
-        exit(EXIT_FAILURE);
-    }
+    *length = size;
+    return buf;
+}
 
-    fread(file_buf, sizeof(char), filestat.st_size + 1, fp);
-    fclose(fp);
 
-    image_data = get_base64_plot("./sup/data.png");
+/**
+ * @brief Generate an ok response data with the given parameters
+ *
+ * @param student_name Student name for the template
+ * @param legajo Legajo for the template
+ * @param last_temp Struct with the last temperature and timestamp
+ * @param image_data Base64 encoded plot
+ * @param response_length Length of the generated response
+ * @return char* Response buffer, must be freed by the caller
+ */
+char *build_response_data(const char *student_name,
+                          const char *legajo,
+                          last_temp_t *last_temp,
+                          const char *image_data,
+                          size_t *response_length)
+{
+    char dev_temp[16];
+    char *page, *response;
+    size_t page_length;
 
     sprintf(dev_temp, "%.2f°C", last_temp->temp);
-    sprintf(write_buf,
-            response_page_template,
-            student_name,
-            legajo,
-            last_temp->timestamp,
-            dev_temp,
-            image_data);
-
-    sprintf(out_buf, response_http_template, strlen(write_buf), write_buf);
-    write(sock_client, out_buf, strlen(out_buf));
+    page = _format_alloc(&page_length,
+                         response_page_template,
+                         student_name,
+                         legajo,
+                         last_temp->timestamp,
+                         dev_temp,
+                         image_data);
+
+    if(page == NULL)
+    {
+        return NULL;
+    }
+
+    response = _format_alloc(response_length, response_http_template, page_length, page);
+    free(page);
+
+    return response;
 }
 
 
 /**
  * @brief Generates an invalid response
  *
- * @param sock_client Client socket
+ * @param method Method received from the client
+ * @param response_length Length of the generated response
+ * @return char* Response buffer, must be freed by the caller
  */
-void send_invalid_response(uint32_t sock_client)
+char *build_invalid_response(const char *method, size_t *response_length)
 {
     char write_buf[128] = { 0 };
-    char out_buf[4096] = { 0 };
-    sprintf(write_buf, "POST method is not supported\n");
-    sprintf(out_buf, invalid_response_template, strlen(write_buf), write_buf);
-    write(sock_client, out_buf, strlen(out_buf));
+
+    snprintf(write_buf, sizeof(write_buf), "%s method is not supported\n", method);
+
+    return _format_alloc(
+      response_length, invalid_response_template, strlen(write_buf), write_buf);
 }
 
 
 /**
- * @brief Thread that handles the client conection
+ * @brief Generates a busy response when the work queue is full
  *
- * @param arg Thread arguments
- * @return void* Return value
+ * @param response_length Length of the generated response
+ * @return char* Response buffer, must be freed by the caller
  */
-void *client_thread(void *arg)
+char *build_busy_response(size_t *response_length)
 {
-    const char *student_name = "Pedro Wozniak Lorice";
-    const char *legajo = "140-728.4";
-
-    uint32_t read_msg_length = 0;
-    uint32_t thread_success = 0, thread_error = 1;
-    last_temp_t *last_temp = malloc(sizeof(last_temp_t));
-
-    args_t *args = arg;
+    const char *write_buf = "Server busy, try again later\n";
 
-    uint32_t sock_client = args->sock_fd;
-    TRACE_MID("New client with socket_id: %d\n", sock_client);
-
-    char read_buf[4096] = { 0 };
-    char *method;
-
-    get_last_temp(last_temp);
+    return _format_alloc(response_length, busy_response_template, strlen(write_buf), write_buf);
+}
 
-    read_msg_length = read(sock_client, read_buf, sizeof(read_buf));
 
-    char *tmp_msg = strdup(read_buf);
-    method = strtok(tmp_msg, " /");
+/**
+ * @brief Generates the CSV history of a time range, answered from the rollup tiers
+ *
+ * @param query Query string: from and to in epoch milliseconds, step in milliseconds (0 for the
+ * raw samples). Defaults to the last hour by minute
+ * @param response_length Length of the generated response
+ * @return char* Response buffer, must be freed by the caller
+ */
+char *build_history_response(char *query, size_t *response_length)
+{
+    const char *invalid_query = "Invalid history range or too many points for the step\n";
+    int64_t to = sample_time_now(), from = ERROR, step = 60 * 1000;
+    rollup_record_t *buckets;
+    char *csv = NULL, *response, *param, *save_ptr;
+    size_t count, csv_length = 0;
+    long long value;
+    FILE *fp;
 
-    if(read_msg_length <= 0)
+    for(param = strtok_r(query, "&", &save_ptr); param != NULL;
+        param = strtok_r(NULL, "&", &save_ptr))
     {
-        perror("rcv");
-        if(errno == EPIPE) /* Connection broken */
+        if(sscanf(param, "from=%lld", &value) == 1)
         {
-            printf("Client error\n");
-            goto thread_error;
+            from = value;
         }
-        if(errno == EAGAIN || errno == EWOULDBLOCK) /* Timeout in reception */
+        else if(sscanf(param, "to=%lld", &value) == 1)
         {
-            printf("Timeout in client connection\n");
-            goto thread_error;
+            to = value;
         }
+        else if(sscanf(param, "step=%lld", &value) == 1)
+        {
+            step = value;
+        }
+    }
 
-        printf("Client ended connection\n");
-        goto thread_error;
+    if(from == ERROR)
+    {
+        from = to - 60 * 60 * 1000;
+    }
+
+    if(rollup_query(from, to, step, &buckets, &count) == ERROR)
+    {
+        return _format_alloc(response_length,
+                             invalid_response_template,
+                             strlen(invalid_query),
+                             invalid_query);
     }
 
-    if(!strcasecmp(method, "GET"))
+    if((fp = open_memstream(&csv, &csv_length)) == NULL)
     {
-        generate_temperature_plot();
-        send_response_data(sock_client, student_name, legajo, last_temp);
+        perror("open_memstream error");
+        free(buckets);
+        return NULL;
     }
-    else if(!strcasecmp(method, "POST"))
+
+    fprintf(fp, "timestamp,min,max,mean,count\n");
+    for(size_t i = 0; i < count; i++)
     {
-        send_invalid_response(sock_client);
-        goto thread_error;
+        fprintf(fp,
+                "%lld,%.2f,%.2f,%.2f,%u\n",
+                ( long long )buckets[i].timestamp,
+                buckets[i].min,
+                buckets[i].max,
+                buckets[i].mean,
+                buckets[i].count);
     }
+    fclose(fp);
+    free(buckets);
 
-    close(sock_client);
-    g_number_of_threads--;
-    free(last_temp);
-    pthread_exit(&thread_success);
+    response = _format_alloc(response_length, history_http_template, csv_length, csv);
+    free(csv);
 
-thread_error:
-    g_number_of_threads--;
-    close(sock_client);
-    free(last_temp);
-    pthread_exit(&thread_error);
+    return response;
+}
+
+
+/**
+ * @brief Build the response for a client request
+ *
+ * @param ctx Process context
+ * @param request Request received from the client
+ * @param response_length Length of the generated response
+ * @return char* Response buffer, must be freed by the caller
+ */
+char *build_client_response(ctx_t *ctx, const char *request, size_t *response_length)
+{
+    const char *student_name = "Pedro Wozniak Lorice";
+    const char *legajo = "140-728.4";
+
+    last_temp_t last_temp;
+    plot_image_t *image;
+    char *tmp_msg, *method, *path, *query, *response, *save_ptr;
+
+    if((tmp_msg = strdup(request)) == NULL)
+    {
+        perror("strdup error");
+        return NULL;
+    }
+
+    method = strtok_r(tmp_msg, " /", &save_ptr);
+
+    if(method == NULL)
+    {
+        free(tmp_msg);
+        return NULL;
+    }
+
+    path = strtok_r(NULL, " ", &save_ptr);
+
+    if(!strcasecmp(method, "GET") && path != NULL && !strncmp(path, "/history", strlen("/history")))
+    {
+        query = strchr(path, '?');
+        response = build_history_response(query != NULL ? query + 1 : "", response_length);
+    }
+    else if(!strcasecmp(method, "GET"))
+    {
+        get_last_temp(ctx, &last_temp);
+        image = plot_cache_get(ctx);
+        response = build_response_data(
+          student_name, legajo, &last_temp, image ? image->data : "", response_length);
+        plot_cache_put(image);
+    }
+    else
+    {
+        response = build_invalid_response(method, response_length);
+    }
+
+    free(tmp_msg);
+    return response;
 }
 
 
@@ -236,15 +340,16 @@ int main(int argc, char *argv[])
 {
     ctx_t ctx_a;
     ctx_t *ctx = &ctx_a;
-    uint32_t sock_client;
 
-    ctx->config_file = malloc(sizeof(ctx->config_file));
+    ctx->config_file = malloc(sizeof(config_file_t));
 
     /* Set default values */
-    ctx->backlog = 2;
-    ctx->max_conn = 1000;
-    ctx->read_interval = 1;
-    ctx->samples = 5;
+    ctx->config_file->backlog = ctx->backlog = 2;
+    ctx->config_file->max_conn = ctx->max_conn = 1000;
+    ctx->config_file->read_interval = ctx->read_interval = 1;
+    ctx->config_file->samples = ctx->samples = 5;
+    ctx->config_file->workers = ctx->workers = WORKER_POOL_DEFAULT_WORKERS;
+    ctx->config_file->queue_depth = ctx->queue_depth = WORKER_POOL_DEFAULT_QUEUE_DEPTH;
 
     if(read_config_file(ctx->config_file, (argc == 2 ? argv[1] : NULL)) == ERROR)
     {
@@ -256,6 +361,8 @@ int main(int argc, char *argv[])
     ctx->max_conn = ctx->config_file->max_conn;
     ctx->read_interval = ctx->config_file->read_interval;
     ctx->samples = ctx->config_file->samples;
+    ctx->workers = ctx->config_file->workers;
+    ctx->queue_depth = ctx->config_file->queue_depth;
 
     if(pipe(ctx->pipefd) == ERROR)
     {
@@ -288,10 +395,9 @@ int main(int argc, char *argv[])
 
     /* Initialize semaphores */
     sem_initialise(SEM_MUTEX, 1);
-    sem_initialise(SEM_FULL, 0);
-    sem_initialise(SEM_EMPTY, 10);
 
-    /* Assign shared memory pointer */
+    /* Assign shared memory pointer. 1: raw samples from the driver handler, 2: samples stored
+     * by the plot handler */
     ctx->shared_data_1 = ( shared_mem_t * )shared_mem_1;
     ctx->shared_data_2 = ( shared_mem_t * )shared_mem_2;
 
@@ -368,82 +474,10 @@ int main(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
-    struct timeval tv = { 5, 0 };
-
-    uint32_t old_max_conn = ctx->max_conn;
-    pthread_t *thread_id; /* Allocate max_conn threads */
-    pthread_attr_t attr;
-
-    thread_id = malloc(ctx->max_conn * sizeof(pthread_t));
-
-    while(1)
+    /* Serve every client from the epoll connection engine */
+    if(event_loop_run(ctx, sock_fd) == ERROR)
     {
-        uint32_t nbr_fds;
-        args_t args_client;
-
-        fd_set readfds;
-        FD_ZERO(&readfds);
-        FD_SET(sock_fd, &readfds);
-        nbr_fds = select(sock_fd + 1, &readfds, NULL, NULL, &tv);
-
-        if((nbr_fds < 0) && (errno != EINTR))
-        {
-            close(sock_client), perror("select error");
-            exit(EXIT_FAILURE);
-        }
-        else if(!FD_ISSET(sock_fd, &readfds))
-        {
-            continue;
-        }
-
-        if((sock_client = accept(sock_fd, ( struct sockaddr * )&server_addr, &socket_length)) ==
-           ERROR)
-        {
-            close(sock_client);
-            perror("accept error");
-            exit(EXIT_FAILURE);
-        }
-
-        g_number_of_threads++;
-
-        if(g_number_of_threads > ctx->config_file->max_conn)
-        {
-            printf("Cannot accept more clients\n");
-            close(sock_client); /* TODO: Enviar mensaje de error al cliente ej: 404? */
-            g_number_of_threads--;
-            continue;
-        }
-
-        args_client.ctx_client = ctx;
-        args_client.sock_fd = sock_client;
-
-        /* Create dynamic threads */
-        if(ctx->max_conn > old_max_conn ||
-           (ctx->max_conn < old_max_conn && ctx->max_conn > g_number_of_threads))
-        {
-            thread_id = realloc(thread_id, ctx->max_conn * sizeof(pthread_t));
-        }
-
-        pthread_attr_init(&attr); /* Allocate attrib */
-
-        if(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED))
-        {
-            close(sock_client);
-            perror("pthread_attr_setdetachstate error");
-            exit(EXIT_FAILURE);
-        }
-
-        /* Create detached thread */
-        if((*thread_id = pthread_create(
-              &thread_id[g_number_of_threads], &attr, &client_thread, ( void * )&args_client)) ==
-           ERROR)
-        {
-            close(sock_client);
-            perror("pthread_create error");
-            exit(EXIT_FAILURE);
-        }
-
-        pthread_attr_destroy(&attr); /* Free attrib */
+        perror("event_loop_run error");
     }
 
     if(shmdt(shared_mem_1) == ERROR || shmdt(shared_mem_2) == ERROR)
@@ -459,6 +493,33 @@ int main(int argc, char *argv[])
     exit(EXIT_SUCCESS);
 }
 
+/**
+ * @brief Reload the config file in the parent process and forward the request to the config
+ * file process so the other childs get it through the pipe
+ *
+ * @param ctx Process context
+ */
+void reload_config(ctx_t *ctx)
+{
+    flag_sigusr1 = false;
+
+    if(read_config_file(ctx->config_file, NULL) == ERROR)
+    {
+        perror("read config file error");
+        return;
+    }
+
+    ctx->backlog = ctx->config_file->backlog;
+    ctx->max_conn = ctx->config_file->max_conn;
+    ctx->read_interval = ctx->config_file->read_interval;
+    ctx->samples = ctx->config_file->samples;
+    ctx->workers = ctx->config_file->workers;
+    ctx->queue_depth = ctx->config_file->queue_depth;
+
+    kill(cpid_config_file, SIGUSR1);
+}
+
+
 /**
  * @brief Process that handles the config file
  *
@@ -468,7 +529,7 @@ void child_config_file(ctx_t *ctx)
 {
     TRACE_MID("Child Config File started with PID: %d\n", getpid());
 
-    config_file_t *config_file = malloc(sizeof(config_file));
+    config_file_t *config_file = malloc(sizeof(config_file_t));
 
     while(1)
     {
@@ -479,7 +540,7 @@ void child_config_file(ctx_t *ctx)
                 perror("read config file error");
                 exit(EXIT_FAILURE);
             }
-            write(ctx->pipefd[WRITE], config_file, 2 * sizeof(config_file));
+            write(ctx->pipefd[WRITE], config_file, sizeof(config_file_t));
             flag_sigusr1 = false;
 
             printf("Se actualizo pipefd\n");
@@ -0,0 +1,252 @@
+/**
+ * @file worker_pool.c
+ * @author Pedro Wozniak Lorice (pwozniaklorice@est.frba.utn.edu.ar)
+ * @brief Fixed pool of worker threads fed by a bounded queue
+ * @version 0.1
+ * @date 2026-10-16
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+
+#include "../../inc/worker_pool.h"
+
+
+/**
+ * @brief Worker thread, runs queued jobs until the pool shrinks below it
+ *
+ * @param arg Worker pool
+ * @return void* Return value
+ */
+static void *_worker_thread(void *arg)
+{
+    worker_pool_t *pool = arg;
+    work_item_t item;
+    sigset_t sig_block_mask;
+
+    /* Signals are handled by the event loop thread */
+    sigfillset(&sig_block_mask);
+    pthread_sigmask(SIG_BLOCK, &sig_block_mask, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while(1)
+    {
+        while(pool->count == 0 && pool->live_workers <= pool->target_workers)
+        {
+            pthread_cond_wait(&pool->not_empty, &pool->lock);
+        }
+
+        if(pool->live_workers > pool->target_workers)
+        {
+            break;
+        }
+
+        item = pool->items[pool->head];
+        pool->head = (pool->head + 1) % pool->capacity;
+        pool->count--;
+
+        pthread_mutex_unlock(&pool->lock);
+        item.fn(item.arg);
+        pthread_mutex_lock(&pool->lock);
+    }
+
+    pool->live_workers--;
+    pthread_mutex_unlock(&pool->lock);
+
+    TRACE_LOW("Worker exited, %d left\n", pool->live_workers);
+
+    return NULL;
+}
+
+
+/**
+ * @brief Spawn detached workers until live_workers reaches target_workers. Called with lock held
+ *
+ * @param pool Worker pool
+ * @return ssize_t Return value
+ */
+static ssize_t _spawn_workers(worker_pool_t *pool)
+{
+    pthread_attr_t attr;
+    pthread_t thread_id;
+
+    pthread_attr_init(&attr); /* Allocate attrib */
+
+    if(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED))
+    {
+        perror("pthread_attr_setdetachstate error");
+        pthread_attr_destroy(&attr);
+        return ERROR;
+    }
+
+    while(pool->live_workers < pool->target_workers)
+    {
+        if(pthread_create(&thread_id, &attr, &_worker_thread, pool) != 0)
+        {
+            perror("pthread_create error");
+            pool->target_workers = pool->live_workers;
+            pthread_attr_destroy(&attr);
+            return ERROR;
+        }
+        pool->live_workers++;
+    }
+
+    pthread_attr_destroy(&attr); /* Free attrib */
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Resize the queue storage keeping the pending jobs. Called with lock held
+ *
+ * @param pool Worker pool
+ * @param queue_depth New queue depth, never below the pending jobs
+ * @return ssize_t Return value
+ */
+static ssize_t _resize_queue(worker_pool_t *pool, uint32_t queue_depth)
+{
+    work_item_t *items;
+
+    if(queue_depth < pool->count)
+    {
+        queue_depth = pool->count;
+    }
+
+    if(queue_depth == 0 || queue_depth == pool->capacity)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    if((items = malloc(queue_depth * sizeof(work_item_t))) == NULL)
+    {
+        perror("malloc error");
+        return ERROR;
+    }
+
+    for(uint32_t i = 0; i < pool->count; i++)
+    {
+        items[i] = pool->items[(pool->head + i) % pool->capacity];
+    }
+
+    free(pool->items);
+    pool->items = items;
+    pool->capacity = queue_depth;
+    pool->head = 0;
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Initialize the pool and pre-spawn its workers
+ *
+ * @param pool Worker pool
+ * @param workers Number of workers
+ * @param queue_depth Max number of queued jobs
+ * @return ssize_t Return value
+ */
+ssize_t worker_pool_init(worker_pool_t *pool, uint32_t workers, uint32_t queue_depth)
+{
+    ssize_t rv;
+
+    memset(pool, 0, sizeof(worker_pool_t));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->not_empty, NULL);
+
+    pthread_mutex_lock(&pool->lock);
+
+    if(_resize_queue(pool, queue_depth ? queue_depth : WORKER_POOL_DEFAULT_QUEUE_DEPTH) == ERROR)
+    {
+        pthread_mutex_unlock(&pool->lock);
+        return ERROR;
+    }
+
+    pool->target_workers = workers ? workers : WORKER_POOL_DEFAULT_WORKERS;
+    rv = _spawn_workers(pool);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    TRACE_MID("Worker pool started with %d workers, queue depth %d\n",
+              pool->live_workers,
+              pool->capacity);
+
+    return rv;
+}
+
+
+/**
+ * @brief Queue a job without blocking the caller
+ *
+ * @param pool Worker pool
+ * @param fn Job function
+ * @param arg Job argument
+ * @return ssize_t Return value, ERROR if the queue is full
+ */
+ssize_t worker_pool_submit(worker_pool_t *pool, work_fn_t fn, void *arg)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    if(pool->count == pool->capacity)
+    {
+        pthread_mutex_unlock(&pool->lock);
+        return ERROR;
+    }
+
+    pool->items[(pool->head + pool->count) % pool->capacity].fn = fn;
+    pool->items[(pool->head + pool->count) % pool->capacity].arg = arg;
+    pool->count++;
+
+    pthread_cond_signal(&pool->not_empty);
+    pthread_mutex_unlock(&pool->lock);
+
+    return EXIT_SUCCESS;
+}
+
+
+/**
+ * @brief Grow or shrink the pool live. Extra workers exit once they finish their current job
+ *
+ * @param pool Worker pool
+ * @param workers Number of workers
+ * @param queue_depth Max number of queued jobs
+ * @return ssize_t Return value
+ */
+ssize_t worker_pool_resize(worker_pool_t *pool, uint32_t workers, uint32_t queue_depth)
+{
+    ssize_t rv = EXIT_SUCCESS;
+
+    if(workers == 0)
+    {
+        workers = 1;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    if(_resize_queue(pool, queue_depth) == ERROR)
+    {
+        rv = ERROR;
+    }
+
+    pool->target_workers = workers;
+
+    if(pool->live_workers < pool->target_workers)
+    {
+        if(_spawn_workers(pool) == ERROR)
+        {
+            rv = ERROR;
+        }
+    }
+    else
+    {
+        pthread_cond_broadcast(&pool->not_empty); /* Wake idle workers so the extra ones exit */
+    }
+
+    TRACE_MID("Worker pool resized to %d workers, queue depth %d\n", workers, pool->capacity);
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return rv;
+}